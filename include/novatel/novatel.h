@@ -41,15 +41,27 @@
 
 #include <string>
 #include <cstring> // for size_t
+#include <map>
+#include <vector>
+#include <bitset>
+#include <deque>
+#include <set>
+#include <typeinfo>
 
 // #include "novatel/generate_crc.hpp"
 // Structure definition headers
 #include "novatel/novatel_enums.h"
 #include "novatel/novatel_structures.h"
+#include "novatel/novatel_subscribers.h"
+#include "novatel/novatel_commands.h"
+#include "novatel/novatel_metrics.h"
+#include "novatel/novatel_trace.h"
 // Boost Headers
 #include <boost/function.hpp>
 #include <boost/thread.hpp>
+#include <boost/thread/future.hpp>
 #include <boost/bind.hpp>
+#include <boost/atomic.hpp>
 //#include <boost/condition_variable.hpp>
 // Serial Headers
 #include "serial/serial.h"
@@ -63,8 +75,100 @@ namespace novatel {
 #define CRC32_POLYNOMIAL 0xEDB88320L
 
 
+/*!
+ * Returns the name used in LOG commands for a binary log (e.g. "BESTPOSB"),
+ * or NULL if the log type is unknown.
+ */
+const char* BinaryLogName(BINARY_LOG_TYPE log_type);
+
+/*!
+ * Looks up a binary log by its LOG command name.  The comparison ignores
+ * case.  Returns false if the name is not a known binary log.
+ */
+bool BinaryLogTypeFromName(const std::string &name, BINARY_LOG_TYPE *log_type);
+
+//! Result of a command sent to the receiver
+struct CommandResult
+{
+    CommandStatus status;
+    std::string command;  //!< command as sent, without the line ending
+    std::string message;  //!< receiver's error text, or a description of the failure
+};
+
+//! Statistics of the thread that writes to the serial port
+struct WriterStatistics
+{
+    size_t queue_depth;           //!< commands waiting to be written
+    size_t correction_backlog;    //!< correction bytes waiting to be written
+    uint64_t writes;              //!< serial port writes made
+    uint64_t commands_written;    //!< commands written; several may share a write
+    uint64_t bytes_written;
+    uint64_t write_errors;
+    uint64_t corrections_dropped; //!< correction bytes dropped because the backlog was full
+    double last_latency_ms;       //!< time the oldest command in the last write was queued
+    double max_latency_ms;
+    double mean_latency_ms;
+};
+
+//! Load one log puts on the serial port
+struct LogBandwidth
+{
+    std::string log;            //!< log as given to ConfigureLogs(), after any replanning
+    BINARY_LOG_TYPE log_type;
+    double message_bytes;       //!< bytes per message, including header and CRC
+    double rate;                //!< messages per second
+    double bytes_per_second;
+    bool size_known;            //!< false if the size of the log is not known
+    bool periodic;              //!< requested ONTIME, so its period can be lengthened
+    bool replanned;             //!< period lengthened to fit the port
+};
+
+//! Load a set of logs puts on the serial port
+struct BandwidthPlan
+{
+    std::vector<LogBandwidth> logs;
+    double bytes_per_second;    //!< total of all logs
+    double capacity;            //!< bytes per second the port carries, 10 bits per byte
+    double utilization;         //!< bytes_per_second/capacity, 0 if the baud rate is unknown
+    bool fits;                  //!< utilization is within the limit set with SetBandwidthPolicy()
+};
+
+//! Number of bins in LogTimingStatistics::jitter_histogram
+#define LOG_JITTER_BINS 8
+
+//! Regularity of the messages of one log
+struct LogTimingStatistics
+{
+    double period;                //!< expected period [sec], 0 until configured or learned
+    uint64_t messages;
+    uint64_t gaps;                //!< times one or more epochs were missing
+    uint64_t missed;              //!< epochs missing in all gaps
+    uint64_t duplicates;
+    uint64_t out_of_order;
+    double max_jitter_ms;         //!< largest arrival jitter
+    /*!
+     * Messages by arrival jitter: the time between arrivals less the time
+     * between their epochs.  Bin 0 counts jitter under 1 ms, bin n from
+     * 2^(n-1) ms up to 2^n ms, and the last bin everything above.
+     */
+    uint64_t jitter_histogram[LOG_JITTER_BINS];
+};
+
+//! An irregularity in the stream of a log
+struct LogTimingEvent
+{
+    BINARY_LOG_TYPE log_type;
+    LogTimingEventType type;
+    double gps_time;              //!< GPS time of the message [sec into week]
+    double previous_gps_time;     //!< GPS time of the last message in order [sec into week]
+    uint32_t missed;              //!< epochs missing, for LOG_GAP
+};
+
 typedef boost::function<double()> GetTimeCallback;
 typedef boost::function<void()> HandleAcknowledgementCallback;
+typedef boost::function<void(const CommandResult&)> CommandCallback;
+typedef boost::function<void(ConnectionState)> ConnectionStateCallback;
+typedef boost::function<void(const LogTimingEvent&)> LogTimingCallback;
 
 // Messaging callbacks
 typedef boost::function<void(const std::string&)> LogMsgCallback;
@@ -128,9 +232,152 @@ public:
     */
     void Disconnect();
 
+  /*!
+   * Finds the baud rate of a receiver that is already sending logs,
+   * without sending it anything.  Listens at each rate from 9600 to
+   * 921600 baud until a message with a valid CRC arrives, so a silent
+   * line takes eight sample periods.  Connect() with search set calls it
+   * when the receiver does not answer at the rate asked for, before
+   * writing to the port at any other rate.
+   *
+   * @param sample_ms time to listen at each rate
+   * @param first_baud rate to listen at first, e.g. the one expected
+   *
+   * @return the baud rate found, or 0 if no rate gave a valid message
+   */
+  int DetectBaudRate(std::string port, uint32_t sample_ms=250, int first_baud=0);
+
+  /*!
+   * Selects whether the connection is supervised (default).  While it is,
+   * a read error or a silence longer than three periods of the fastest
+   * ONTIME log counts as losing the receiver.  The port is then reopened,
+   * retrying with a backoff from 10 ms up to 500 ms, at the same baud rate
+   * and after a few attempts with a baud rate search.  Once reconnected,
+   * the logs, interface modes and port baud rates configured before are
+   * restored and subscribers are told of the gap.
+   */
+  void SetAutoReconnect(bool enable);
+
+  /*!
+   * Sets a handler called when a log misses epochs, repeats one or sends
+   * one out of order.  Each log is expected to come at the ONTIME period
+   * it was requested at, or else at the period seen between two pairs of
+   * messages in a row.  It is called on the read thread, like the data
+   * callbacks.
+   */
+  void set_log_timing_callback(LogTimingCallback handler);
+
+  //! Regularity of the messages of a log received so far
+  LogTimingStatistics GetLogTimingStatistics(BINARY_LOG_TYPE log_type);
+
+  //! Counters and gauges of the driver since it was created
+  MetricsSnapshot GetMetrics();
+
+  /*!
+   * Selects whether the stages each binary log goes through are timed (on
+   * by default).  Timing costs a clock read per stage and a histogram
+   * bucket increment, cheap enough to leave on.
+   */
+  void SetLatencyTracking(bool enable) {latency_tracking_=enable;}
+
+  /*!
+   * Sets how many seconds GPS time is ahead of UTC (18 since 2017), used to
+   * map the GPS time in each log's header onto the host clock to work out
+   * the log's age.  The age is only meaningful if the host clock is
+   * synchronized, e.g. by NTP or PPS.
+   */
+  void SetGpsUtcOffset(int seconds) {gps_utc_offset_=seconds;}
+
+  //! Latencies of a log in one stage so far, all zero if never timed
+  LatencySummary GetLatency(BINARY_LOG_TYPE log_type, LatencyStage stage);
+
+  /*!
+   * Starts tracing serial reads and writes, messages framed, decoded and
+   * handed to subscribers, and commands completed, keeping the last
+   * events_per_thread events of each thread.  Off by default; while off
+   * each trace point costs a flag test.
+   */
+  void StartTracing(size_t events_per_thread=65536) {tracer_.Start(events_per_thread);}
+  void StopTracing() {tracer_.Stop();}
+
+  //! Events traced so far in the Chrome trace event JSON format, for Perfetto
+  std::string GetTrace() {return tracer_.ChromeTraceJson();}
+
+  //! Writes GetTrace() to a file
+  bool WriteTrace(const std::string &path);
+
+  //! GetMetrics() in the Prometheus text exposition format
+  std::string GetPrometheusMetrics() {return FormatPrometheusMetrics(GetMetrics());}
+
+  /*!
+   * Serves GetPrometheusMetrics() on a Unix domain socket at path until
+   * StopServingMetrics() or the driver is destroyed.  Each client
+   * connecting is sent the metrics and disconnected, e.g.
+   * `socat - UNIX-CONNECT:path`.
+   */
+  bool ServeMetrics(const std::string &path);
+  void StopServingMetrics() {metrics_server_.Stop();}
+
+  /*!
+   * Selects whether low priority logs are slowed down while the receiver
+   * is overloaded (off by default).  Once a second the supervisor thread
+   * looks at the idle time and status word in the headers of the logs
+   * received, and counts the messages of each ONTIME log.  Less than 10%
+   * idle time, the CPU overload or a port overrun flag, or an ONTIME log
+   * arriving less often than asked for count as overloaded; each low
+   * priority ONTIME log then has its period lengthened a step, up to 8
+   * times the period requested.  After 5 s with over 30% idle time the
+   * periods are shortened again a step at a time.  Other logs always keep
+   * their rate.  Turning this off restores the periods requested.
+   */
+  void SetAdaptiveLogRates(bool enable);
+
+  /*!
+   * Marks a log as low priority, to be slowed down first when the receiver
+   * is overloaded.  Ephemerides, satellite visibility and positions,
+   * tracking status, DOPs and hardware levels are low priority to begin
+   * with.
+   */
+  void SetLogPriority(BINARY_LOG_TYPE log_type, bool low_priority);
+
+  //! Number of times the connection has been restored
+  uint32_t reconnect_count() const {return reconnect_count_;}
+
+  /*!
+   * Selects whether Disconnect() stops the logs on the receiver's port with
+   * UNLOGALL (default).  Leaving them running lets the next connection
+   * carry on without a gap in the data.
+   */
+  void SetStopLogsOnDisconnect(bool enable) {stop_logs_on_disconnect_=enable;};
+
+  /*!
+   * Keeps the receiver cache in a file as well as in memory, so that warm
+   * reconnects also work after the program restarts.  Loads the cache from
+   * the file if it exists.
+   *
+   * The cache holds the version of the receiver last identified on each
+   * port and the logs requested from it.  When Connect() finds the same
+   * serial number on the port again it skips reading the LOGLIST, and
+   * ConfigureLogs() only sends the LOG commands that differ.
+   */
+  bool SetReceiverCacheFile(const std::string &path);
+
+  //! Forgets every cached receiver and deletes the cache file
+  void ClearReceiverCache();
+
   //! Indicates if a connection to the receiver has been established.
   bool IsConnected() {return is_connected_;}
 
+  //! Current step of connecting to the receiver
+  ConnectionState connection_state() const {return connection_state_;}
+
+  /*!
+   * Sets a handler called with each new connection state.  It is called
+   * on the thread calling Connect() or Disconnect(), or on the supervisor
+   * thread while reconnecting.
+   */
+  void set_connection_state_callback(ConnectionStateCallback handler);
+
   /*!
 
      * Pings the GPS to determine if it is properly connected
@@ -173,8 +420,56 @@ public:
      *               - [B]=Binary
      *               . [empty]=Abreviated ASCII
      * log_string format: "BESTUTMB ONTIME 1.0; BESTVELB ONTIME 1.0"
+     *
+     * All LOG commands are written back to back and the receiver's
+     * responses are matched to them in order.  Logs the receiver rejects
+     * are reported with its error message; logs with no response are
+     * sent again, up to five times.
+     *
+     * @return true if every log was acknowledged
      */
-    void ConfigureLogs(std::string log_string);
+    bool ConfigureLogs(std::string log_string);
+
+    /*!
+     * Works out the load the logs in log_string, together with the other
+     * logs already requested on this port, would put on the port.  Message
+     * sizes come from the last message of each log received, or else from
+     * the log's structure, with a typical number of observations for logs
+     * with repeated blocks.  Only ONTIME logs, and IMU logs at a typical
+     * IMU rate, count; logs sent on change are too irregular to plan for.
+     * Logs given with a port are for another port and are left out.
+     *
+     * @param replan lengthen ONTIME periods, largest load first, until the
+     * logs fit
+     */
+    BandwidthPlan PlanBandwidth(const std::string &log_string, bool replan=false);
+
+    /*!
+     * Sets what ConfigureLogs() and SetLogConfiguration() do when the logs
+     * asked for would load the port beyond max_utilization of its
+     * capacity.  The default is to warn when above 80%.
+     *
+     * With BANDWIDTH_RAISE_BAUD the port is switched with SetBaudRate() to
+     * the lowest rate up to max_baudrate the logs fit into.
+     */
+    void SetBandwidthPolicy(BandwidthPolicy policy, double max_utilization=0.8,
+        int max_baudrate=921600) {
+        bandwidth_policy_=policy; max_utilization_=max_utilization; max_baud_rate_=max_baudrate;};
+
+    /*!
+     * Makes the logs on this port match log_string, which has the format
+     * of ConfigureLogs().  Reads the receiver's LOGLIST and sends LOG
+     * commands only for logs that are missing or have a different trigger,
+     * and UNLOG commands for logs that are not wanted.  Logs with
+     * subscribers or data callbacks are kept.  Logs already running as
+     * asked keep running without a gap.
+     *
+     * Falls back to ConfigureLogs() if the receiver does not answer the
+     * LOGLIST request.
+     *
+     * @return true if every change was acknowledged
+     */
+    bool SetLogConfiguration(std::string log_string);
     void Unlog(std::string log); //!< Stop logging a specified log
     void UnlogAll(); //!< Stop logging all logs that aren't set with HOLD parameter
 
@@ -189,9 +484,75 @@ public:
 
     void ConfigureBaudRate(std::string com_port, int baudrate);
 
-    void SetBaudRate(int baudrate, std::string com_port="COM1");
+    /*!
+     * Changes the baud rate of the receiver's port and of the host's port
+     * together, and checks the receiver answers at the new rate.  If it
+     * does not, the old rate is restored, searching for the receiver if
+     * it did change.  Logs keep running throughout.
+     *
+     * @param com_port receiver port the host is connected to
+     *
+     * @return true if the receiver answers at the new baud rate
+     */
+    bool SetBaudRate(int baudrate, std::string com_port="THISPORT");
+
+    /*!
+     * Sends a command and waits for the receiver's response.
+     *
+     * Must not be called from a data callback, since responses are read
+     * by the same thread.
+     *
+     * @return true if the receiver acknowledged the command
+     */
+    bool SendCommand(std::string cmd_msg, uint32_t timeout_ms=2000);
+
+    /*!
+     * Sends a command without waiting for the response.
+     *
+     * Commands may be sent from any number of threads; they are written
+     * one at a time and each response is matched to its own command.  The
+     * result is available from the returned future and is also passed to
+     * callback, if set, on the thread that completes the command (usually
+     * the read thread).  Commands with no response within timeout_ms
+     * complete with COMMAND_TIMEOUT.
+     */
+    boost::unique_future<CommandResult> SendCommandAsync(const std::string &command,
+        uint32_t timeout_ms=2000, CommandCallback callback=CommandCallback());
+
+    /*!
+     * Sends a binary command built with EncodeCommand() without waiting
+     * for the response, like SendCommandAsync().  Binary responses are
+     * matched to commands by command id, oldest first.
+     *
+     * @param description used as CommandResult::command and in log messages
+     */
+    boost::unique_future<CommandResult> SendBinaryCommandAsync(const std::string &description,
+        const std::string &message, uint32_t timeout_ms=2000,
+        CommandCallback callback=CommandCallback());
+
+    /*!
+     * Selects whether the methods that configure the receiver (e.g.
+     * SetInitialPosition(), HardwareReset(), UnlogAll()) send their
+     * commands in binary (default) or ASCII.  Binary commands carry
+     * numbers exactly and their responses are CRC protected.  Commands
+     * given as text, as to SendCommand() and ConfigureLogs(), are always
+     * sent as ASCII.
+     */
+    void SetBinaryCommands(bool enable) {binary_commands_=enable;};
+
+    /*!
+     * Queues correction data (e.g. RTCM) to be written to the receiver.
+     * Corrections are written in between commands and no faster than the
+     * port's baud rate can carry them, so a burst of corrections does not
+     * hold up commands.  Data that would wait more than two seconds behind
+     * corrections already queued is dropped.
+     *
+     * @return false if not connected or the data was dropped
+     */
+    bool SendCorrections(const unsigned char *data, size_t length);
 
-    bool SendCommand(std::string cmd_msg);
+    //! Gets the statistics of the serial port writer thread
+    WriterStatistics GetWriterStatistics();
 
     /*!
      * SetSvElevationCutoff
@@ -262,75 +623,341 @@ public:
      */
 	bool UpdateVersion();
 
+    /*!
+     * Requests a single message of a binary log with "LOG <log> ONCE".
+     *
+     * The message is taken from the normal stream of decoded messages, so
+     * the future is ready as soon as it arrives.  If the receiver rejects
+     * the request or no message arrives within timeout_ms the future holds
+     * a std::runtime_error instead.  Replies are read by the read thread,
+     * so do not wait for one from a data callback.
+     *
+     * Example: Query<Version>(VERSIONB_LOG_TYPE).get()
+     *
+     * @param log_type binary log to request; T must be its structure
+     */
+    template <typename T>
+    boost::unique_future<T> Query(BINARY_LOG_TYPE log_type, uint32_t timeout_ms=2000) {
+        boost::shared_ptr<QuerySubscriber<T> > query(new QuerySubscriber<T>(log_type));
+        boost::unique_future<T> future = query->GetFuture();
+        StartQuery(query, typeid(T), timeout_ms);
+        return boost::move(future);
+    }
+
+    /*!
+     * Like Query(), for logs the receiver answers with several messages
+     * (e.g. RXCONFIGB).  The future is ready once the last message, with
+     * header sequence 0, arrives.
+     */
+    template <typename T>
+    boost::unique_future<std::vector<T> > QuerySequence(BINARY_LOG_TYPE log_type,
+        uint32_t timeout_ms=2000) {
+        boost::shared_ptr<QuerySequenceSubscriber<T> > query(
+            new QuerySequenceSubscriber<T>(log_type));
+        boost::unique_future<std::vector<T> > future = query->GetFuture();
+        StartQuery(query, typeid(T), timeout_ms);
+        return boost::move(future);
+    }
+
     bool ConvertLLaUTM(double Lat, double Long, double *northing, double *easting, int *zone, bool *north);
 
     // Set data callbacks
     void set_best_gps_position_callback(BestGpsPositionCallback handler){
-        best_gps_position_callback_=handler;};
+        SetCallback<Position>(BESTGPSPOS_LOG_TYPE, handler);};
     void set_best_lever_arm_callback(BestLeverArmCallback handler){
-        best_lever_arm_callback_=handler;};
+        SetCallback<BestLeverArm>(BESTLEVERARM_LOG_TYPE, handler);};
     void set_best_position_callback(BestPositionCallback handler){
-        best_position_callback_=handler;};
+        SetCallback<Position>(BESTPOSB_LOG_TYPE, handler);};
     void set_best_utm_position_callback(BestUtmPositionCallback handler){
-        best_utm_position_callback_=handler;};
+        SetCallback<UtmPosition>(BESTUTMB_LOG_TYPE, handler);};
     void set_best_velocity_callback(BestVelocityCallback handler){
-        best_velocity_callback_=handler;};
+        SetCallback<Velocity>(BESTVELB_LOG_TYPE, handler);};
     void set_best_position_ecef_callback(BestPositionEcefCallback handler){
-        best_position_ecef_callback_=handler;};
+        SetCallback<PositionEcef>(BESTXYZB_LOG_TYPE, handler);};
     void set_ins_position_velocity_attitude_callback(InsPositionVelocityAttitudeCallback handler){
-        ins_position_velocity_attitude_callback_=handler;};
+        SetCallback<InsPositionVelocityAttitude>(INSPVA_LOG_TYPE, handler);};
     void set_ins_position_velocity_attitude_short_callback(InsPositionVelocityAttitudeShortCallback handler){
-        ins_position_velocity_attitude_short_callback_=handler;};
+        SetCallback<InsPositionVelocityAttitudeShort>(INSPVAS_LOG_TYPE, handler);};
     void set_vehicle_body_rotation_callback(VehicleBodyRotationCallback handler){
-        vehicle_body_rotation_callback_=handler;};
+        SetCallback<VehicleBodyRotation>(VEHICLEBODYROTATION_LOG_TYPE, handler);};
     void set_ins_speed_callback(InsSpeedCallback handler){
-        ins_speed_callback_=handler;};
+        SetCallback<InsSpeed>(INSSPD_LOG_TYPE, handler);};
     void set_raw_imu_callback(RawImuCallback handler){
-        raw_imu_callback_=handler;};
+        SetCallback<RawImu>(RAWIMU_LOG_TYPE, handler);};
     void set_raw_imu_short_callback(RawImuShortCallback handler){
-        raw_imu_short_callback_=handler;};
+        SetCallback<RawImuShort>(RAWIMUS_LOG_TYPE, handler);};
     void set_ins_covariance_callback(InsCovarianceCallback handler){
-        ins_covariance_callback_=handler;};
+        SetCallback<InsCovariance>(INSCOV_LOG_TYPE, handler);};
     void set_ins_covariance_short_callback(InsCovarianceShortCallback handler){
-        ins_covariance_short_callback_=handler;};
+        SetCallback<InsCovarianceShort>(INSCOVS_LOG_TYPE, handler);};
     void set_pseudorange_dop_callback(PseudorangeDopCallback handler){
-        pseudorange_dop_callback_=handler;};
+        SetCallback<Dop>(PSRDOPB_LOG_TYPE, handler);};
     void set_rtk_dop_callback(RtkDopCallback handler){
-        rtk_dop_callback_=handler;};
+        SetCallback<Dop>(RTKDOPB_LOG_TYPE, handler);};
     void set_baseline_ecef_callback(BaselineEcefCallback handler){
-        baseline_ecef_callback_=handler;};
+        SetCallback<BaselineEcef>(BSLNXYZ_LOG_TYPE, handler);};
     void set_ionospheric_model_callback(IonosphericModelCallback handler){
-        ionospheric_model_callback_=handler;};
+        SetCallback<IonosphericModel>(IONUTCB_LOG_TYPE, handler);};
     void set_range_measurements_callback(RangeMeasurementsCallback handler){
-        range_measurements_callback_=handler;};
+        SetCallback<RangeMeasurements>(RANGEB_LOG_TYPE, handler);};
     void set_compressed_range_measurements_callback(CompressedRangeMeasurementsCallback handler){
-        compressed_range_measurements_callback_=handler;};
+        SetCallback<CompressedRangeMeasurements>(RANGECMPB_LOG_TYPE, handler);};
     void set_gps_ephemeris_callback(GpsEphemerisCallback handler){
-        gps_ephemeris_callback_=handler;};
+        SetCallback<GpsEphemeris>(GPSEPHEMB_LOG_TYPE, handler);};
     void set_raw_ephemeris_callback(RawEphemerisCallback handler){
-        raw_ephemeris_callback_=handler;};
+        SetCallback<RawEphemeris>(RAWEPHEMB_LOG_TYPE, handler);};
     void set_satellite_positions_callback(SatellitePositionsCallback handler){
-        satellite_positions_callback_=handler;};
+        SetCallback<SatellitePositions>(SATXYZB_LOG_TYPE, handler);};
     void set_satellite_visibility_callback(SatelliteVisibilityCallback handler){
-        satellite_visibility_callback_=handler;};
+        SetCallback<SatelliteVisibility>(SATVISB_LOG_TYPE, handler);};
     void set_time_offset_callback(TimeOffsetCallback handler){
-        time_offset_callback_=handler;};
+        SetCallback<TimeOffset>(TIMEB_LOG_TYPE, handler);};
     void set_tracking_status_callback(TrackingStatusCallback handler){
-        tracking_status_callback_=handler;};
+        SetCallback<TrackStatus>(TRACKSTATB_LOG_TYPE, handler);};
     void set_receiver_hardware_status_callback(ReceiverHardwareStatusCallback handler){
-        receiver_hardware_status_callback_=handler;};
+        SetCallback<ReceiverHardwareStatus>(RXHWLEVELSB_LOG_TYPE, handler);};
     void set_best_pseudorange_position_callback(BestPseudorangePositionCallback handler){
-        best_pseudorange_position_callback_=handler;};
+        SetCallback<Position>(PSRPOSB_LOG_TYPE, handler);};
     void set_rtk_position_callback(RtkPositionCallback handler){
-        rtk_position_callback_=handler;};
+        SetCallback<Position>(RTKPOSB_LOG_TYPE, handler);};
 
     void set_raw_msg_callback(RawMsgCallback handler) {
         raw_msg_callback_=handler;};
 
+    /*!
+     * Registers a handler for a binary log.
+     *
+     * Unlike the set_*_callback() methods, any number of handlers may be
+     * registered for the same log, each with its own decimation.  Messages
+     * a handler's decimation rejects are never decoded for it.  The
+     * timestamp passed is the host time at which the message finished
+     * arriving.
+     *
+     * @param log_type binary log to receive; T must be its structure
+     * @return id to pass to Unsubscribe(), or 0 if T does not match log_type
+     */
+    template <typename T>
+    SubscriptionId Subscribe(BINARY_LOG_TYPE log_type,
+        typename CallbackSubscriber<T>::Handler handler,
+        const Decimation &decimation=Decimation()) {
+        boost::shared_ptr<Subscriber> subscriber(new CallbackSubscriber<T>(log_type, handler));
+        subscriber->set_decimation(decimation);
+        return AddSubscriber(subscriber, typeid(T));
+    }
+
+    /*!
+     * Registers a batch handler for a binary log.
+     *
+     * Instead of one call per message, the handler receives all messages
+     * of the given type decoded since the last flush in a single call,
+     * along with the host time at which each message finished arriving.
+     * The arrival times are reconstructed from the position of each message
+     * within the serial read and the port baud rate.
+     *
+     * @param log_type binary log to receive; T must be its structure
+     * @return id to pass to Unsubscribe(), or 0 if T does not match log_type
+     */
+    template <typename T>
+    SubscriptionId SubscribeBatch(BINARY_LOG_TYPE log_type,
+        typename BatchSubscriber<T>::Handler handler,
+        const Decimation &decimation=Decimation()) {
+        boost::shared_ptr<Subscriber> subscriber(new BatchSubscriber<T>(log_type, handler));
+        subscriber->set_decimation(decimation);
+        return AddSubscriber(subscriber, typeid(T));
+    }
+
+    /*!
+     * Registers a handler that receives binary logs as pooled handles.
+     *
+     * Each message is copied once into an object preallocated by a pool
+     * owned by the subscription.  The handle passed to the handler may be
+     * copied and handed to other threads; the object is recycled when the
+     * last copy is released.  If more than pool_capacity messages are held
+     * at once the extra messages are heap allocated and counted as misses.
+     *
+     * @param log_type binary log to receive; T must be its structure
+     * @return id to pass to Unsubscribe(), or 0 if T does not match log_type
+     */
+    template <typename T>
+    SubscriptionId SubscribePooled(BINARY_LOG_TYPE log_type,
+        typename PooledSubscriber<T>::Handler handler, size_t pool_capacity=16,
+        const Decimation &decimation=Decimation()) {
+        boost::shared_ptr<Subscriber> subscriber(
+            new PooledSubscriber<T>(log_type, handler, pool_capacity));
+        subscriber->set_decimation(decimation);
+        return AddSubscriber(subscriber, typeid(T));
+    }
+
+    /*!
+     * Gets the pool statistics of a subscription made with SubscribePooled().
+     * Returns false if there is no such pooled subscription.
+     */
+    bool GetPoolStatistics(SubscriptionId id, PoolStatistics *statistics);
+
+    /*!
+     * Removes a subscription.  Messages a batch subscriber has not yet
+     * been handed are discarded.
+     */
+    bool Unsubscribe(SubscriptionId id);
+
+    /*!
+     * Sets how often batches are handed to batch subscribers.  With a
+     * period of 0 (default) batches are flushed after every serial read,
+     * otherwise they are flushed after the first read at least
+     * milliseconds after the previous flush.
+     */
+    void SetBatchFlushPeriod(uint32_t milliseconds) {
+        batch_flush_period_=milliseconds/1000.0;};
+
+    /*!
+     * Enables demand driven logging.
+     *
+     * While enabled, a LOG command is sent to the receiver when the first
+     * subscriber for a binary log appears and an UNLOG command when the
+     * last one leaves, unless a data callback is also set for that log.
+     * Logs are requested with the trigger last given for them in
+     * ConfigureLogs(), or a default trigger if there was none.  Enabling
+     * requests every log that already has subscribers.
+     */
+    void SetAutoLogging(bool enable);
+
 private:
+    typedef std::vector<boost::shared_ptr<Subscriber> > SubscriberList;
+    typedef std::map<uint16_t, SubscriberList> SubscriberMap;
+    //! set of binary logs indexed by message id
+    typedef std::bitset<MAX_LOG_ID> LogIdSet;
+
+  /*!
+   * Connects at baudrate, or with search set at whatever rate the
+   * receiver is found and then changes it to baudrate.  The search only
+   * starts if the receiver does not answer at baudrate.  The steps shared
+   * by Connect() and Reconnect(); requests no logs itself.
+   */
+  bool FindReceiver(std::string port, int baudrate, bool search);
 
+  /*!
+   * Opens the port, starts the read and write threads and identifies the
+   * receiver.  Each step waits only until its reply arrives, up to
+   * ResponseTimeout().  Disconnects again on failure.
+   */
   bool Connect_(std::string port, int baudrate);
 
+  //! Time to allow for a reply at the current baud rate [ms]
+  uint32_t ResponseTimeout() const;
+
+  /*!
+   * Waits until no data has arrived for about 20 byte times.  Returns
+   * false if the line is still busy after timeout_ms.
+   */
+  bool WaitForQuietLine(uint32_t timeout_ms);
+
+  void SetConnectionState(ConnectionState state);
+
+  /*!
+   * Stops the reader and writer threads and closes the port, without
+   * touching the supervisor.
+   *
+   * @param stop_logs true to send UNLOGALL first
+   */
+  void ClosePort(bool stop_logs);
+
+  //! Starts the supervisor thread if reconnecting or adaptive log rates are enabled and it is not running
+  void StartSupervisor();
+  void StopSupervisor();
+
+  /*!
+   * Method run in the supervisor thread; reconnects each time the port is
+   * lost and adjusts log rates once a second
+   */
+  void Supervise();
+
+  //! Notes the receiver's idle time and status from a log header (read thread only)
+  void RecordReceiverLoad(const Oem4BinaryHeader *header);
+
+  /*!
+   * Checks a message's epoch against the last one of its log and notes its
+   * arrival jitter (read thread only)
+   */
+  void MonitorLogTiming(const Oem4BinaryHeader *header);
+
+  //! Sets the period a log is expected at [ms], 0 to learn it
+  void SetExpectedPeriod(BINARY_LOG_TYPE log_type, uint32_t period_ms);
+
+  //! Measures the receiver's load and adjusts log rates (supervisor thread only)
+  void ControlLogRates();
+
+  /*!
+   * Lengthens the period of each low priority ONTIME log a step if
+   * overloaded, or shortens each slowed log a step if restore.  Returns the
+   * logs to request, separated by semicolons.  (supervisor thread only)
+   */
+  std::string AdjustLogRates(bool overloaded, bool restore, const LogIdSet &low_priority);
+
+  /*!
+   * Reopens the port, retrying until it succeeds or supervision stops,
+   * and restores the configuration.  Returns false if supervision stopped.
+   */
+  bool Reconnect();
+
+  /*!
+   * Called from the read thread when the receiver is lost.  Ends the read
+   * thread and wakes the supervisor.
+   */
+  void PortLost(const std::string &reason);
+
+  /*!
+   * Longest time without data before the receiver counts as lost [ms], or
+   * 0 if no ONTIME log is requested.  subscribers_mutex_ must not be held.
+   */
+  uint32_t SilenceTimeout();
+
+  //! Tells the subscribers in the dispatch table of a gap (read thread only)
+  void NotifyGap(double resumed_timestamp);
+
+  //! What is known about the receiver last identified on a port
+  struct CachedReceiver
+  {
+      std::string serial_number;
+      std::string model;
+      std::string hardware_version;
+      std::string software_version;
+      std::map<uint16_t, std::string> logs;       //!< trigger of each log requested
+      std::map<uint16_t, std::string> saved_logs; //!< logs requested at the last SAVECONFIG
+  };
+
+  /*!
+   * Checks the serial number found by Ping() against the cache and, if
+   * it matches, takes the logs the receiver is sure to still be sending
+   * from the cache instead of reading the LOGLIST.
+   */
+  bool WarmConnect(const std::string &port, const CachedReceiver &cached);
+
+  bool FindCachedReceiver(const std::string &port, CachedReceiver *receiver);
+
+  /*!
+   * Requests LOGLIST and records the binary logs running on this port as
+   * requested, with their triggers.
+   *
+   * @param port_logs if not NULL, receives every log running on this port
+   * @return false if the receiver did not send the list
+   */
+  bool ReadLogList(std::vector<LogListEntry> *port_logs);
+
+  /*!
+   * Records the connected receiver and its requested logs in the cache
+   * and writes the cache file, if there is one.
+   *
+   * @param saved true if the receiver has just saved its configuration
+   */
+  void UpdateReceiverCache(bool saved);
+
+  /*!
+   * Counts the binary and ASCII messages with valid CRCs in data received
+   * at a trial baud rate.  At the wrong rate the bytes are garbled and
+   * nothing passes the CRC check.
+   */
+  static size_t ScoreBaudSample(const unsigned char *data, size_t length);
+
 
 	/*!
 	 * Starts a thread to continuously read from the serial port.
@@ -366,17 +993,300 @@ private:
 	 */
 	void ParseBinary(unsigned char *message, size_t length, BINARY_LOG_TYPE message_id);
 
+	/*!
+	 * Decodes a message into its structure and hands it to all subscribers
+	 * for message_id whose decimation accepts it.  Nothing is decoded if
+	 * nobody takes the message.
+	 */
+	template <typename T>
+	void Dispatch(unsigned char *message, size_t length, BINARY_LOG_TYPE message_id);
+
+	//! Hands held messages to all batch subscribers
+	void FlushBatches();
+
+	SubscriptionId AddSubscriber(boost::shared_ptr<Subscriber> subscriber,
+		const std::type_info &message_type);
+
+	/*!
+	 * Replaces the data callback for log_type.  The callback is kept as a
+	 * subscriber with id 0 so the read thread never sees it change under it.
+	 */
+	template <typename T>
+	void SetCallback(BINARY_LOG_TYPE log_type, const boost::function<void(T&, double&)> &handler) {
+		boost::shared_ptr<Subscriber> callback;
+		if (handler)
+			callback.reset(new CallbackSubscriber<T>(log_type, handler));
+		ReplaceCallback(log_type, callback);
+	}
+	void ReplaceCallback(BINARY_LOG_TYPE log_type, boost::shared_ptr<Subscriber> callback);
+
+	/*!
+	 * Publishes a new subscriber table and retires the old one.
+	 * subscribers_mutex_ must be held.
+	 */
+	void PublishSubscribers(const SubscriberMap &subscribers);
+
+	/*!
+	 * Frees retired subscriber tables the read thread can no longer be
+	 * using.  subscribers_mutex_ must be held.
+	 */
+	void ReclaimSubscriberTables();
+
+	//! Records a "LOG" request taken from ConfigureLogs(); subscribers_mutex_ must be held
+	void RecordLogRequest(const std::string &log);
+
+	/*!
+	 * Sends LOG or UNLOG for log_type without waiting for the receiver's
+	 * response, so it is safe to call from the read thread.  The log is
+	 * recorded as requested or stopped once the receiver accepts it.
+	 */
+	void SendAutoLogCommand(BINARY_LOG_TYPE log_type, bool log);
+	//! Records the result of a command sent by SendAutoLogCommand()
+	void AutoLogCommandDone(BINARY_LOG_TYPE log_type, bool log, const CommandResult &result);
+
+	//! Requests every subscribed log that has not been requested yet
+	void RequestSubscribedLogs();
+
+	/*!
+	 * True if the receiver has been asked for log, a ConfigureLogs() entry,
+	 * with the same trigger.  subscribers_mutex_ must be held.
+	 */
+	bool IsLogRequested(const std::string &log);
+
+	/*!
+	 * Applies the bandwidth policy to logs, which may be replaced with a
+	 * replanned set.  Returns false if the logs are rejected.
+	 *
+	 * @param include_requested count the logs already requested too
+	 */
+	bool CheckBandwidth(std::vector<std::string> *logs, bool include_requested);
+
+	/*!
+	 * Lowest baud rate up to max_baudrate that carries bytes_per_second
+	 * within max_utilization, or 0 if there is none.
+	 */
+	static int SufficientBaudRate(double bytes_per_second, double max_utilization, int max_baudrate);
+
 	bool ParseVersion(std::string packet);
+	bool ParseVersion(const Version &version);
+	//! Sets the receiver information and derives its capabilities from the model
+	void SetVersion(const std::string &model, const std::string &serial_number,
+		const std::string &hardware_version, const std::string &software_version);
+
+	/*!
+	 * Subscribes query for its reply and sends "LOG <log> ONCE".  Fails
+	 * the query if that is not possible.
+	 */
+	void StartQuery(boost::shared_ptr<QueryBase> query, const std::type_info &message_type,
+		uint32_t timeout_ms);
+
+	//! Fails a query whose LOG command was not acknowledged
+	void QueryCommandDone(SubscriptionId id, const CommandResult &result);
+
+	/*!
+	 * Removes the subscribers of completed queries and fails queries whose
+	 * deadline has passed.
+	 */
+	void ExpireQueries();
+
+	//! Query waiting for its reply
+	struct PendingQuery
+	{
+		boost::shared_ptr<QueryBase> query;
+		boost::system_time deadline;
+	};
+
+	//! Command waiting for its response
+	struct PendingCommand
+	{
+		uint64_t sequence; //!< order in which commands of the same format were queued
+		std::string command;
+		boost::system_time deadline;
+		boost::system_time queued; //!< when the command was queued for writing
+		boost::shared_ptr<boost::promise<CommandResult> > promise;
+		CommandCallback callback;
+	};
+
+	/*!
+	 * Queues an ASCII command for the writer thread and returns its
+	 * sequence number.  Responses are matched to commands in the order the
+	 * commands were written.  If the write fails the command completes
+	 * with COMMAND_WRITE_FAILED.
+	 *
+	 * @param pending if not NULL, completed when the response arrives.
+	 * Otherwise the response is still waited for, up to ResponseTimeout(),
+	 * so that a lost one is not matched to the next command.
+	 */
+	uint64_t WriteCommand(const std::string &command, const PendingCommand *pending);
+
+	//! Sets the result of a command and calls its callback
+	void CompleteCommand(const PendingCommand &pending, CommandStatus status,
+		const std::string &message);
+
+	//! Completes pending commands whose deadline has passed with COMMAND_TIMEOUT
+	void ExpireCommands();
+	/*!
+	 * Completes every pending command with COMMAND_WRITE_FAILED and starts
+	 * matching responses afresh, for when the port is closed.
+	 */
+	void AbandonCommands(const std::string &reason);
+
+	//! Called from the read thread with each response line after the '<'
+	void HandleResponse(const std::string &line);
+
+	/*!
+	 * Sends command either as ASCII or, if binary_message is not empty,
+	 * as that binary message.
+	 */
+	boost::unique_future<CommandResult> SendCommandAsync_(const std::string &command,
+		const std::string &binary_message, uint32_t timeout_ms, CommandCallback callback);
+
+	//! Waits for a command sent with SendCommandAsync_() and logs the outcome
+	bool WaitForCommand(boost::unique_future<CommandResult> &future,
+		const std::string &command, uint32_t timeout_ms);
+
+	/*!
+	 * Sends a command in binary, with the given body, if binary commands
+	 * are enabled and otherwise as the ASCII text command, then waits for
+	 * the response.
+	 */
+	bool SendTypedCommand(const std::string &command, BINARY_COMMAND_ID command_id,
+		const void *body, size_t body_length, uint32_t timeout_ms=2000);
+	template <typename T>
+	bool SendTypedCommand(const std::string &command, BINARY_COMMAND_ID command_id,
+		const T &body) {
+		return SendTypedCommand(command, command_id, &body, sizeof(body));
+	}
+
+	/*!
+	 * Queues a binary command for the writer thread and for the next
+	 * response with its command id.
+	 *
+	 * @param pending if not NULL, completed when the response arrives
+	 */
+	void WriteBinaryCommand(const std::string &message, const PendingCommand *pending);
+
+	//! Called from the read thread with each binary response message
+	void HandleBinaryResponse(unsigned char *message, size_t length);
+
+	//! Data waiting for the writer thread
+	struct OutboundWrite
+	{
+		std::string data;
+		boost::system_time queued;
+		bool binary;         //!< true for a binary command, false for ASCII
+		uint16_t command_id; //!< binary command id
+		uint64_t sequence;   //!< PendingCommand::sequence of the command
+	};
+
+	//! Starts the thread that writes queued commands and corrections
+	void StartWriting();
+
+	//! Stops the writer thread once it has written the commands queued
+	void StopWriting();
+
+	/*!
+	 * Method run in a separate thread that writes queued commands to the
+	 * serial port.  All commands waiting are written with a single write,
+	 * followed by as many correction bytes as the port can send before
+	 * the next write is due.
+	 */
+	void WriteSerialPort();
+
+	//! Completes the commands in writes with COMMAND_WRITE_FAILED
+	void FailWrites(const std::vector<OutboundWrite> &writes, const std::string &error);
 
 
     //////////////////////////////////////////////////////
     // Serial port reading members
     //////////////////////////////////////////////////////
-	//! Serial port object for communicating with sensor
-	serial::Serial *serial_port_;
+	//! Serial port object for communicating with sensor.  Replaced only
+	//! under serial_port_mutex_; other threads use a copy from SerialPort().
+	boost::shared_ptr<serial::Serial> serial_port_;
+	boost::mutex serial_port_mutex_;
+	//! The open serial port, kept alive for as long as the copy is held
+	boost::shared_ptr<serial::Serial> SerialPort();
 	//! shared pointer to Boost thread for listening for data from novatel
 	boost::shared_ptr<boost::thread> read_thread_ptr_;
-	bool reading_status_;  //!< True if the read thread is running, false otherwise.
+	boost::atomic<bool> reading_status_;  //!< True if the read thread is running, false otherwise.
+	//! thread writing commands and corrections to the serial port
+	boost::shared_ptr<boost::thread> write_thread_ptr_;
+	bool writing_status_;  //!< True while the write thread should run
+	//! guards the writer members below
+	boost::mutex write_mutex_;
+	boost::condition_variable write_condition_;
+	std::deque<OutboundWrite> write_queue_;  //!< commands waiting to be written
+	std::string correction_queue_;           //!< correction bytes waiting to be written
+	WriterStatistics writer_statistics_;
+	double total_write_latency_ms_;
+
+    //////////////////////////////////////////////////////
+    // Connection supervisor
+    //////////////////////////////////////////////////////
+	boost::shared_ptr<boost::thread> supervisor_thread_ptr_;
+	//! guards the supervisor members below
+	boost::mutex supervisor_mutex_;
+	boost::condition_variable supervisor_condition_;
+	bool auto_reconnect_;
+	bool supervising_;  //!< true while the supervisor thread should run
+	bool port_lost_;    //!< set by the read thread, cleared once reconnected
+	//! INTERFACEMODE and COM commands to repeat after reconnecting, by port
+	std::map<std::string, std::string> restore_commands_;
+	boost::atomic<uint32_t> reconnect_count_;
+	boost::atomic<bool> gap_pending_; //!< subscribers are due a Gap() call
+	double gap_start_;  //!< read_timestamp_ of the last read before the loss
+	bool adaptive_log_rates_;
+	LogIdSet low_priority_logs_;
+
+    //////////////////////////////////////////////////////
+    // Receiver load, from the logs received
+    //////////////////////////////////////////////////////
+	//! least idle time in the headers since last looked at [0.5%], 255 if none
+	boost::atomic<uint8_t> receiver_idle_;
+	//! receiver status bits set in any header since last looked at
+	boost::atomic<uint32_t> receiver_status_;
+	//! messages of each log received since last looked at
+	boost::atomic<uint32_t> log_counts_[MAX_LOG_ID];
+	//! requested and current trigger of each log slowed down (supervisor thread only)
+	std::map<uint16_t, std::pair<std::string, std::string> > throttled_logs_;
+	int healthy_intervals_;    //!< seconds with headroom since last adjusted
+	bool log_rates_changed_;   //!< counts cover a change of period
+	boost::system_time last_rate_control_;
+
+	//! Where a log's stream has got to
+	struct LogTiming
+	{
+	    LogTimingStatistics statistics;
+	    uint32_t configured_period_ms;  //!< ONTIME period requested, 0 if none
+	    uint32_t learned_period_ms;     //!< step seen twice in a row, 0 if none yet
+	    int64_t last_epoch_ms;          //!< GPS time of the last message in order, -1 if none
+	    int64_t last_step_ms;
+	    double last_arrival;            //!< frame_timestamp_ of that message
+	};
+	//! guards log_timing_ and log_timing_callback_
+	boost::mutex timing_mutex_;
+	//! timing of each log, allocated when first needed
+	LogTiming *log_timing_[MAX_LOG_ID];
+	LogTimingCallback log_timing_callback_;
+
+	MetricsRegistry metrics_;
+	MetricsServer metrics_server_;
+	Tracer tracer_;
+
+	//! Histograms of each stage of one log (read thread records)
+	struct LogLatency
+	{
+	    LatencyHistogram stages[LATENCY_STAGES];
+	};
+	//! Histograms of a log, allocated when first needed (read thread only)
+	LogLatency *LatencyOf(uint16_t message_id);
+	//! latencies of each log, published to other threads once allocated
+	boost::atomic<LogLatency*> log_latency_[MAX_LOG_ID];
+	boost::atomic<bool> latency_tracking_;
+	boost::atomic<int> gps_utc_offset_;  //!< seconds GPS time is ahead of UTC
+	uint64_t read_monotonic_us_;   //!< MonotonicMicroseconds() when the last read completed, 0 if untimed
+	double read_wall_time_;        //!< WallClockSeconds() when the last read completed
+	uint64_t frame_monotonic_us_;  //!< MonotonicMicroseconds() when the current message was framed, 0 if untimed
 
     //////////////////////////////////////////////////////
     // Diagnostic Callbacks
@@ -395,37 +1305,50 @@ private:
     //////////////////////////////////////////////////////
     RawMsgCallback raw_msg_callback_;
 
-    BestGpsPositionCallback best_gps_position_callback_;
-    BestLeverArmCallback best_lever_arm_callback_;
-    BestPositionCallback best_position_callback_;
-    BestUtmPositionCallback best_utm_position_callback_;
-    BestVelocityCallback best_velocity_callback_;
-    BestPositionEcefCallback best_position_ecef_callback_;
-    InsPositionVelocityAttitudeCallback ins_position_velocity_attitude_callback_;
-    InsPositionVelocityAttitudeShortCallback ins_position_velocity_attitude_short_callback_;
-    VehicleBodyRotationCallback vehicle_body_rotation_callback_;
-    InsSpeedCallback ins_speed_callback_;
-    RawImuCallback raw_imu_callback_;
-    RawImuShortCallback raw_imu_short_callback_;
-    InsCovarianceCallback ins_covariance_callback_;
-    InsCovarianceShortCallback ins_covariance_short_callback_;
-
-    // GPS Callbacks
-    PseudorangeDopCallback pseudorange_dop_callback_;
-    RtkDopCallback rtk_dop_callback_;
-    BaselineEcefCallback baseline_ecef_callback_;
-    IonosphericModelCallback ionospheric_model_callback_;
-    RangeMeasurementsCallback range_measurements_callback_;
-    CompressedRangeMeasurementsCallback compressed_range_measurements_callback_;
-    GpsEphemerisCallback gps_ephemeris_callback_;
-    RawEphemerisCallback raw_ephemeris_callback_;
-    SatellitePositionsCallback satellite_positions_callback_;
-    SatelliteVisibilityCallback satellite_visibility_callback_;
-    TimeOffsetCallback time_offset_callback_;
-    TrackingStatusCallback tracking_status_callback_;
-    ReceiverHardwareStatusCallback receiver_hardware_status_callback_;
-    BestPseudorangePositionCallback best_pseudorange_position_callback_;
-    RtkPositionCallback rtk_position_callback_;
+    //////////////////////////////////////////////////////
+    // Subscribers
+    //////////////////////////////////////////////////////
+    struct SubscriberTable
+    {
+        SubscriberMap subscribers; //!< subscribers by log type, data callbacks have id 0
+        LogIdSet wanted;           //!< logs with a subscriber or data callback
+    };
+    /*!
+     * Current subscribers.  Tables are never modified once published;
+     * writers build a new one, swap it in, and free the old one once the
+     * read thread has finished any read that may still be using it.
+     */
+    boost::atomic<const SubscriberTable*> subscribers_;
+    /*!
+     * Incremented as the read thread enters and leaves BufferIncomingData,
+     * so it is odd while a read may be using a table loaded from subscribers_.
+     */
+    boost::atomic<uint64_t> read_epoch_;
+    //! tables replaced while a read was in progress, with the read_epoch_ at the time
+    std::vector<std::pair<const SubscriberTable*, uint64_t> > retired_tables_;
+    //! serializes writers; guards next_subscription_id_, retired_tables_ and the log registry below
+    boost::mutex subscribers_mutex_;
+    SubscriptionId next_subscription_id_;
+    //! subscribers that accepted the message being dispatched (read thread only)
+    std::vector<Subscriber*> accepted_subscribers_;
+    //! table loaded from subscribers_ for the current serial read
+    const SubscriberTable *dispatch_subscribers_;
+    double batch_flush_period_; //!< minimum time between batch flushes [sec]
+    double last_batch_flush_; //!< read_timestamp_ of the last batch flush
+
+    //////////////////////////////////////////////////////
+    // Log registry
+    //////////////////////////////////////////////////////
+    LogIdSet requested_logs_; //!< logs the receiver has been asked to output
+    std::map<uint16_t, std::string> log_triggers_; //!< trigger and period from ConfigureLogs
+    std::map<SubscriptionId, PendingQuery> pending_queries_; //!< queries by subscription id
+    BandwidthPolicy bandwidth_policy_;
+    double max_utilization_;
+    int max_baud_rate_;         //!< highest rate BANDWIDTH_RAISE_BAUD switches to
+    boost::atomic<bool> changing_baud_rate_; //!< SetBaudRate() is running
+    //! length of the last message of each log received, 0 if none yet
+    boost::atomic<uint16_t> observed_log_sizes_[MAX_LOG_ID];
+    bool auto_logging_;
 
 
 
@@ -437,15 +1360,33 @@ private:
 	size_t bytes_remaining_;	//!< bytes remaining to be read in the current message
 	size_t buffer_index_;		//!< index into data_buffer_
 	size_t header_length_;	//!< length of the current header being read
+	bool skipping_message_;	//!< true if nobody wants the current message and it is not being stored
+	BINARY_LOG_TYPE message_id_;	//!< message id of the current message being read
 	bool reading_acknowledgement_;	//!< true if an acknowledgement is being received
 	double read_timestamp_; 		//!< time stamp when last serial port read completed
 	double parse_timestamp_;		//!< time stamp when last parse began
+	double frame_timestamp_;		//!< time stamp when the last byte of the current message arrived
+	boost::atomic<int> baud_rate_;	//!< baud rate of the open serial port, 0 if unknown
 
-    boost::condition_variable ack_condition_;
-    boost::mutex ack_mutex_;
-    bool ack_received_;     //!< true if an acknowledgement has been received from the GPS
+    std::string response_buffer_; //!< response line being received (read thread only)
+    //! serializes command writes; guards the members below
+    boost::mutex command_mutex_;
+    uint64_t commands_sent_;      //!< sequence number of the next command written
+    uint64_t responses_received_; //!< sequence number of the command the next response is for
+    std::map<uint64_t, PendingCommand> pending_commands_; //!< commands waiting for a response
+    //! binary commands waiting for a response by command id, oldest first
+    std::map<uint16_t, std::deque<PendingCommand> > pending_binary_commands_;
+    uint64_t binary_commands_sent_; //!< sequence number of the next binary command queued
+    std::set<uint64_t> unsent_commands_; //!< ASCII commands whose write failed
+    bool binary_commands_; //!< true to send configuration commands in binary
 
-  bool is_connected_; //!< indicates if a connection to the receiver has been established
+  boost::atomic<bool> is_connected_; //!< indicates if a connection to the receiver has been established
+  std::string port_; //!< port of the identified receiver, empty until identified
+  bool stop_logs_on_disconnect_;
+  boost::atomic<ConnectionState> connection_state_;
+  ConnectionStateCallback connection_state_callback_;
+  boost::mutex connection_state_mutex_; //!< guards connection_state_callback_
+  boost::atomic<uint64_t> bytes_received_; //!< bytes read from the serial port
 	//////////////////////////////////////////////////////
     // Receiver information and capabilities
 	//////////////////////////////////////////////////////
@@ -461,6 +1402,11 @@ private:
 	bool glonass_capable_; //!< Can the receiver receive GLONASS frequencies?
 	bool span_capable_;  //!< Is the receiver a SPAN unit?
 
+	//! guards the members below
+	boost::mutex cache_mutex_;
+	std::map<std::string, CachedReceiver> receiver_cache_; //!< receivers by port
+	std::string receiver_cache_file_; //!< empty to keep the cache in memory only
+
 
 };
 }
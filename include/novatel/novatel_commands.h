@@ -0,0 +1,173 @@
+/*!
+ * \file novatel/novatel_commands.h
+ * \author David Hodo <david.hodo@gmail.com>
+ * \version 1.0
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Encoding of receiver commands as OEM4 binary messages and decoding of the
+ * receiver's binary responses.
+ *
+ */
+
+#ifndef NOVATEL_COMMANDS_H
+#define NOVATEL_COMMANDS_H
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+#include "novatel/novatel_enums.h"
+#include "novatel/novatel_structures.h"
+
+namespace novatel {
+
+#define THISPORT_ADDRESS (0xC0)   // port field value for "the port the command arrived on"
+#define ALL_PORTS        (8)      // port field value for every port (UNLOGALL)
+#define RESPONSE_BIT     (0x80)   // set in the message type of a response
+
+//*******************************************************************************
+// COMMAND BODIES
+//*******************************************************************************
+
+//! LOG
+PACK(
+struct LogCommand
+{
+    uint32_t port;          //!< port to output the log on
+    uint16_t message_id;    //!< log to output
+    uint8_t message_type;   //!< 0 for binary
+    uint8_t reserved;
+    uint32_t trigger;       //!< LogMode
+    double period;          //!< [sec] for ONTIME
+    double offset;          //!< [sec] for ONTIME
+    uint32_t hold;          //!< 1 to keep the log through UNLOGALL
+});
+
+//! UNLOG
+PACK(
+struct UnlogCommand
+{
+    uint32_t port;
+    uint16_t message_id;
+    uint8_t message_type;
+    uint8_t reserved;
+});
+
+//! UNLOGALL
+PACK(
+struct UnlogAllCommand
+{
+    uint32_t port;          //!< port to clear logs from
+    uint32_t held;          //!< 1 to also clear logs logged with hold
+});
+
+//! ECUTOFF
+PACK(
+struct ElevationCutoffCommand
+{
+    float angle;            //!< [deg]
+});
+
+//! SETAPPROXPOS
+PACK(
+struct ApproximatePositionCommand
+{
+    double latitude;        //!< [deg]
+    double longitude;       //!< [deg]
+    double height;          //!< [m]
+});
+
+//! SETAPPROXTIME
+PACK(
+struct ApproximateTimeCommand
+{
+    uint32_t gps_week;
+    double gps_seconds;
+});
+
+//! CSMOOTH
+PACK(
+struct CarrierSmoothingCommand
+{
+    uint32_t l1_time_constant; //!< [sec]
+    uint32_t l2_time_constant; //!< [sec]
+});
+
+//! POSTIMEOUT, RESET, FRESET, PDPFILTER and other commands with a single enum or integer
+PACK(
+struct SingleValueCommand
+{
+    uint32_t value;
+});
+
+//! PDPMODE
+PACK(
+struct PdpModeCommand
+{
+    uint32_t mode;          //!< PDPMode
+    uint32_t dynamics;      //!< PDPDynamics
+});
+
+//! Response to a binary command
+struct BinaryResponse
+{
+    uint16_t command_id;    //!< message id of the command responded to
+    uint32_t response_id;   //!< 1 if the command was accepted
+    std::string message;    //!< response text, e.g. "OK" or "Invalid Message ID"
+};
+
+/*!
+ * Builds a binary command message: a 28 byte header, the body and a CRC.
+ * The returned string holds the raw bytes to write to the receiver.
+ */
+std::string EncodeCommand(BINARY_COMMAND_ID command_id, const void *body, size_t body_length);
+
+template <typename T>
+std::string EncodeCommand(BINARY_COMMAND_ID command_id, const T &body) {
+    return EncodeCommand(command_id, &body, sizeof(body));
+}
+
+//! Builds a binary LOG command for log_type on the port the command is sent on
+std::string EncodeLogCommand(BINARY_LOG_TYPE log_type, LogMode trigger,
+                             double period=0, double offset=0, bool hold=false);
+
+/*!
+ * Builds a binary UNLOG command for log_type on the port the command is sent on
+ *
+ * @param message_type as in the message header, e.g. 0x20 for the ASCII form of the log
+ */
+std::string EncodeUnlogCommand(BINARY_LOG_TYPE log_type, uint8_t message_type=0);
+
+/*!
+ * Decodes a binary response message.  Returns false if the message is not
+ * a response or its CRC does not match.
+ */
+bool DecodeResponse(const unsigned char *message, size_t length, BinaryResponse *response);
+
+}
+#endif
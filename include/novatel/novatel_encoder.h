@@ -0,0 +1,91 @@
+/*!
+ * \file novatel/novatel_encoder.h
+ * \author David Hodo <david.hodo@gmail.com>
+ * \version 1.0
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *
+ * \section DESCRIPTION
+ *
+ * Encoding of the logs the driver decodes as OEM4 binary messages, the
+ * inverse of Novatel::ParseBinary(), for emulators and synthetic streams.
+ *
+ */
+
+#ifndef NOVATEL_ENCODER_H
+#define NOVATEL_ENCODER_H
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+#include "novatel/novatel_enums.h"
+#include "novatel/novatel_structures.h"
+
+namespace novatel {
+
+/*!
+ * Builds a binary log from a message laid out as its structure, header
+ * first: the header and body_length bytes of body, then a CRC.  The sync
+ * bytes, header length, message id and message length are filled in; the
+ * rest of the header (time, status, sequence, port) is kept as given.
+ */
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const void *message, size_t body_length);
+
+/*!
+ * Builds a binary log with a repeated block.  The record count, the last
+ * 4 bytes of the fixed_length bytes of body before the block, is set to
+ * number_of_records, which may be more than the structure holds.
+ */
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const void *message, size_t fixed_length,
+                      const void *records, size_t record_size, uint32_t number_of_records);
+
+//! Builds a log with the short binary header (INSPVAS, RAWIMUS, INSCOVS)
+std::string EncodeShortLog(BINARY_LOG_TYPE log_type, const void *message, size_t body_length);
+
+//! Builds a log whose structure is filled on the wire, e.g. Position for BESTPOSB
+template <typename T>
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const T &message) {
+    return EncodeLog(log_type, &message, sizeof(message) - HEADER_SIZE - 4);
+}
+
+/*
+ * Logs with a repeated block send only the first number_of_... records
+ * (at most the structure's MAX_CHAN or MAX_LOG_LIST); RXCONFIG sends as
+ * much of the command as its command_header gives.
+ */
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const Dop &message);
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const RangeMeasurements &message);
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const CompressedRangeMeasurements &message);
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const SatellitePositions &message);
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const SatelliteVisibility &message);
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const TrackStatus &message);
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const LogList &message);
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const ReceiverConfiguration &message);
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const InsPositionVelocityAttitudeShort &message);
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const RawImuShort &message);
+std::string EncodeLog(BINARY_LOG_TYPE log_type, const InsCovarianceShort &message);
+
+}
+#endif
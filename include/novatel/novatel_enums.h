@@ -319,9 +319,64 @@ enum FRESET_TARGET
     LBAND_TCXO_OFFSET = 38, //!< Removes the TCXO offset information from NVM (not in OEMStar firmware)
 };
 
+enum CommandStatus //!< Outcome of a command sent to the receiver
+{
+    COMMAND_OK = 0,           //!< Receiver acknowledged the command
+    COMMAND_ERROR = 1,        //!< Receiver rejected the command
+    COMMAND_TIMEOUT = 2,      //!< No response arrived before the command's timeout
+    COMMAND_WRITE_FAILED = 3, //!< Command could not be written to the serial port
+};
+
+enum BandwidthPolicy //!< What ConfigureLogs() does with logs the port cannot carry
+{
+    BANDWIDTH_IGNORE = 0,  //!< Request the logs anyway
+    BANDWIDTH_WARN = 1,    //!< Log a warning and request the logs anyway
+    BANDWIDTH_REJECT = 2,  //!< Request none of the logs
+    BANDWIDTH_REPLAN = 3,  //!< Lengthen ONTIME periods until the logs fit
+    BANDWIDTH_RAISE_BAUD = 4, //!< Raise the baud rate until the logs fit, else warn
+};
+
+enum LogTimingEventType //!< Irregularities in the stream of a log
+{
+    LOG_GAP = 0,          //!< one or more epochs missing
+    LOG_DUPLICATE = 1,    //!< same epoch received again
+    LOG_OUT_OF_ORDER = 2, //!< epoch older than the last one received
+};
+
+enum ConnectionState //!< Steps of connecting to the receiver
+{
+    DISCONNECTED = 0,   //!< No serial port open
+    OPENING = 1,        //!< Opening the serial port
+    IDENTIFYING = 2,    //!< Waiting for the VERSION log
+    READING_LOGS = 3,   //!< Waiting for the LOGLIST log
+    STOPPING_LOGS = 4,  //!< Waiting for the response to UNLOGALL, if LOGLIST is not available
+    CONNECTED = 5,      //!< Receiver found and identified
+    RECONNECTING = 6,   //!< Connection lost; reopening the port
+};
+
+enum BINARY_COMMAND_ID //!< Message ids of commands sent in binary format
+{
+    LOG_CMD_ID = 1,
+    INTERFACEMODE_CMD_ID = 3,
+    COM_CMD_ID = 4,
+    RESET_CMD_ID = 18,
+    SAVECONFIG_CMD_ID = 19,
+    FRESET_CMD_ID = 20,
+    UNLOG_CMD_ID = 36,
+    UNLOGALL_CMD_ID = 38,
+    ECUTOFF_CMD_ID = 50,
+    SETAPPROXTIME_CMD_ID = 102,
+    CSMOOTH_CMD_ID = 269,
+    SETAPPROXPOS_CMD_ID = 377,
+    PDPFILTER_CMD_ID = 424,
+    POSTIMEOUT_CMD_ID = 612,
+    PDPMODE_CMD_ID = 970,
+};
+
 enum BINARY_LOG_TYPE
 {
   // OEM4 logs
+  LOGLISTB_LOG_TYPE = 5,
   GPSEPHEMB_LOG_TYPE = 7,
   IONUTCB_LOG_TYPE = 8 ,
   CLOCKMODELB_LOG_TYPE = 16,
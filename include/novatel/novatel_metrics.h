@@ -0,0 +1,269 @@
+/*!
+ * \file novatel/novatel_metrics.h
+ * \author David Hodo <david.hodo@gmail.com>
+ * \version 1.0
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Counters and gauges describing the driver at run time, kept in shards
+ * written by one thread each and added up when read, latency histograms,
+ * and their exposition in the Prometheus text format.
+ *
+ */
+
+#ifndef NOVATEL_METRICS_H
+#define NOVATEL_METRICS_H
+
+#include <string>
+#include <map>
+#include <stdint.h>
+#include <time.h>
+
+#include "novatel/novatel_structures.h"
+// Boost Headers
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+namespace novatel {
+
+//! Counters kept by the driver
+enum MetricsCounter
+{
+    METRIC_BYTES_READ = 0,        //!< bytes read from the serial port
+    METRIC_FRAMES,                //!< binary logs and responses received
+    METRIC_CRC_FAILURES,          //!< binary logs decoded with a bad CRC
+    METRIC_RESYNCS,               //!< sync bytes not followed by the rest of a header
+    METRIC_BUFFER_OVERFLOWS,      //!< messages too long for the receive buffer
+    METRIC_UNKNOWN_LOGS,          //!< binary logs the driver does not decode
+    METRIC_BYTES_WRITTEN,         //!< bytes written to the serial port
+    METRIC_COMMANDS,              //!< commands completed, whatever the result
+    METRIC_COMMAND_ERRORS,        //!< commands rejected by the receiver
+    METRIC_COMMAND_TIMEOUTS,      //!< commands without a response
+    METRIC_COMMAND_ROUND_TRIPS,   //!< commands answered by the receiver
+    METRIC_COMMAND_ROUND_TRIP_US, //!< time from queueing to answer, over all answered commands
+    METRIC_COUNTERS
+};
+
+/*!
+ * Shards of the counters.  The read and write threads each have a shard to
+ * themselves, so counting costs them a plain load and store.  Other
+ * threads share the last shard and count with atomic additions.
+ */
+enum MetricsShard
+{
+    READER_SHARD = 0,
+    WRITER_SHARD = 1,
+    SHARED_SHARD = 2,
+    METRICS_SHARDS
+};
+
+//! Stages a binary log goes through in the driver, timed for each log
+enum LatencyStage
+{
+    LATENCY_READ_TO_FRAME = 0,    //!< serial read returning to the log's last byte being framed
+    LATENCY_FRAME_TO_DECODE,      //!< log framed to decoded, including routing to subscribers
+    LATENCY_DECODE_TO_DISPATCH,   //!< log decoded to a subscriber being handed it
+    LATENCY_CALLBACK,             //!< time spent in one subscriber
+    LATENCY_MESSAGE_AGE,          //!< arrival on the host less the GPS time in the header
+    LATENCY_STAGES
+};
+
+//! Distribution of the latencies recorded in a histogram, in microseconds
+struct LatencySummary
+{
+    uint64_t count;
+    double mean_us;
+    uint64_t p50_us;
+    uint64_t p90_us;
+    uint64_t p99_us;
+    uint64_t p999_us;
+    uint64_t max_us;
+};
+
+//! Latencies of each stage of one log
+struct LogLatencySummary
+{
+    LatencySummary stages[LATENCY_STAGES];
+};
+
+//! Values below this are counted exactly, and each power of two above is split in as many buckets
+#define LATENCY_SUB_BUCKETS 8
+//! Enough buckets for values up to 2^40 us, about 12 days
+#define LATENCY_BUCKETS (LATENCY_SUB_BUCKETS*38)
+
+/*!
+ * Histogram of latencies in the manner of HdrHistogram: each power of two
+ * is split in LATENCY_SUB_BUCKETS linear buckets, so percentiles are
+ * within 12.5% at any scale and recording a value costs a few
+ * instructions.  One thread records; any thread may summarize.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    //! Records a latency (owning thread only)
+    void Record(uint64_t value_us) {
+        boost::atomic<uint64_t> &bucket = counts_[BucketIndex(value_us)];
+        bucket.store(bucket.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+        sum_us_.store(sum_us_.load(boost::memory_order_relaxed) + value_us, boost::memory_order_relaxed);
+        if (value_us > max_us_.load(boost::memory_order_relaxed))
+            max_us_.store(value_us, boost::memory_order_relaxed);
+    }
+
+    //! Percentiles of the values recorded so far, each the top of its bucket
+    LatencySummary Summarize() const;
+
+    static size_t BucketIndex(uint64_t value_us) {
+        if (value_us < LATENCY_SUB_BUCKETS)
+            return value_us;
+        int exponent = 63 - __builtin_clzll(value_us);  // >= 3
+        size_t index = LATENCY_SUB_BUCKETS*(exponent-2) + (value_us >> (exponent-3)) - LATENCY_SUB_BUCKETS;
+        return index < LATENCY_BUCKETS ? index : LATENCY_BUCKETS-1;
+    }
+    //! Largest value counted in a bucket
+    static uint64_t BucketTop(size_t index);
+
+private:
+    boost::atomic<uint64_t> counts_[LATENCY_BUCKETS];
+    boost::atomic<uint64_t> sum_us_;
+    boost::atomic<uint64_t> max_us_;
+};
+
+//! Microseconds on a clock that never steps, for timing stages
+inline uint64_t MonotonicMicroseconds() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint64_t(now.tv_sec)*1000000 + now.tv_nsec/1000;
+}
+
+//! Seconds since the Unix epoch on the system clock
+inline double WallClockSeconds() {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+
+//! Metrics of the driver at one moment
+struct MetricsSnapshot
+{
+    uint64_t counters[METRIC_COUNTERS];
+    std::map<uint16_t, uint64_t> log_frames;  //!< binary logs received by message id
+    std::map<uint16_t, LogLatencySummary> latencies;  //!< latencies of the logs timed, by message id
+    uint64_t command_round_trip_max_us;
+    // gauges
+    bool connected;
+    size_t write_queue_depth;     //!< commands waiting for the write thread
+    size_t correction_backlog;    //!< correction bytes waiting for the write thread
+    size_t pending_commands;      //!< commands waiting for a response
+    size_t pending_queries;       //!< queries waiting for their log
+};
+
+//! Counters updated by the driver's threads and added up when read
+class MetricsRegistry
+{
+public:
+    MetricsRegistry();
+
+    //! Adds to a counter; only the thread owning a shard may use it
+    void Add(MetricsShard shard, MetricsCounter counter, uint64_t count=1) {
+        boost::atomic<uint64_t> &value = shards_[shard].counters[counter];
+        if (shard == SHARED_SHARD)
+            value.fetch_add(count, boost::memory_order_relaxed);
+        else
+            value.store(value.load(boost::memory_order_relaxed) + count, boost::memory_order_relaxed);
+    }
+
+    //! Counts a binary log (read thread only)
+    void CountLog(uint16_t message_id) {
+        if (message_id >= MAX_LOG_ID)
+            return;
+        boost::atomic<uint64_t> &value = log_frames_[message_id];
+        value.store(value.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+    }
+
+    //! Counts a command answered after round_trip_us (any thread)
+    void AddRoundTrip(uint64_t round_trip_us);
+
+    //! Adds up the shards into snapshot's counters and log_frames
+    void Collect(MetricsSnapshot *snapshot) const;
+
+private:
+    struct Shard
+    {
+        boost::atomic<uint64_t> counters[METRIC_COUNTERS];
+        char padding[64];  //!< keeps shards written by different threads off each other's cache lines
+    };
+    char padding_[64];
+    Shard shards_[METRICS_SHARDS];
+    boost::atomic<uint64_t> round_trip_max_us_;
+    boost::atomic<uint64_t> log_frames_[MAX_LOG_ID];
+};
+
+/*!
+ * Formats a snapshot in the Prometheus text exposition format, with each
+ * metric name starting with prefix.
+ */
+std::string FormatPrometheusMetrics(const MetricsSnapshot &snapshot, const std::string &prefix="novatel");
+
+/*!
+ * Serves text on a Unix domain socket.  Each client connecting is sent the
+ * text current at the time and disconnected, which suits a monitoring
+ * agent scraping locally.
+ */
+class MetricsServer
+{
+public:
+    typedef boost::function<std::string()> TextCallback;
+
+    MetricsServer();
+    ~MetricsServer();
+
+    /*!
+     * Starts serving on a socket at path, replacing any file there.
+     *
+     * @param error set to the reason if it fails
+     */
+    bool Start(const std::string &path, TextCallback text, std::string *error);
+    void Stop();
+    bool IsServing() const {return serving_;}
+
+private:
+    void Serve();
+
+    std::string path_;
+    TextCallback text_;
+    int listen_fd_;
+    boost::atomic<bool> serving_;
+    boost::shared_ptr<boost::thread> thread_ptr_;
+};
+
+}
+
+#endif
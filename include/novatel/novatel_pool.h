@@ -0,0 +1,243 @@
+/*!
+ * \file novatel/novatel_pool.h
+ * \author David Hodo <david.hodo@gmail.com>
+ * \version 1.0
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Lock-free pool of preallocated messages handed out as reference counted
+ * handles, so decoded logs can be passed to other threads without copying
+ * them into heap memory.
+ *
+ */
+
+#ifndef NOVATEL_POOL_H
+#define NOVATEL_POOL_H
+
+#include <cstddef>
+#include <algorithm>
+#include <stdint.h>
+// Boost Headers
+#include <boost/atomic.hpp>
+#include <boost/intrusive_ptr.hpp>
+
+namespace novatel {
+
+//! Usage statistics of a MessagePool
+struct PoolStatistics
+{
+    size_t capacity;  //!< number of messages preallocated by the pool
+    size_t in_use;    //!< messages currently referenced by a handle
+    uint64_t misses;  //!< messages heap allocated because the pool was empty
+};
+
+template <typename T> class MessagePool;
+
+/*!
+ * Reference counted handle to a message owned by a MessagePool.
+ *
+ * Handles may be copied and passed between threads freely.  When the last
+ * handle to a message is released the message goes back to its pool.
+ */
+template <typename T>
+class PooledMessage
+{
+public:
+    PooledMessage() : node_(NULL) {}
+    PooledMessage(const PooledMessage &other) : node_(other.node_) {
+        if (node_)
+            node_->AddReference();
+    }
+#if __cplusplus >= 201103L
+    PooledMessage(PooledMessage &&other) : node_(other.node_) {other.node_=NULL;}
+#endif
+    ~PooledMessage() {reset();}
+
+    PooledMessage& operator=(PooledMessage other) {
+        swap(other);
+        return *this;
+    }
+
+    void swap(PooledMessage &other) {std::swap(node_, other.node_);}
+
+    //! Releases this handle's reference to the message
+    void reset() {
+        if (node_)
+            node_->Release();
+        node_=NULL;
+    }
+
+    //! True if the handle refers to a message
+    bool valid() const {return node_!=NULL;}
+
+    T& operator*() const {return node_->message;}
+    T* operator->() const {return &node_->message;}
+    T* get() const {return node_ ? &node_->message : NULL;}
+
+    //! host time at which the message finished arriving
+    double timestamp() const {return node_->timestamp;}
+
+private:
+    friend class MessagePool<T>;
+    //! takes over the reference already held on node
+    explicit PooledMessage(typename MessagePool<T>::Node *node) : node_(node) {}
+
+    typename MessagePool<T>::Node *node_;
+};
+
+/*!
+ * Fixed size pool of messages with a lock-free free list.
+ *
+ * Acquire() may be called from one or more producer threads and handles may
+ * be released from any thread.  When the pool is empty messages are heap
+ * allocated instead and counted as misses.  The pool itself is reference
+ * counted and stays alive until both its owner and every outstanding handle
+ * have let go of it.
+ */
+template <typename T>
+class MessagePool
+{
+public:
+    struct Node
+    {
+        T message;
+        double timestamp;
+        boost::atomic<uint32_t> references;
+        boost::atomic<uint32_t> next;   //!< index of the next free node
+        uint32_t index;                 //!< index in the pool, HEAP_NODE if heap allocated
+        MessagePool *pool;
+
+        void AddReference() {references.fetch_add(1, boost::memory_order_relaxed);}
+        void Release() {
+            if (references.fetch_sub(1, boost::memory_order_acq_rel)==1)
+                pool->Recycle(this);
+        }
+    };
+
+    explicit MessagePool(size_t capacity)
+        : capacity_(capacity), nodes_(new Node[capacity]), free_head_(EMPTY),
+          references_(0), in_use_(0), misses_(0) {
+        for (size_t ii=0; ii<capacity_; ii++) {
+            nodes_[ii].index=ii;
+            nodes_[ii].pool=this;
+            Push(&nodes_[ii]);
+        }
+    }
+
+    /*!
+     * Takes a message from the pool.  The handle holds the only reference.
+     *
+     * @param timestamp stored with the message, see PooledMessage::timestamp()
+     */
+    PooledMessage<T> Acquire(double timestamp=0) {
+        Node *node=Pop();
+        if (node==NULL) {
+            misses_.fetch_add(1, boost::memory_order_relaxed);
+            node=new Node;
+            node->index=HEAP_NODE;
+            node->pool=this;
+        }
+        node->timestamp=timestamp;
+        node->references.store(1, boost::memory_order_relaxed);
+        in_use_.fetch_add(1, boost::memory_order_relaxed);
+        references_.fetch_add(1, boost::memory_order_relaxed);
+        return PooledMessage<T>(node);
+    }
+
+    PoolStatistics statistics() const {
+        PoolStatistics stats;
+        stats.capacity=capacity_;
+        stats.in_use=in_use_.load(boost::memory_order_relaxed);
+        stats.misses=misses_.load(boost::memory_order_relaxed);
+        return stats;
+    }
+
+    friend void intrusive_ptr_add_ref(MessagePool *pool) {
+        pool->references_.fetch_add(1, boost::memory_order_relaxed);
+    }
+    friend void intrusive_ptr_release(MessagePool *pool) {
+        if (pool->references_.fetch_sub(1, boost::memory_order_acq_rel)==1)
+            delete pool;
+    }
+
+private:
+    static const uint32_t EMPTY=0xFFFFFFFF;
+    static const uint32_t HEAP_NODE=0xFFFFFFFF;
+
+    ~MessagePool() {delete [] nodes_;}
+
+    //! Called when the last handle to node is released
+    void Recycle(Node *node) {
+        in_use_.fetch_sub(1, boost::memory_order_relaxed);
+        if (node->index==HEAP_NODE)
+            delete node;
+        else
+            Push(node);
+        intrusive_ptr_release(this);
+    }
+
+    // The free list head holds the index of the first free node in its low
+    // 32 bits and a counter bumped by every update in its high 32 bits, so a
+    // node popped and pushed back between a load and a compare-exchange
+    // cannot be mistaken for an unchanged list.
+    void Push(Node *node) {
+        uint64_t head=free_head_.load(boost::memory_order_relaxed);
+        uint64_t new_head;
+        do {
+            node->next.store(uint32_t(head), boost::memory_order_relaxed);
+            new_head=(((head>>32)+1)<<32) | node->index;
+        } while (!free_head_.compare_exchange_weak(head, new_head,
+                    boost::memory_order_release, boost::memory_order_relaxed));
+    }
+
+    Node* Pop() {
+        uint64_t head=free_head_.load(boost::memory_order_acquire);
+        for (;;) {
+            uint32_t index=uint32_t(head);
+            if (index==EMPTY)
+                return NULL;
+            uint64_t new_head=(((head>>32)+1)<<32) |
+                nodes_[index].next.load(boost::memory_order_relaxed);
+            if (free_head_.compare_exchange_weak(head, new_head,
+                    boost::memory_order_acquire, boost::memory_order_acquire))
+                return &nodes_[index];
+        }
+    }
+
+    MessagePool(const MessagePool&);
+    MessagePool& operator=(const MessagePool&);
+
+    const size_t capacity_;
+    Node *nodes_;
+    boost::atomic<uint64_t> free_head_;
+    boost::atomic<uint32_t> references_; //!< owners plus messages in use
+    boost::atomic<size_t> in_use_;
+    boost::atomic<uint64_t> misses_;
+};
+
+}
+#endif
@@ -45,6 +45,9 @@
 namespace novatel {
 
 #define MAX_NOUT_SIZE      (8192)   // Maximum size of a NovAtel log buffer (ALMANACA logs are big!)
+#define MAX_LOG_ID         (4096)   // Binary logs with message ids below this can be subscribed to
+#define MAX_LOG_LIST       (64)     // Maximum number of logs in a LOGLIST log
+#define MAX_RXCONFIG_LENGTH (512)   // Maximum length of the command embedded in a RXCONFIG log
 #define EPH_CHAN 33
 #define NUMSAT 14
 #define MAX_CHAN	28  // Maximum number of signal channels
@@ -1089,6 +1092,51 @@ struct Version
 });
 
 
+//! One log in a LOGLIST log
+PACK(
+struct LogListEntry
+{
+	uint32_t port;			//!< Port the log is output on
+	uint16_t message_id;		//!< Message id of the log
+	uint8_t message_type;		//!< Message type (bits 5-6: 0 binary, 1 ASCII, 2 abbreviated ASCII)
+	uint8_t reserved;
+	LogMode trigger;		//!< ONNEW, ONCHANGED, ONTIME, etc.
+	double period;			//!< Log period for ONTIME [sec]
+	double offset;			//!< Offset for period [sec]
+	uint32_t hold;			//!< 1 if the log is kept by UNLOGALL
+});
+
+/*!
+ * LOGLIST Message Structure
+ * This log lists the logs currently requested on
+ * all ports.
+ */
+PACK(
+struct LogList
+{
+	Oem4BinaryHeader header;		//!< Message header
+	int32_t number_of_logs;			//!< Number of logs to follow
+	LogListEntry logs[MAX_LOG_LIST];	//!< Logs requested
+	uint8_t crc[4];
+});
+
+/*!
+ * RXCONFIG Message Structure
+ * This log lists the receiver configuration as the
+ * commands that were used to set it, one command per
+ * log.  The logs describing one configuration are sent
+ * together, with header.sequence counting down to 0.
+ */
+PACK(
+struct ReceiverConfiguration
+{
+	Oem4BinaryHeader header;		//!< Message header
+	Oem4BinaryHeader command_header;	//!< Header of the embedded command
+	uint8_t command[MAX_RXCONFIG_LENGTH];	//!< Body of the embedded command
+	uint8_t crc[4];
+});
+
+
 struct ReceiverError
 {
 	int32_t DRAMStatus :1;
@@ -0,0 +1,375 @@
+/*!
+ * \file novatel/novatel_subscribers.h
+ * \author David Hodo <david.hodo@gmail.com>
+ * \version 1.0
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Message subscribers used by the Novatel driver to hand decoded logs to
+ * user code.
+ *
+ */
+
+#ifndef NOVATEL_SUBSCRIBERS_H
+#define NOVATEL_SUBSCRIBERS_H
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <stdint.h>
+
+#include "novatel/novatel_enums.h"
+#include "novatel/novatel_pool.h"
+// Boost Headers
+#include <boost/function.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/thread/future.hpp>
+
+namespace novatel {
+
+//! Identifies a subscription registered with the driver (0 is never used)
+typedef uint32_t SubscriptionId;
+
+/*!
+ * Selects which messages of a log a subscriber receives.  Decimation is
+ * decided from the GPS time in the message header, before the message is
+ * decoded or copied for the subscriber.
+ */
+struct Decimation
+{
+    enum Mode {
+        ALL,         //!< every message
+        EVERY_NTH,   //!< the first message and every n-th one after it
+        MAX_RATE,    //!< at most one message per period
+        GPS_ALIGNED  //!< the first message in each period, with periods aligned to GPS time
+    };
+
+    Decimation() : mode(ALL), n(1), period_ms(0) {}
+
+    static Decimation EveryNth(uint32_t n) {
+        Decimation decimation;
+        decimation.mode=EVERY_NTH;
+        decimation.n=n>0 ? n : 1;
+        return decimation;
+    }
+    //! rate in Hz
+    static Decimation MaxRate(double rate) {
+        Decimation decimation;
+        decimation.mode=MAX_RATE;
+        decimation.period_ms=rate>0 ? uint32_t(1000.0/rate+0.5) : 0;
+        return decimation;
+    }
+    //! e.g. GpsAligned(1000) gives the message on or just after each whole GPS second
+    static Decimation GpsAligned(uint32_t period_ms) {
+        Decimation decimation;
+        decimation.mode=GPS_ALIGNED;
+        decimation.period_ms=period_ms;
+        return decimation;
+    }
+
+    Mode mode;
+    uint32_t n;
+    uint32_t period_ms;
+};
+
+/*!
+ * Base class for everything that receives decoded binary logs.
+ *
+ * The driver decodes each message once into its structure and passes a
+ * pointer to it to every subscriber registered for that log type.
+ */
+class Subscriber
+{
+public:
+    Subscriber(BINARY_LOG_TYPE log_type) : log_type_(log_type), id_(0),
+        message_count_(0), next_due_(0), last_period_(0), accepted_any_(false) {}
+    virtual ~Subscriber() {}
+
+    BINARY_LOG_TYPE log_type() const {return log_type_;}
+    SubscriptionId id() const {return id_;}
+    void set_id(SubscriptionId id) {id_=id;}
+    void set_decimation(const Decimation &decimation) {decimation_=decimation;}
+
+    /*!
+     * Called from the read thread with the raw message (header first) to
+     * decide whether this subscriber wants it.  Updates the decimation
+     * state, so it must be called exactly once per message.
+     */
+    bool Accept(const unsigned char *message) {
+        switch (decimation_.mode) {
+            case Decimation::EVERY_NTH:
+                return (message_count_++ % decimation_.n)==0;
+            case Decimation::MAX_RATE: {
+                uint64_t time=GpsTime(message);
+                // not due yet; a time more than a period early means GPS
+                // time went backwards (e.g. after a reset), so start over
+                if (accepted_any_ && (time<next_due_) &&
+                    (next_due_-time<=decimation_.period_ms))
+                    return false;
+                // keep to the schedule unless messages were missed
+                if (accepted_any_ && (time>=next_due_) &&
+                    (time<next_due_+decimation_.period_ms))
+                    next_due_+=decimation_.period_ms;
+                else
+                    next_due_=time+decimation_.period_ms;
+                accepted_any_=true;
+                return true;
+            }
+            case Decimation::GPS_ALIGNED: {
+                if (decimation_.period_ms==0)
+                    return true;
+                uint64_t period=GpsTime(message)/decimation_.period_ms;
+                if (accepted_any_ && (period==last_period_))
+                    return false;
+                last_period_=period;
+                accepted_any_=true;
+                return true;
+            }
+            default:
+                return true;
+        }
+    }
+
+    /*!
+     * Called from the read thread for each message of log_type().
+     *
+     * @param message points to the decoded structure for log_type()
+     * @param timestamp host time at which the message finished arriving
+     */
+    virtual void Deliver(void *message, double timestamp)=0;
+
+    //! Called from the read thread when held messages should be handed on
+    virtual void Flush() {}
+
+    /*!
+     * Called from the read thread when data arrives again after the
+     * connection to the receiver was lost and restored.  Messages sent by
+     * the receiver in between were missed.
+     *
+     * @param last_timestamp host time of the last read before the loss
+     * @param resumed_timestamp host time of the first read after it
+     */
+    virtual void Gap(double last_timestamp, double resumed_timestamp) {}
+
+    //! Fills statistics and returns true if the subscriber delivers from a pool
+    virtual bool GetPoolStatistics(PoolStatistics *statistics) const {return false;}
+
+    //! False if the subscriber should not make the driver request its log
+    virtual bool RequestsLog() const {return true;}
+
+private:
+    //! GPS time in the header of an OEM4 binary message [ms since the start of GPS time]
+    static uint64_t GpsTime(const unsigned char *message) {
+        uint64_t week=message[14] | (message[15]<<8);
+        uint64_t milliseconds=message[16] | (message[17]<<8) | (message[18]<<16) |
+            (uint64_t(message[19])<<24);
+        return week*604800000ULL+milliseconds;
+    }
+
+    BINARY_LOG_TYPE log_type_;
+    SubscriptionId id_;
+    Decimation decimation_;
+    uint64_t message_count_;  //!< messages offered (EVERY_NTH)
+    uint64_t next_due_;       //!< GPS time the next message is due (MAX_RATE)
+    uint64_t last_period_;    //!< period of the last accepted message (GPS_ALIGNED)
+    bool accepted_any_;
+};
+
+/*!
+ * Calls a handler with each message, like the data callbacks set with the
+ * Novatel::set_*_callback() methods, but any number may be registered.
+ */
+template <typename T>
+class CallbackSubscriber : public Subscriber
+{
+public:
+    typedef boost::function<void(T&, double&)> Handler;
+
+    CallbackSubscriber(BINARY_LOG_TYPE log_type, Handler handler)
+        : Subscriber(log_type), handler_(handler) {}
+
+    void Deliver(void *message, double timestamp) {
+        if (handler_)
+            handler_(*static_cast<T*>(message), timestamp);
+    }
+
+private:
+    Handler handler_;
+};
+
+/*!
+ * Collects messages of one type and hands them to a single handler call
+ * each time the driver flushes batches.  The vectors passed to the handler
+ * are reused for the next batch, so copy anything needed after returning.
+ */
+template <typename T>
+class BatchSubscriber : public Subscriber
+{
+public:
+    typedef boost::function<void(std::vector<T>&, std::vector<double>&)> Handler;
+
+    BatchSubscriber(BINARY_LOG_TYPE log_type, Handler handler)
+        : Subscriber(log_type), handler_(handler) {}
+
+    void Deliver(void *message, double timestamp) {
+        messages_.push_back(*static_cast<T*>(message));
+        timestamps_.push_back(timestamp);
+    }
+
+    //! a batch never spans a gap in the data
+    void Gap(double last_timestamp, double resumed_timestamp) {Flush();}
+
+    void Flush() {
+        if (messages_.empty())
+            return;
+        if (handler_)
+            handler_(messages_, timestamps_);
+        messages_.clear();
+        timestamps_.clear();
+    }
+
+private:
+    Handler handler_;
+    std::vector<T> messages_;     //!< messages received since the last flush
+    std::vector<double> timestamps_; //!< arrival time of each message in messages_
+};
+
+/*!
+ * Copies each message into an object from a MessagePool and passes the
+ * handler a reference counted handle to it.  Handles can be kept or passed
+ * to other threads; the message returns to the pool when the last copy of
+ * its handle goes away.
+ */
+template <typename T>
+class PooledSubscriber : public Subscriber
+{
+public:
+    typedef boost::function<void(const PooledMessage<T>&)> Handler;
+
+    PooledSubscriber(BINARY_LOG_TYPE log_type, Handler handler, size_t capacity)
+        : Subscriber(log_type), handler_(handler), pool_(new MessagePool<T>(capacity)) {}
+
+    void Deliver(void *message, double timestamp) {
+        PooledMessage<T> pooled=pool_->Acquire(timestamp);
+        *pooled=*static_cast<T*>(message);
+        if (handler_)
+            handler_(pooled);
+    }
+
+    bool GetPoolStatistics(PoolStatistics *statistics) const {
+        *statistics=pool_->statistics();
+        return true;
+    }
+
+private:
+    Handler handler_;
+    boost::intrusive_ptr<MessagePool<T> > pool_;
+};
+
+/*!
+ * Base class for subscribers that wait for a single reply to a query made
+ * with Novatel::Query().  The reply completes the query exactly once,
+ * either with the message or with an error.
+ */
+class QueryBase : public Subscriber
+{
+public:
+    QueryBase(BINARY_LOG_TYPE log_type) : Subscriber(log_type), completed_(false) {}
+
+    //! Queries send their own LOG ONCE request
+    bool RequestsLog() const {return false;}
+
+    //! Completes the query with an error, unless it has already completed
+    virtual void Fail(const std::string &error)=0;
+
+    bool completed() const {return completed_.load(boost::memory_order_acquire);}
+
+protected:
+    //! Marks the query completed; true only for the first caller
+    bool Complete() {return !completed_.exchange(true, boost::memory_order_acq_rel);}
+
+private:
+    boost::atomic<bool> completed_;
+};
+
+//! Completes a promise with the first message received
+template <typename T>
+class QuerySubscriber : public QueryBase
+{
+public:
+    QuerySubscriber(BINARY_LOG_TYPE log_type) : QueryBase(log_type) {}
+
+    boost::unique_future<T> GetFuture() {return promise_.get_future();}
+
+    void Deliver(void *message, double timestamp) {
+        if (Complete())
+            promise_.set_value(*static_cast<T*>(message));
+    }
+
+    void Fail(const std::string &error) {
+        if (Complete())
+            promise_.set_exception(boost::copy_exception(std::runtime_error(error)));
+    }
+
+private:
+    boost::promise<T> promise_;
+};
+
+/*!
+ * Collects a set of related messages, such as the RXCONFIG logs that
+ * together describe the receiver configuration, and completes a promise
+ * with them once the message with header sequence 0 arrives.
+ */
+template <typename T>
+class QuerySequenceSubscriber : public QueryBase
+{
+public:
+    QuerySequenceSubscriber(BINARY_LOG_TYPE log_type) : QueryBase(log_type) {}
+
+    boost::unique_future<std::vector<T> > GetFuture() {return promise_.get_future();}
+
+    void Deliver(void *message, double timestamp) {
+        if (completed())
+            return;
+        messages_.push_back(*static_cast<T*>(message));
+        // every log structure starts with its header
+        if ((messages_.back().header.sequence == 0) && Complete())
+            promise_.set_value(messages_);
+    }
+
+    void Fail(const std::string &error) {
+        if (Complete())
+            promise_.set_exception(boost::copy_exception(std::runtime_error(error)));
+    }
+
+private:
+    boost::promise<std::vector<T> > promise_;
+    std::vector<T> messages_; //!< messages received so far (read thread only)
+};
+
+}
+#endif
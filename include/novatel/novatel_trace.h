@@ -0,0 +1,154 @@
+/*!
+ * \file novatel/novatel_trace.h
+ * \author David Hodo <david.hodo@gmail.com>
+ * \version 1.0
+ *
+ * \section LICENSE
+ *
+ * The BSD License
+ *
+ * Copyright (c) 2011 David Hodo - Integrated Solutions for Systems (IS4S)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * Tracing of the driver's pipeline: compact events kept in a ring buffer
+ * per thread, written out on demand in the Chrome trace event format
+ * for viewing in Perfetto or chrome://tracing.
+ *
+ */
+
+#ifndef NOVATEL_TRACE_H
+#define NOVATEL_TRACE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+
+#include "novatel/novatel_metrics.h"
+// Boost Headers
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+namespace novatel {
+
+//! Events traced
+enum TraceEventType
+{
+    TRACE_READ = 0,        //!< serial port read; value is the bytes read
+    TRACE_FRAME,           //!< message framed; id is its message id, value its length
+    TRACE_DECODE,          //!< message decoded; id is its message id
+    TRACE_CALLBACK,        //!< subscriber handed a message; id is its message id, value the subscriber id
+    TRACE_WRITE,           //!< serial port write; id is the commands written, value the bytes
+    TRACE_COMMAND_DONE,    //!< command answered, failed or timed out; value is its CommandStatus
+    TRACE_EVENT_TYPES
+};
+
+//! One traced event, a span if duration_ns is set and an instant if not
+struct TraceEvent
+{
+    uint64_t start_ns;     //!< MonotonicNanoseconds() at the start
+    uint32_t duration_ns;
+    uint16_t type;         //!< TraceEventType
+    uint16_t id;
+    uint32_t value;
+};
+
+//! Nanoseconds on the clock used by MonotonicMicroseconds()
+inline uint64_t MonotonicNanoseconds() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint64_t(now.tv_sec)*1000000000 + now.tv_nsec;
+}
+
+/*!
+ * Keeps the most recent events of each of the driver's threads.  The read
+ * and write threads each have a ring to themselves, so recording costs
+ * them a copy and a store; other threads share the last ring under a
+ * lock.  While tracing is off recording is a single flag test.
+ */
+class Tracer
+{
+public:
+    Tracer();
+    ~Tracer();
+
+    /*!
+     * Starts tracing, keeping at least the last events_per_thread events of
+     * each thread.  The rings are sized by the first call; events from
+     * earlier tracing stay in them until overwritten.
+     */
+    void Start(size_t events_per_thread);
+    void Stop() {tracing_ = false;}
+    bool IsTracing() const {return tracing_.load(boost::memory_order_relaxed);}
+
+    //! Records an event; only the thread owning a ring may use it, except the shared one
+    void Record(MetricsShard ring, TraceEventType type, uint64_t start_ns, uint64_t end_ns,
+                uint16_t id=0, uint32_t value=0) {
+        // acquire pairs with Start() so the rings are seen allocated
+        if (!tracing_.load(boost::memory_order_acquire))
+            return;
+        TraceEvent event;
+        event.start_ns = start_ns;
+        uint64_t duration_ns = end_ns > start_ns ? end_ns - start_ns : 0;
+        event.duration_ns = duration_ns < 0xFFFFFFFFu ? uint32_t(duration_ns) : 0xFFFFFFFFu;
+        event.type = type;
+        event.id = id;
+        event.value = value;
+        if (ring == SHARED_SHARD) {
+            boost::lock_guard<boost::mutex> lock(shared_mutex_);
+            rings_[ring].Push(event);
+        } else {
+            rings_[ring].Push(event);
+        }
+    }
+
+    //! Events of a ring still held, oldest first
+    std::vector<TraceEvent> Events(MetricsShard ring) const;
+
+    //! All events held in the Chrome trace event JSON format
+    std::string ChromeTraceJson() const;
+
+private:
+    struct Ring
+    {
+        Ring() : events(NULL), capacity(0) {head = 0;}
+        void Push(const TraceEvent &event) {
+            if (capacity == 0)
+                return;
+            uint64_t index = head.load(boost::memory_order_relaxed);
+            events[index & (capacity-1)] = event;
+            head.store(index+1, boost::memory_order_release);
+        }
+        TraceEvent *events;
+        size_t capacity;               //!< a power of two
+        boost::atomic<uint64_t> head;  //!< events pushed since the ring was made
+        char padding[64];              //!< keeps rings written by different threads off each other's cache lines
+    };
+    Ring rings_[METRICS_SHARDS];
+    boost::mutex shared_mutex_;
+    mutable boost::mutex start_mutex_;  //!< guards sizing the rings
+    boost::atomic<bool> tracing_;
+};
+
+}
+
+#endif
@@ -3,6 +3,12 @@
 #include <valarray>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
 
 using namespace std;
 using namespace novatel;
@@ -13,6 +19,9 @@ using namespace novatel;
 #include "boost/date_time/posix_time/posix_time.hpp"
 ////////////////////////////////////////////////////
 
+//! Longest command response line kept (e.g. "<ERROR:Invalid Message. Field = 1")
+static const size_t MAX_RESPONSE_LENGTH = 256;
+
 
 /* --------------------------------------------------------------------------
 Calculate a CRC value to be used by CRC calculation functions.
@@ -32,6 +41,16 @@ unsigned long CRC32Value(int i)
 }
 
 
+//! CRC32Value() of each byte, worked out once so every message can be checked
+struct CRC32Table {
+  unsigned long values[256];
+  CRC32Table() {
+    for (int i = 0; i < 256; i++)
+      values[i] = CRC32Value(i);
+  }
+};
+static const CRC32Table crc32_table;
+
 /* --------------------------------------------------------------------------
 Calculates the CRC-32 of a block of data all at once
 -------------------------------------------------------------------------- */
@@ -43,7 +62,7 @@ unsigned long CalculateBlockCRC32 ( unsigned long ulCount, /* Number of bytes in
   unsigned long ulCRC = 0;
   while ( ulCount-- != 0 ) {
     ulTemp1 = ( ulCRC >> 8 ) & 0x00FFFFFFL;
-    ulTemp2 = CRC32Value( ((int) ulCRC ^ *ucBuffer++ ) & 0xff );
+    ulTemp2 = crc32_table.values[ ((int) ulCRC ^ *ucBuffer++ ) & 0xff ];
     ulCRC = ulTemp1 ^ ulTemp2;
   }
   return( ulCRC );
@@ -53,6 +72,313 @@ unsigned long CalculateBlockCRC32 ( unsigned long ulCount, /* Number of bytes in
 
 
 
+/* --------------------------------------------------------------------------
+Message decoding.  Each log is copied from the receive buffer into its
+structure.  Logs with a repeated block only have the records actually
+received copied, and the record count is limited to what the structure holds.
+-------------------------------------------------------------------------- */
+template <typename T>
+static bool DecodeMessage(unsigned char *message, size_t length, T &decoded) {
+    size_t copy_length = std::min(length, sizeof(decoded));
+    memcpy(&decoded, message, copy_length);
+    if (copy_length < sizeof(decoded))
+        memset(((unsigned char*)&decoded)+copy_length, 0, sizeof(decoded)-copy_length);
+    return true;
+}
+
+/*!
+ * Copies a log with a repeated block into its structure.
+ *
+ * @param fixed_length length of the message body before the repeated
+ * block, including the record count which is its last 4 bytes
+ * @param records first record of the repeated block in the structure
+ * @param crc crc field of the structure
+ */
+static bool DecodeVariableMessage(unsigned char *message, size_t length, void *decoded,
+                                  size_t fixed_length, void *records, size_t record_size,
+                                  uint32_t max_records, uint8_t *crc) {
+    size_t header_length = message[3];
+    size_t payload_length = (((uint16_t) message[9]) << 8) + message[8];
+    if ((header_length != HEADER_SIZE) || (fixed_length > payload_length) ||
+        (header_length + payload_length + 4 > length))
+        return false;
+
+    // Copy header and unrepeated fields
+    memcpy(decoded, message, header_length+fixed_length);
+    uint32_t number_of_records;
+    memcpy(&number_of_records, message+header_length+fixed_length-4, 4);
+    uint32_t received_records = (payload_length-fixed_length)/record_size;
+    number_of_records = std::min(number_of_records, std::min(received_records, max_records));
+    memcpy(((unsigned char*)decoded)+header_length+fixed_length-4, &number_of_records, 4);
+    // Copy repeated fields
+    memcpy(records, message+header_length+fixed_length, number_of_records*record_size);
+    // Copy CRC
+    memcpy(crc, message+header_length+payload_length, 4);
+    return true;
+}
+
+static bool DecodeMessage(unsigned char *message, size_t length, Dop &decoded) {
+    return DecodeVariableMessage(message, length, &decoded, 28, decoded.prn,
+                                 sizeof(decoded.prn[0]), MAX_CHAN, decoded.crc);
+}
+
+static bool DecodeMessage(unsigned char *message, size_t length, RangeMeasurements &decoded) {
+    return DecodeVariableMessage(message, length, &decoded, 4, decoded.range_data,
+                                 sizeof(RangeData), MAX_CHAN, decoded.crc);
+}
+
+static bool DecodeMessage(unsigned char *message, size_t length, CompressedRangeMeasurements &decoded) {
+    return DecodeVariableMessage(message, length, &decoded, 4, decoded.range_data,
+                                 sizeof(CompressedRangeData), MAX_CHAN, decoded.crc);
+}
+
+static bool DecodeMessage(unsigned char *message, size_t length, SatellitePositions &decoded) {
+    return DecodeVariableMessage(message, length, &decoded, 12, decoded.data,
+                                 sizeof(SatellitePositionData), MAX_CHAN, decoded.crc);
+}
+
+static bool DecodeMessage(unsigned char *message, size_t length, SatelliteVisibility &decoded) {
+    return DecodeVariableMessage(message, length, &decoded, 12, decoded.data,
+                                 sizeof(SatelliteVisibilityData), MAX_CHAN, decoded.crc);
+}
+
+static bool DecodeMessage(unsigned char *message, size_t length, TrackStatus &decoded) {
+    return DecodeVariableMessage(message, length, &decoded, 16, decoded.data,
+                                 sizeof(TrackStatusData), MAX_CHAN, decoded.crc);
+}
+
+static bool DecodeMessage(unsigned char *message, size_t length, LogList &decoded) {
+    return DecodeVariableMessage(message, length, &decoded, 4, decoded.logs,
+                                 sizeof(LogListEntry), MAX_LOG_LIST, decoded.crc);
+}
+
+// RXCONFIG carries the header and body of a command instead of records
+static bool DecodeMessage(unsigned char *message, size_t length, ReceiverConfiguration &decoded) {
+    size_t payload_length = (((uint16_t) message[9]) << 8) + message[8];
+    if ((message[3] != HEADER_SIZE) || (payload_length < HEADER_SIZE) ||
+        (HEADER_SIZE + payload_length + 4 > length))
+        return false;
+    size_t command_length = std::min<size_t>(payload_length-HEADER_SIZE, MAX_RXCONFIG_LENGTH);
+    memset(&decoded, 0, sizeof(decoded));
+    memcpy(&decoded, message, 2*HEADER_SIZE + command_length);
+    memcpy(decoded.crc, message + HEADER_SIZE + payload_length, 4);
+    return true;
+}
+
+// GPSEPHEM has no repeated block, so anything but a whole one is rejected
+static bool DecodeMessage(unsigned char *message, size_t length, GpsEphemeris &decoded) {
+    if (length != sizeof(decoded))
+        return false;
+    memcpy(&decoded, message, sizeof(decoded));
+    return true;
+}
+
+//! Warning for a message DecodeMessage() rejected
+template <typename T>
+static const char* DecodeFailure(const T &decoded) {
+    return "could not decode message";
+}
+
+static const char* DecodeFailure(const GpsEphemeris &decoded) {
+    return "GpsEphemeris mismatch";
+}
+
+/*!
+ * Returns the structure a binary log is decoded into, or NULL if the
+ * log is not decoded by the driver.  Must agree with Novatel::ParseBinary().
+ */
+static const std::type_info* MessageType(BINARY_LOG_TYPE message_id) {
+    switch (message_id) {
+        case BESTGPSPOS_LOG_TYPE:
+        case BESTPOSB_LOG_TYPE:
+        case PSRPOSB_LOG_TYPE:
+        case RTKPOSB_LOG_TYPE:
+            return &typeid(Position);
+        case BESTLEVERARM_LOG_TYPE: return &typeid(BestLeverArm);
+        case BESTUTMB_LOG_TYPE: return &typeid(UtmPosition);
+        case BESTVELB_LOG_TYPE: return &typeid(Velocity);
+        case BESTXYZB_LOG_TYPE: return &typeid(PositionEcef);
+        case INSPVA_LOG_TYPE: return &typeid(InsPositionVelocityAttitude);
+        case INSPVAS_LOG_TYPE: return &typeid(InsPositionVelocityAttitudeShort);
+        case VEHICLEBODYROTATION_LOG_TYPE: return &typeid(VehicleBodyRotation);
+        case INSSPD_LOG_TYPE: return &typeid(InsSpeed);
+        case RAWIMU_LOG_TYPE: return &typeid(RawImu);
+        case RAWIMUS_LOG_TYPE: return &typeid(RawImuShort);
+        case INSCOV_LOG_TYPE: return &typeid(InsCovariance);
+        case INSCOVS_LOG_TYPE: return &typeid(InsCovarianceShort);
+        case PSRDOPB_LOG_TYPE:
+        case RTKDOPB_LOG_TYPE:
+            return &typeid(Dop);
+        case BSLNXYZ_LOG_TYPE: return &typeid(BaselineEcef);
+        case IONUTCB_LOG_TYPE: return &typeid(IonosphericModel);
+        case RANGEB_LOG_TYPE: return &typeid(RangeMeasurements);
+        case RANGECMPB_LOG_TYPE: return &typeid(CompressedRangeMeasurements);
+        case GPSEPHEMB_LOG_TYPE: return &typeid(GpsEphemeris);
+        case RAWEPHEMB_LOG_TYPE: return &typeid(RawEphemeris);
+        case SATXYZB_LOG_TYPE: return &typeid(SatellitePositions);
+        case SATVISB_LOG_TYPE: return &typeid(SatelliteVisibility);
+        case TIMEB_LOG_TYPE: return &typeid(TimeOffset);
+        case TRACKSTATB_LOG_TYPE: return &typeid(TrackStatus);
+        case RXHWLEVELSB_LOG_TYPE: return &typeid(ReceiverHardwareStatus);
+        case VERSIONB_LOG_TYPE: return &typeid(Version);
+        case RXSTATUSB_LOG_TYPE: return &typeid(RXStatus);
+        case RXCONFIGB_LOG_TYPE: return &typeid(ReceiverConfiguration);
+        case LOGLISTB_LOG_TYPE: return &typeid(LogList);
+        default: return NULL;
+    }
+}
+
+//! Typical number of records in logs with repeated blocks, used before one is received
+static const size_t TYPICAL_OBSERVATIONS = 24;  //!< signals tracked, e.g. 12 satellites on L1 and L2
+static const size_t TYPICAL_SATELLITES = 12;
+//! Typical rate of IMU logs requested ONNEW [Hz]
+static const double TYPICAL_IMU_RATE = 100;
+
+//! Bytes in a message with the given body and a typical number of records
+static size_t VariableLogSize(size_t fixed_length, size_t record_size, size_t records) {
+    return HEADER_SIZE + fixed_length + records*record_size + 4;
+}
+
+/*!
+ * Size of a message of a binary log on the wire, including its header and
+ * CRC, or 0 if the driver does not know the log.  Must agree with the
+ * DecodeMessage() overloads.
+ */
+static size_t NominalLogSize(BINARY_LOG_TYPE message_id) {
+    switch (message_id) {
+        case PSRDOPB_LOG_TYPE:
+        case RTKDOPB_LOG_TYPE:
+            return VariableLogSize(28, sizeof(((Dop*)0)->prn[0]), TYPICAL_SATELLITES);
+        case RANGEB_LOG_TYPE:
+            return VariableLogSize(4, sizeof(RangeData), TYPICAL_OBSERVATIONS);
+        case RANGECMPB_LOG_TYPE:
+            return VariableLogSize(4, sizeof(CompressedRangeData), TYPICAL_OBSERVATIONS);
+        case SATXYZB_LOG_TYPE:
+            return VariableLogSize(12, sizeof(SatellitePositionData), TYPICAL_SATELLITES);
+        case SATVISB_LOG_TYPE:
+            return VariableLogSize(12, sizeof(SatelliteVisibilityData), TYPICAL_SATELLITES);
+        case TRACKSTATB_LOG_TYPE:
+            return VariableLogSize(16, sizeof(TrackStatusData), TYPICAL_OBSERVATIONS);
+        // every other log decoded by the driver fills its whole structure
+        case BESTGPSPOS_LOG_TYPE:
+        case BESTPOSB_LOG_TYPE:
+        case PSRPOSB_LOG_TYPE:
+        case RTKPOSB_LOG_TYPE:
+            return sizeof(Position);
+        case BESTLEVERARM_LOG_TYPE: return sizeof(BestLeverArm);
+        case BESTUTMB_LOG_TYPE: return sizeof(UtmPosition);
+        case BESTVELB_LOG_TYPE: return sizeof(Velocity);
+        case BESTXYZB_LOG_TYPE: return sizeof(PositionEcef);
+        case INSPVA_LOG_TYPE: return sizeof(InsPositionVelocityAttitude);
+        case INSPVAS_LOG_TYPE: return sizeof(InsPositionVelocityAttitudeShort);
+        case VEHICLEBODYROTATION_LOG_TYPE: return sizeof(VehicleBodyRotation);
+        case INSSPD_LOG_TYPE: return sizeof(InsSpeed);
+        case RAWIMU_LOG_TYPE: return sizeof(RawImu);
+        case RAWIMUS_LOG_TYPE: return sizeof(RawImuShort);
+        case INSCOV_LOG_TYPE: return sizeof(InsCovariance);
+        case INSCOVS_LOG_TYPE: return sizeof(InsCovarianceShort);
+        case BSLNXYZ_LOG_TYPE: return sizeof(BaselineEcef);
+        case IONUTCB_LOG_TYPE: return sizeof(IonosphericModel);
+        case GPSEPHEMB_LOG_TYPE: return sizeof(GpsEphemeris);
+        case RAWEPHEMB_LOG_TYPE: return sizeof(RawEphemeris);
+        case TIMEB_LOG_TYPE: return sizeof(TimeOffset);
+        case RXHWLEVELSB_LOG_TYPE: return sizeof(ReceiverHardwareStatus);
+        case VERSIONB_LOG_TYPE: return sizeof(Version);
+        case RXSTATUSB_LOG_TYPE: return sizeof(RXStatus);
+        default: return 0;
+    }
+}
+
+struct BinaryLogInfo {
+    BINARY_LOG_TYPE log_type;
+    const char *name;             //!< name used in LOG commands
+    const char *default_trigger;  //!< used when the log is requested automatically
+};
+
+static const BinaryLogInfo binary_logs[] = {
+    {LOGLISTB_LOG_TYPE, "LOGLISTB", "ONCE"},
+    {GPSEPHEMB_LOG_TYPE, "GPSEPHEMB", "ONCHANGED"},
+    {IONUTCB_LOG_TYPE, "IONUTCB", "ONCHANGED"},
+    {CLOCKMODELB_LOG_TYPE, "CLOCKMODELB", "ONTIME 1"},
+    {VERSIONB_LOG_TYPE, "VERSIONB", "ONCE"},
+    {RAWEPHEMB_LOG_TYPE, "RAWEPHEMB", "ONCHANGED"},
+    {BESTPOSB_LOG_TYPE, "BESTPOSB", "ONTIME 1"},
+    {BESTUTMB_LOG_TYPE, "BESTUTMB", "ONTIME 1"},
+    {BESTXYZB_LOG_TYPE, "BESTXYZB", "ONTIME 1"},
+    {RANGEB_LOG_TYPE, "RANGEB", "ONTIME 1"},
+    {PSRPOSB_LOG_TYPE, "PSRPOSB", "ONTIME 1"},
+    {SATVISB_LOG_TYPE, "SATVISB", "ONTIME 1"},
+    {ALMANACB_LOG_TYPE, "ALMANACB", "ONCHANGED"},
+    {RAWALMB_LOG_TYPE, "RAWALMB", "ONCHANGED"},
+    {TRACKSTATB_LOG_TYPE, "TRACKSTATB", "ONTIME 1"},
+    {SATSTATB_LOG_TYPE, "SATSTATB", "ONTIME 1"},
+    {SATXYZB_LOG_TYPE, "SATXYZB", "ONTIME 1"},
+    {RXSTATUSB_LOG_TYPE, "RXSTATUSB", "ONCHANGED"},
+    {RXSTATUSEVENTB_LOG_TYPE, "RXSTATUSEVENTB", "ONNEW"},
+    {RXHWLEVELSB_LOG_TYPE, "RXHWLEVELSB", "ONTIME 1"},
+    {MATCHEDPOSB_LOG_TYPE, "MATCHEDPOSB", "ONCHANGED"},
+    {BESTVELB_LOG_TYPE, "BESTVELB", "ONTIME 1"},
+    {PSRVELB_LOG_TYPE, "PSRVELB", "ONTIME 1"},
+    {TIMEB_LOG_TYPE, "TIMEB", "ONTIME 1"},
+    {RANGEPNB_LOG_TYPE, "RANGEPNB", "ONTIME 1"},
+    {RXCONFIGB_LOG_TYPE, "RXCONFIGB", "ONCE"},
+    {RANGECMPB_LOG_TYPE, "RANGECMPB", "ONTIME 1"},
+    {RTKPOSB_LOG_TYPE, "RTKPOSB", "ONTIME 1"},
+    {RTKDOPB_LOG_TYPE, "RTKDOPB", "ONTIME 1"},
+    {NAVIGATEB_LOG_TYPE, "NAVIGATEB", "ONTIME 1"},
+    {AVEPOSB_LOG_TYPE, "AVEPOSB", "ONTIME 1"},
+    {REFSTATIONB_LOG_TYPE, "REFSTATIONB", "ONCHANGED"},
+    {PASSCOM1B_LOG_TYPE, "PASSCOM1B", "ONCHANGED"},
+    {PASSCOM2B_LOG_TYPE, "PASSCOM2B", "ONCHANGED"},
+    {PASSCOM3B_LOG_TYPE, "PASSCOM3B", "ONCHANGED"},
+    {BSLNXYZ_LOG_TYPE, "BSLNXYZB", "ONTIME 1"},
+    {PSRXYZ_LOG_TYPE, "PSRXYZB", "ONTIME 1"},
+    {PSRDOPB_LOG_TYPE, "PSRDOPB", "ONTIME 1"},
+    {BESTGPSPOS_LOG_TYPE, "BESTGPSPOSB", "ONTIME 1"},
+    {BESTGPSVEL_LOG_TYPE, "BESTGPSVELB", "ONTIME 1"},
+    {BESTLEVERARM_LOG_TYPE, "BESTLEVERARMB", "ONCHANGED"},
+    {INSATT_LOG_TYPE, "INSATTB", "ONTIME 1"},
+    {INSCOV_LOG_TYPE, "INSCOVB", "ONTIME 1"},
+    {INSCOVS_LOG_TYPE, "INSCOVSB", "ONTIME 1"},
+    {INSPOS_LOG_TYPE, "INSPOSB", "ONTIME 1"},
+    {INSPOSSYNC_LOG_TYPE, "INSPOSSYNCB", "ONTIME 1"},
+    {INSPVA_LOG_TYPE, "INSPVAB", "ONTIME 1"},
+    {INSPVAS_LOG_TYPE, "INSPVASB", "ONTIME 1"},
+    {INSSPD_LOG_TYPE, "INSSPDB", "ONTIME 1"},
+    {INSUTM_LOG_TYPE, "INSUTMB", "ONTIME 1"},
+    {INSUPDATE_LOG_TYPE, "INSUPDATEB", "ONCHANGED"},
+    {INSVEL_LOG_TYPE, "INSVELB", "ONTIME 1"},
+    {RAWIMU_LOG_TYPE, "RAWIMUB", "ONNEW"},
+    {RAWIMUS_LOG_TYPE, "RAWIMUSB", "ONNEW"},
+    {VEHICLEBODYROTATION_LOG_TYPE, "VEHICLEBODYROTATIONB", "ONCHANGED"},
+};
+
+static const BinaryLogInfo* FindBinaryLog(BINARY_LOG_TYPE log_type) {
+    for (size_t ii=0; ii<sizeof(binary_logs)/sizeof(binary_logs[0]); ii++) {
+        if (binary_logs[ii].log_type == log_type)
+            return &binary_logs[ii];
+    }
+    return NULL;
+}
+
+const char* novatel::BinaryLogName(BINARY_LOG_TYPE log_type) {
+    const BinaryLogInfo *info = FindBinaryLog(log_type);
+    return info ? info->name : NULL;
+}
+
+bool novatel::BinaryLogTypeFromName(const std::string &name, BINARY_LOG_TYPE *log_type) {
+    std::string upper(name);
+    std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+    for (size_t ii=0; ii<sizeof(binary_logs)/sizeof(binary_logs[0]); ii++) {
+        if (upper == binary_logs[ii].name) {
+            *log_type = binary_logs[ii].log_type;
+            return true;
+        }
+    }
+    return false;
+}
+
+
 /*!
  * Default callback method for timestamping data.  Used if a
  * user callback is not set.  Returns the current time from the
@@ -76,7 +402,7 @@ inline void printHex(char *data, int length) {
 
 
 // stolen from: http://oopweb.com/CPP/Documents/CPPHOWTO/Volume/C++Programming-HOWTO-7.html
-void Tokenize(const std::string& str, std::vector<std::string>& tokens, const std::string& delimiters = " ") {
+static void Tokenize(const std::string& str, std::vector<std::string>& tokens, const std::string& delimiters = " ") {
 	// Skip delimiters at beginning.
 	std::string::size_type lastPos = str.find_first_not_of(delimiters, 0);
 	// Find first "non-delimiter".
@@ -122,11 +448,9 @@ void DefaultBestPositionCallback(Position best_position, double time_stamp){
 }
 
 Novatel::Novatel() {
-	serial_port_=NULL;
 	reading_status_=false;
 	time_handler_ = DefaultGetTime;
     handle_acknowledgement_=DefaultAcknowledgementHandler;
-    best_position_callback_=DefaultBestPositionCallback;
     log_debug_=DefaultDebugMsgCallback;
     log_info_=DefaultInfoMsgCallback;
     log_warning_=DefaultWarningMsgCallback;
@@ -135,253 +459,1005 @@ Novatel::Novatel() {
     buffer_index_=0;
     read_timestamp_=0;
     parse_timestamp_=0;
-    ack_received_=false;
+    commands_sent_=0;
+    responses_received_=0;
+    binary_commands_=true;
+    binary_commands_sent_=0;
+    bytes_received_=0;
+    connection_state_=DISCONNECTED;
+    stop_logs_on_disconnect_=true;
+    bandwidth_policy_=BANDWIDTH_WARN;
+    max_utilization_=0.8;
+    max_baud_rate_=921600;
+    changing_baud_rate_=false;
+    for (size_t ii=0; ii<MAX_LOG_ID; ii++)
+        observed_log_sizes_[ii]=0;
+    auto_reconnect_=true;
+    supervising_=false;
+    port_lost_=false;
+    reconnect_count_=0;
+    gap_pending_=false;
+    gap_start_=0;
+    adaptive_log_rates_=false;
+    const BINARY_LOG_TYPE low_priority[] = {GPSEPHEMB_LOG_TYPE, RAWEPHEMB_LOG_TYPE, IONUTCB_LOG_TYPE,
+        ALMANACB_LOG_TYPE, RAWALMB_LOG_TYPE, SATVISB_LOG_TYPE, SATXYZB_LOG_TYPE, TRACKSTATB_LOG_TYPE,
+        SATSTATB_LOG_TYPE, RXHWLEVELSB_LOG_TYPE, PSRDOPB_LOG_TYPE, RTKDOPB_LOG_TYPE};
+    for (size_t ii=0; ii<sizeof(low_priority)/sizeof(low_priority[0]); ii++)
+        low_priority_logs_.set(low_priority[ii]);
+    receiver_idle_=255;
+    receiver_status_=0;
+    for (size_t ii=0; ii<MAX_LOG_ID; ii++)
+        log_counts_[ii]=0;
+    healthy_intervals_=0;
+    log_rates_changed_=false;
+    last_rate_control_=boost::get_system_time();
+    for (size_t ii=0; ii<MAX_LOG_ID; ii++)
+        log_timing_[ii]=NULL;
+    for (size_t ii=0; ii<MAX_LOG_ID; ii++)
+        log_latency_[ii]=NULL;
+    latency_tracking_=true;
+    gps_utc_offset_=18;
+    read_monotonic_us_=0;
+    read_wall_time_=0;
+    frame_monotonic_us_=0;
+    writing_status_=false;
+    writer_statistics_=WriterStatistics();
+    total_write_latency_ms_=0;
     is_connected_ = false;
+    message_id_=BINARY_LOG_TYPE(0);
+    frame_timestamp_=0;
+    baud_rate_=0;
+    next_subscription_id_=1;
+    batch_flush_period_=0;
+    last_batch_flush_=0;
+    auto_logging_=false;
+    skipping_message_=false;
+    subscribers_.store(new SubscriberTable());
+    read_epoch_=0;
+    dispatch_subscribers_=NULL;
+    set_best_position_callback(DefaultBestPositionCallback);
 }
 
 Novatel::~Novatel() {
+    metrics_server_.Stop();
     Disconnect();
+    boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+    for (size_t ii=0; ii<retired_tables_.size(); ii++)
+        delete retired_tables_[ii].first;
+    retired_tables_.clear();
+    delete subscribers_.load();
+    for (size_t ii=0; ii<MAX_LOG_ID; ii++) {
+        delete log_timing_[ii];
+        delete log_latency_[ii].load();
+    }
 }
 
+//! Baud rates of the receiver's serial ports, slowest first
+static const int SUPPORTED_BAUD_RATES[] = {9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600};
+
+//! Baud rates tried when searching for the receiver, most common first
+static const int DETECTABLE_BAUD_RATES[] = {115200, 9600, 230400, 460800, 921600, 57600, 38400, 19200};
+static const size_t DETECTABLE_BAUD_RATE_COUNT = sizeof(DETECTABLE_BAUD_RATES)/sizeof(DETECTABLE_BAUD_RATES[0]);
+
 bool Novatel::Connect(std::string port, int baudrate, bool search) {
+	boost::system_time start = boost::get_system_time();
+	if (!FindReceiver(port, baudrate, search)) {
+		log_error_("Failed to connect.");
+		return false;
+	}
+
+	is_connected_ = true;
+	SetConnectionState(CONNECTED);
+	std::stringstream output;
+	output << "Connected in " << (boost::get_system_time()-start).total_milliseconds() << " ms.";
+	log_info_(output.str());
+	if (auto_logging_)
+		RequestSubscribedLogs();
+	StartSupervisor();
+	return true;
+}
 
-	bool connected = Connect_(port, baudrate);
+bool Novatel::FindReceiver(std::string port, int baudrate, bool search) {
+	// the receiver is usually still at the rate asked for, and answers
+	// within one reply time even when UNLOGALL has left it quiet
+	if (Connect_(port, baudrate))
+		return true;
 
-	if (!connected && search) {
-		// search additional baud rates
-		int bauds_to_search[5]={9600,19200,38400,57600,115200};
-		bool found = false;
-		for (int ii=0; ii<5; ii++){
+	bool connected = false;
+	if (search) {
+		// a receiver already sending logs gives its baud rate away before
+		// anything more is sent to it
+		int found_baud = DetectBaudRate(port, 250, baudrate);
+		if ((found_baud > 0) && !Connect_(port, found_baud))
+			found_baud = 0;
+
+		// otherwise ask at each other baud rate in turn
+		for (size_t ii=0; (found_baud == 0) && (ii<DETECTABLE_BAUD_RATE_COUNT); ii++){
+			if (DETECTABLE_BAUD_RATES[ii] == baudrate)
+				continue;
 			std::stringstream search_msg;
-			search_msg << "Searching for receiver with baudrate: " << bauds_to_search[ii];
+			search_msg << "Searching for receiver with baudrate: " << DETECTABLE_BAUD_RATES[ii];
 			log_info_(search_msg.str());
-			if (Connect_(port, bauds_to_search[ii])) {
-				found = true;
-				break;
-			}
+			if (Connect_(port, DETECTABLE_BAUD_RATES[ii]))
+				found_baud = DETECTABLE_BAUD_RATES[ii];
 		}
 
 		// if the receiver was found on a different baud rate, 
 		// change its setting to the selected baud rate and reconnect
-		if (found) {
+		if (found_baud == baudrate) {
+			connected = true;
+		} else if (found_baud > 0) {
 			// change baud rate to selected value
 			std::stringstream cmd;
-			cmd << "COM " << baudrate << "\r\n";
+			cmd << "COM " << baudrate;
 			std::stringstream baud_msg;
 			baud_msg << "Changing receiver baud rate to " << baudrate;
 			log_info_(baud_msg.str());
-			try {
-				serial_port_->write(cmd.str());
-			} catch (std::exception &e) {
-				std::stringstream output;
-			    output << "Error changing baud rate: " << e.what();
-			    log_error_(output.str());
-			    return false;
-			}
-			Disconnect();
+			// the receiver answers at the new rate, so don't wait for it;
+			// closing the port lets the writer finish writing the command
+			WriteCommand(cmd.str(), NULL);
+			ClosePort(false);
 			boost::this_thread::sleep(boost::posix_time::milliseconds(100));
 			connected = Connect_(port, baudrate);
 		} 
 	}
 
-	if (connected) {
-		// start reading
-		StartReading();
-		is_connected_ = true;
-		return true;
-	} else {
-		log_error_("Failed to connect.");
-		return false;
-	}
-
+	return connected;
 }
 
 bool Novatel::Connect_(std::string port, int baudrate=115200) {
+	SetConnectionState(OPENING);
 	try {
 
 		//serial::Timeout my_timeout(50, 200, 0, 200, 0); // 115200 working settings
 		//serial_port_ = new serial::Serial(port,baudrate,my_timeout);
 
-		serial_port_ = new serial::Serial(port,baudrate,serial::Timeout::simpleTimeout(50));
+		boost::shared_ptr<serial::Serial> serial_port(
+			new serial::Serial(port,baudrate,serial::Timeout::simpleTimeout(50)));
+		baud_rate_ = baudrate;
 
-		if (!serial_port_->isOpen()){
+		if (!serial_port->isOpen()){
 	        std::stringstream output;
 	        output << "Serial port: " << port << " failed to open." << std::endl;
 	        log_error_(output.str());
-			delete serial_port_;
-			serial_port_ = NULL;
+			SetConnectionState(DISCONNECTED);
 			return false;
 		} else {
 	        std::stringstream output;
 	        output << "Serial port: " << port << " opened successfully." << std::endl;
 	        log_info_(output.str());
 		}
-
-		// stop any incoming data and flush buffers
-		serial_port_->write("UNLOGALL\r\n");
-		// wait for data to stop cominig in
-		boost::this_thread::sleep(boost::posix_time::milliseconds(1000));
-		// clear serial port buffers
-		serial_port_->flush();
-
-		// look for GPS by sending ping and waiting for response
-		if (!Ping()){
-	        std::stringstream output;
-	        output << "Novatel GPS not found on port: " << port << " at baudrate " << baudrate << std::endl;
-	        log_error_(output.str());
-			delete serial_port_;
-			serial_port_ = NULL;
-			is_connected_ = false;
-			return false;
-		}
+		boost::lock_guard<boost::mutex> lock(serial_port_mutex_);
+		serial_port_ = serial_port;
 	} catch (std::exception &e) {
 	    std::stringstream output;
 	    output << "Error connecting to gps on com port " << port << ": " << e.what();
 	    log_error_(output.str());
 	    is_connected_ = false;
+	    SetConnectionState(DISCONNECTED);
 	    return false;
 	}
 
+	// the handshake is read by the read thread like any other data, so
+	// each step finishes as soon as its reply arrives
+	StartWriting();
+	StartReading();
+
+	// the VERSION reply is picked out of any logs already running
+	SetConnectionState(IDENTIFYING);
+	if (!Ping(1)) {
+        std::stringstream output;
+        output << "Novatel GPS not found on port: " << port << " at baudrate " << baudrate << std::endl;
+        log_error_(output.str());
+		// a receiver that was only slow to answer keeps its logs
+		ClosePort(false);
+		return false;
+	}
+
+	// a receiver seen on this port before keeps the logs it is known to
+	// be sending, so the LOGLIST is only read from receivers not cached
+	CachedReceiver cached;
+	if (FindCachedReceiver(port, &cached) && WarmConnect(port, cached))
+		return true;
+
+	// logs already running are left alone and only changes are sent later.
+	// Without a LOGLIST the logs are stopped, since nothing is known of them.
+	SetConnectionState(READING_LOGS);
+	if (!ReadLogList(NULL)) {
+		log_warning_("No LOGLIST from the receiver; stopping its logs instead.");
+		SetConnectionState(STOPPING_LOGS);
+		uint32_t timeout_ms = ResponseTimeout();
+		boost::unique_future<CommandResult> unlog = SendCommandAsync("UNLOGALL", timeout_ms);
+		if (!unlog.timed_wait_until(boost::get_system_time() + boost::posix_time::milliseconds(timeout_ms)))
+			ExpireCommands();
+		{
+			boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+			requested_logs_.reset();
+		}
+		WaitForQuietLine(timeout_ms);
+	}
+
+	port_ = port;
+	UpdateReceiverCache(false);
 	return true;
 }
 
+bool Novatel::WarmConnect(const std::string &port, const CachedReceiver &cached) {
+	if (serial_number_ != cached.serial_number) {
+		log_info_("Receiver on port " + port + " has changed since it was cached.");
+		return false;
+	}
 
-void Novatel::Disconnect() {
-	log_info_("Novatel disconnecting.");
-	StopReading();
-	// sleep longer than the timeout period
-	boost::this_thread::sleep(boost::posix_time::milliseconds(150));
+	// logs requested both when the configuration was saved and since are
+	// being sent whether or not the receiver has restarted in between
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		requested_logs_.reset();
+		for (std::map<uint16_t, std::string>::const_iterator it = cached.logs.begin();
+				it != cached.logs.end(); ++it) {
+			std::map<uint16_t, std::string>::const_iterator saved = cached.saved_logs.find(it->first);
+			if ((saved != cached.saved_logs.end()) && (saved->second == it->second)) {
+				requested_logs_.set(it->first);
+				log_triggers_[it->first] = it->second;
+			}
+		}
+	}
+	log_info_("Reconnected to receiver " + serial_number_ + " using its cached configuration.");
+	port_ = port;
+	UpdateReceiverCache(false);
+	return true;
+}
 
-	try {
-		if ((serial_port_!=NULL) && (serial_port_->isOpen()) ) {
-			log_info_("Sending UNLOGALL and closing port.");
-			serial_port_->write("UNLOGALL\r\n");
-			serial_port_->close();
-			delete serial_port_;
-			serial_port_=NULL;
+//! Trigger of a log list entry as it is given in a LOG command
+static std::string EntryTrigger(const LogListEntry &entry) {
+	static const char *names[] = {"ONNEW", "ONCHANGED", "ONTIME", "ONNEXT", "ONCE", "ONMARK", "STOPPED"};
+	std::stringstream trigger;
+	if (unsigned(entry.trigger) < sizeof(names)/sizeof(names[0]))
+		trigger << names[entry.trigger];
+	else
+		trigger << "UNKNOWN";
+	// LOG [port] message [trigger [period [offset [hold]]]]
+	if (entry.hold)
+		trigger << " " << entry.period << " " << entry.offset << " HOLD";
+	else if ((entry.trigger == ONTIME) && (entry.offset != 0))
+		trigger << " " << entry.period << " " << entry.offset;
+	else if (entry.trigger == ONTIME)
+		trigger << " " << entry.period;
+	return trigger.str();
+}
+
+//! True if two triggers given as in a LOG command have the same effect
+static bool TriggersMatch(std::string trigger, std::string other) {
+	std::transform(trigger.begin(), trigger.end(), trigger.begin(), ::toupper);
+	std::transform(other.begin(), other.end(), other.begin(), ::toupper);
+	std::vector<std::string> first, second;
+	Tokenize(trigger, first, " ");
+	Tokenize(other, second, " ");
+	if (first.empty() || second.empty() || (first.size() > 4) || (second.size() > 4))
+		return false;
+	// missing fields take their defaults, and numbers are compared by
+	// value, so "ONTIME 1.0" matches "ONTIME 1 0 NOHOLD"
+	while (first.size() < second.size())
+		first.push_back(first.size() == 3 ? "NOHOLD" : "0");
+	while (second.size() < first.size())
+		second.push_back(second.size() == 3 ? "NOHOLD" : "0");
+	for (size_t ii=0; ii<first.size(); ii++) {
+		const std::string &word = first[ii];
+		char *end;
+		double value = strtod(word.c_str(), &end);
+		if ((*end == 0) && !word.empty()) {
+			if (fabs(value - atof(second[ii].c_str())) > 1e-6)
+				return false;
+		} else if (word != second[ii]) {
+			return false;
 		}
-	} catch (std::exception &e) {
-	    std::stringstream output;
-	    output << "Error during disconnect: " << e.what();
-	    log_error_(output.str());
 	}
+	return true;
 }
 
-bool Novatel::Ping(int num_attempts) {
+//! True if a log list entry describes a log that keeps being output
+static bool IsContinuing(const LogListEntry &entry) {
+	return (entry.trigger != ONCE) && (entry.trigger != ONNEXT) && (entry.trigger != STOPPED);
+}
 
-	while ((num_attempts--)>0) {
-        std::stringstream output;
-        output << "Searching for Novatel receiver..." << std::endl;
-        log_info_(output.str());
-		if (UpdateVersion()) {
-            std::stringstream output;
-            output << "Found Novatel receiver." << std::endl;
-            output << "\tModel: " << model_ << std::endl;
-            output << "\tSerial Number: " << serial_number_ << std::endl;
-            output << "\tHardware version: " << hardware_version_ << std::endl;
-            output << "\tSoftware version: " << software_version_ << std::endl << std::endl;;
-            output << "Receiver capabilities:" << std::endl;
-            output << "\tL2: ";
-			if (l2_capable_)
-                output << "+" << std::endl;
-			else
-                output << "-" << std::endl;
-            output << "\tRaw measurements: ";
-			if (raw_capable_)
-                output << "+" << std::endl;
-			else
-                output << "-" << std::endl;
-            output << "\tRTK: ";
-			if (rtk_capable_)
-                output << "+" << std::endl;
-			else
-                output << "-" << std::endl;
-            output << "\tSPAN: ";
-			if (span_capable_)
-                output << "+" << std::endl;
-			else
-                output << "-" << std::endl;
-            output << "\tGLONASS: ";
-			if (glonass_capable_)
-                output << "+" << std::endl;
+bool Novatel::ReadLogList(std::vector<LogListEntry> *port_logs) {
+	uint32_t timeout_ms = ResponseTimeout();
+	boost::unique_future<LogList> list = Query<LogList>(LOGLISTB_LOG_TYPE, timeout_ms);
+	if (!list.timed_wait_until(boost::get_system_time() + boost::posix_time::milliseconds(timeout_ms)))
+		ExpireQueries();
+	if (list.has_exception())
+		return false;
+	LogList logs = list.get();
+
+	// the list came back on this port, and the low byte of a port id is the
+	// port address used in message headers
+	int32_t count = std::min<int32_t>(logs.number_of_logs, MAX_LOG_LIST);
+	boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+	requested_logs_.reset();
+	for (int32_t ii=0; ii<count; ii++) {
+		const LogListEntry &entry = logs.logs[ii];
+		if (((entry.port & 0xFF) != logs.header.port_address) || !IsContinuing(entry))
+			continue;
+		if (port_logs)
+			port_logs->push_back(entry);
+		// only binary logs can be delivered to subscribers
+		if ((entry.message_type & 0x60) || (entry.message_id >= MAX_LOG_ID))
+			continue;
+		requested_logs_.set(entry.message_id);
+		log_triggers_[entry.message_id] = EntryTrigger(entry);
+	}
+	return true;
+}
+
+bool Novatel::SetReceiverCacheFile(const std::string &path) {
+	boost::lock_guard<boost::mutex> lock(cache_mutex_);
+	receiver_cache_file_ = path;
+	std::ifstream file(path.c_str());
+	if (!file.is_open())
+		return true; // written on the first connection
+	// tab separated records:
+	//   receiver <port> <serial number> <model> <hardware version> <software version>
+	//   log|saved <port> <message id> <trigger>
+	std::string line;
+	while (std::getline(file, line)) {
+		std::vector<std::string> fields;
+		Tokenize(line, fields, "\t");
+		if ((fields.size() == 6) && (fields[0] == "receiver")) {
+			CachedReceiver &receiver = receiver_cache_[fields[1]];
+			receiver.serial_number = fields[2];
+			receiver.model = fields[3];
+			receiver.hardware_version = fields[4];
+			receiver.software_version = fields[5];
+		} else if ((fields.size() == 4) && ((fields[0] == "log") || (fields[0] == "saved"))) {
+			CachedReceiver &receiver = receiver_cache_[fields[1]];
+			uint16_t log_id = uint16_t(atoi(fields[2].c_str()));
+			if (fields[0] == "log")
+				receiver.logs[log_id] = fields[3];
 			else
-                output << "-" << std::endl;
-            log_info_(output.str());
-            return true;
+				receiver.saved_logs[log_id] = fields[3];
+		} else if (!line.empty()) {
+			log_warning_("Ignoring unrecognized line in receiver cache " + path + ": " + line);
 		}
 	}
+	return !file.bad();
+}
 
-	// no response found
-	return false;
+void Novatel::ClearReceiverCache() {
+	boost::lock_guard<boost::mutex> lock(cache_mutex_);
+	receiver_cache_.clear();
+	if (!receiver_cache_file_.empty())
+		std::remove(receiver_cache_file_.c_str());
+}
+
+bool Novatel::FindCachedReceiver(const std::string &port, CachedReceiver *receiver) {
+	boost::lock_guard<boost::mutex> lock(cache_mutex_);
+	std::map<std::string, CachedReceiver>::const_iterator it = receiver_cache_.find(port);
+	if ((it == receiver_cache_.end()) || it->second.serial_number.empty())
+		return false;
+	*receiver = it->second;
+	return true;
+}
+
+void Novatel::UpdateReceiverCache(bool saved) {
+	if (port_.empty())
+		return; // no receiver identified
+	std::map<uint16_t, std::string> logs;
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		for (size_t log_id=0; log_id<requested_logs_.size(); log_id++) {
+			if (!requested_logs_[log_id])
+				continue;
+			std::map<uint16_t, std::string>::const_iterator trigger = log_triggers_.find(log_id);
+			const BinaryLogInfo *info = FindBinaryLog(BINARY_LOG_TYPE(log_id));
+			if (trigger != log_triggers_.end())
+				logs[log_id] = trigger->second;
+			else if (info != NULL)
+				logs[log_id] = info->default_trigger;
+		}
+	}
+
+	boost::lock_guard<boost::mutex> lock(cache_mutex_);
+	CachedReceiver &receiver = receiver_cache_[port_];
+	if (receiver.serial_number != serial_number_)
+		receiver.saved_logs.clear();
+	receiver.serial_number = serial_number_;
+	receiver.model = model_;
+	receiver.hardware_version = hardware_version_;
+	receiver.software_version = software_version_;
+	receiver.logs = logs;
+	if (saved)
+		receiver.saved_logs = logs;
+	if (receiver_cache_file_.empty())
+		return;
 
+	// write a new file and move it into place, so a crash leaves the old one
+	std::string temporary = receiver_cache_file_ + ".tmp";
+	{
+		std::ofstream file(temporary.c_str());
+		for (std::map<std::string, CachedReceiver>::const_iterator it = receiver_cache_.begin();
+				it != receiver_cache_.end(); ++it) {
+			const CachedReceiver &cached = it->second;
+			file << "receiver\t" << it->first << "\t" << cached.serial_number << "\t" << cached.model
+				<< "\t" << cached.hardware_version << "\t" << cached.software_version << "\n";
+			for (std::map<uint16_t, std::string>::const_iterator log = cached.logs.begin();
+					log != cached.logs.end(); ++log)
+				file << "log\t" << it->first << "\t" << log->first << "\t" << log->second << "\n";
+			for (std::map<uint16_t, std::string>::const_iterator log = cached.saved_logs.begin();
+					log != cached.saved_logs.end(); ++log)
+				file << "saved\t" << it->first << "\t" << log->first << "\t" << log->second << "\n";
+		}
+		if (!file.good()) {
+			log_error_("Error writing receiver cache " + temporary);
+			return;
+		}
+	}
+	if (std::rename(temporary.c_str(), receiver_cache_file_.c_str()) != 0)
+		log_error_("Error replacing receiver cache " + receiver_cache_file_);
 }
 
-bool Novatel::SendCommand(std::string cmd_msg) {
+int Novatel::DetectBaudRate(std::string port, uint32_t sample_ms, int first_baud) {
+	// the rate asked for is listened at first, then the rest, most common first
+	std::vector<int> rates;
+	if (first_baud > 0)
+		rates.push_back(first_baud);
+	for (size_t ii=0; ii<DETECTABLE_BAUD_RATE_COUNT; ii++) {
+		if (DETECTABLE_BAUD_RATES[ii] != first_baud)
+			rates.push_back(DETECTABLE_BAUD_RATES[ii]);
+	}
+
+	serial::Serial *listener = NULL;
+	int found_baud = 0;
 	try {
-		// sends command to GPS receiver
-        serial_port_->write(cmd_msg + "\r\n");
-		// wait for acknowledgement (or 2 seconds)
-		boost::mutex::scoped_lock lock(ack_mutex_);
-		boost::system_time const timeout=boost::get_system_time()+ boost::posix_time::milliseconds(2000);
-		if (ack_condition_.timed_wait(lock,timeout)) {
-      log_info_("Command `" + cmd_msg + "` sent to GPS receiver.");
-			return true;
-		} else {
-            log_error_("Command '" + cmd_msg + "' failed.");
-			return false;
+		listener = new serial::Serial(port, rates[0], serial::Timeout::simpleTimeout(20));
+		std::vector<unsigned char> sample(MAX_NOUT_SIZE);
+		// every rate is listened at: a receiver may be between logs, or its
+		// bytes at the wrong rate may be dropped as framing errors
+		for (size_t ii=0; (found_baud == 0) && (ii<rates.size()); ii++) {
+			if (ii > 0)
+				listener->setBaudrate(rates[ii]);
+			// drop whatever arrived at the previous rate
+			listener->flushInput();
+			size_t length = 0;
+			boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(sample_ms);
+			while (boost::get_system_time() < deadline) {
+				// once the sample is full keep its second half, which may
+				// hold the start of a message
+				if (length == sample.size()) {
+					memmove(&sample[0], &sample[length/2], length-length/2);
+					length -= length/2;
+				}
+				size_t count = listener->read(&sample[length], sample.size()-length);
+				if (count == 0)
+					continue;
+				length += count;
+				if (ScoreBaudSample(&sample[0], length) > 0) {
+					found_baud = rates[ii];
+					break;
+				}
+			}
 		}
 	} catch (std::exception &e) {
 		std::stringstream output;
-        output << "Error in Novatel::SendCommand(): " << e.what();
-        log_error_(output.str());
-        return false;
+		output << "Error listening for receiver on port " << port << ": " << e.what();
+		log_error_(output.str());
 	}
+	delete listener;
+
+	if (found_baud > 0) {
+		std::stringstream output;
+		output << "Receiver traffic detected at baudrate " << found_baud;
+		log_info_(output.str());
+	}
+	return found_baud;
 }
 
-bool Novatel::SetSvElevationAngleCutoff(float angle) {
-    try {
-        std::stringstream ang_cmd;
-        ang_cmd << "ECUTOFF " << angle;
-        return SendCommand(ang_cmd.str());
-    } catch (std::exception &e) {
-        std::stringstream output;
-        output << "Error in Novatel::SetSvElevationCutoff(): " << e.what();
-        log_error_(output.str());
-        return false;
-    }
+size_t Novatel::ScoreBaudSample(const unsigned char *data, size_t length) {
+	size_t valid = 0;
+	size_t ii = 0;
+	while (ii < length) {
+		size_t message_length = 0;
+		if ((data[ii] == 0xAA) && (ii+10 <= length) &&
+				(data[ii+1] == 0x44) && (data[ii+2] == 0x12)) {
+			// header, body and CRC of an OEM4 binary message
+			size_t total = data[ii+3] + (data[ii+8] | (data[ii+9]<<8)) + 4;
+			if ((total <= MAX_NOUT_SIZE) && (ii+total <= length)) {
+				const unsigned char *crc = data+ii+total-4;
+				unsigned long expected = crc[0] | (crc[1]<<8) | (crc[2]<<16) | ((unsigned long)crc[3]<<24);
+				if (CalculateBlockCRC32(total-4, const_cast<unsigned char*>(data+ii)) == expected)
+					message_length = total;
+			}
+		} else if (data[ii] == '#') {
+			// ASCII log: the CRC after '*' covers everything between '#' and '*'
+			size_t star = ii+1;
+			while ((star < length) && (data[star] != '*') && (data[star] != '#') &&
+					(data[star] != '\n') && (star-ii < MAX_NOUT_SIZE))
+				star++;
+			if ((star+9 <= length) && (data[star] == '*')) {
+				char hex[9];
+				memcpy(hex, data+star+1, 8);
+				hex[8] = 0;
+				char *end;
+				unsigned long expected = strtoul(hex, &end, 16);
+				if ((end == hex+8) &&
+						(CalculateBlockCRC32(star-ii-1, const_cast<unsigned char*>(data+ii+1)) == expected))
+					message_length = star+9-ii;
+			}
+		}
+		if (message_length > 0) {
+			valid++;
+			ii += message_length;
+		} else {
+			ii++;
+		}
+	}
+	return valid;
 }
 
-void Novatel::PDPFilterDisable() {
-    try{
-    std::stringstream pdp_cmd;
-    pdp_cmd << "PDPFILTER DISABLE" ;
-    bool result = SendCommand(pdp_cmd.str());
-    } catch (std::exception &e) {
-        std::stringstream output;
-        output << "Error in Novatel::PDPFilterDisable(): " << e.what();
-        log_error_(output.str());
-    }
+uint32_t Novatel::ResponseTimeout() const {
+	// allow for the reply queueing behind a kilobyte of logs
+	int baudrate = baud_rate_;
+	if (baudrate <= 0)
+		return 2000;
+	return 500 + (1024*10*1000)/baudrate;
 }
 
-void Novatel::PDPFilterEnable() {
-    try{
-    std::stringstream pdp_cmd;
-    pdp_cmd << "PDPFILTER ENABLE" ;
-    bool result = SendCommand(pdp_cmd.str());
-    } catch (std::exception &e) {
-        std::stringstream output;
-        output << "Error in Novatel::PDPFilterEnable(): " << e.what();
-        log_error_(output.str());
-    }
+bool Novatel::WaitForQuietLine(uint32_t timeout_ms) {
+	// quiet means nothing arrived for as long as 20 bytes take to send,
+	// and at least 20 ms since reads return at most every 50 ms
+	uint32_t quiet_ms = 20;
+	if (baud_rate_ > 0)
+		quiet_ms = std::max<uint32_t>(quiet_ms, (20*10*1000)/baud_rate_);
+	boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(timeout_ms);
+	uint64_t bytes = bytes_received_.load(boost::memory_order_relaxed);
+	while (boost::get_system_time() < deadline) {
+		boost::this_thread::sleep(boost::posix_time::milliseconds(quiet_ms));
+		uint64_t now_received = bytes_received_.load(boost::memory_order_relaxed);
+		if (now_received == bytes)
+			return true;
+		bytes = now_received;
+	}
+	log_warning_("Serial line did not go quiet.");
+	return false;
 }
 
-void Novatel::PDPFilterReset() {
-    try{
-    std::stringstream pdp_cmd;
-    pdp_cmd << "PDPFILTER RESET";
-    bool result = SendCommand(pdp_cmd.str());
-    } catch (std::exception &e) {
-        std::stringstream output;
+void Novatel::set_connection_state_callback(ConnectionStateCallback handler) {
+	boost::lock_guard<boost::mutex> lock(connection_state_mutex_);
+	connection_state_callback_ = handler;
+}
+
+void Novatel::SetConnectionState(ConnectionState state) {
+	connection_state_ = state;
+	// called without the lock, so the handler may replace itself
+	ConnectionStateCallback callback;
+	{
+		boost::lock_guard<boost::mutex> lock(connection_state_mutex_);
+		callback = connection_state_callback_;
+	}
+	if (callback)
+		callback(state);
+}
+
+
+boost::shared_ptr<serial::Serial> Novatel::SerialPort() {
+	boost::lock_guard<boost::mutex> lock(serial_port_mutex_);
+	return serial_port_;
+}
+
+void Novatel::Disconnect() {
+	log_info_("Novatel disconnecting.");
+	StopSupervisor();
+	ClosePort(stop_logs_on_disconnect_);
+	port_.clear();
+}
+
+void Novatel::ClosePort(bool stop_logs) {
+	StopReading();
+	StopWriting();
+	is_connected_ = false;
+
+	// threads still holding a copy of the port see it closed, and the
+	// last of them frees it
+	boost::shared_ptr<serial::Serial> serial_port;
+	{
+		boost::lock_guard<boost::mutex> lock(serial_port_mutex_);
+		serial_port.swap(serial_port_);
+	}
+	// responses to commands written on this port are not coming
+	AbandonCommands("port closed");
+
+	try {
+		if (serial_port) {
+			if (serial_port->isOpen() && stop_logs) {
+				log_info_("Sending UNLOGALL and closing port.");
+				serial_port->write("UNLOGALL\r\n");
+				serial_port->close();
+				{
+					boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+					requested_logs_.reset();
+				}
+			} else if (serial_port->isOpen()) {
+				log_info_("Closing port; the receiver's logs keep running.");
+				serial_port->close();
+			}
+			UpdateReceiverCache(false);
+		}
+	} catch (std::exception &e) {
+	    std::stringstream output;
+	    output << "Error during disconnect: " << e.what();
+	    log_error_(output.str());
+	}
+	if (connection_state_ != DISCONNECTED)
+		SetConnectionState(DISCONNECTED);
+}
+
+void Novatel::SetAutoReconnect(bool enable) {
+	{
+		boost::lock_guard<boost::mutex> lock(supervisor_mutex_);
+		auto_reconnect_ = enable;
+	}
+	if (!enable && !adaptive_log_rates_)
+		StopSupervisor();
+	else if (is_connected_)
+		StartSupervisor();
+}
+
+void Novatel::SetAdaptiveLogRates(bool enable) {
+	{
+		boost::lock_guard<boost::mutex> lock(supervisor_mutex_);
+		adaptive_log_rates_ = enable;
+		supervisor_condition_.notify_all();
+	}
+	// the supervisor keeps running to restore logs slowed down
+	if (enable && is_connected_)
+		StartSupervisor();
+}
+
+void Novatel::SetLogPriority(BINARY_LOG_TYPE log_type, bool low_priority) {
+	if (log_type >= MAX_LOG_ID)
+		return;
+	boost::lock_guard<boost::mutex> lock(supervisor_mutex_);
+	low_priority_logs_.set(log_type, low_priority);
+}
+
+void Novatel::StartSupervisor() {
+	boost::lock_guard<boost::mutex> lock(supervisor_mutex_);
+	if (!(auto_reconnect_ || adaptive_log_rates_) || supervising_)
+		return;
+	// a supervisor stopped earlier has finished, apart from perhaps this call
+	if (supervisor_thread_ptr_ && (supervisor_thread_ptr_->get_id() != boost::this_thread::get_id()))
+		supervisor_thread_ptr_->join();
+	supervising_ = true;
+	port_lost_ = false;
+	supervisor_thread_ptr_ = boost::shared_ptr<boost::thread>
+		(new boost::thread(boost::bind(&Novatel::Supervise, this)));
+}
+
+void Novatel::StopSupervisor() {
+	{
+		boost::lock_guard<boost::mutex> lock(supervisor_mutex_);
+		supervising_ = false;
+		supervisor_condition_.notify_all();
+	}
+	if (supervisor_thread_ptr_ && (supervisor_thread_ptr_->get_id() != boost::this_thread::get_id())) {
+		supervisor_thread_ptr_->join();
+		supervisor_thread_ptr_.reset();
+	}
+}
+
+//! Time between adjustments of log rates [ms]
+static const uint32_t RATE_CONTROL_INTERVAL_MS = 1000;
+
+void Novatel::Supervise() {
+	boost::unique_lock<boost::mutex> lock(supervisor_mutex_);
+	boost::system_time next_control = boost::get_system_time();
+	while (supervising_) {
+		if (port_lost_ && auto_reconnect_) {
+			lock.unlock();
+			bool restored = Reconnect();
+			lock.lock();
+			if (restored)
+				port_lost_ = false;
+			continue;
+		}
+		// logs slowed down are restored after adaptive rates are turned off
+		if (!adaptive_log_rates_ && throttled_logs_.empty()) {
+			supervisor_condition_.wait(lock);
+			next_control = boost::get_system_time();
+			continue;
+		}
+		if (boost::get_system_time() < next_control) {
+			supervisor_condition_.timed_wait(lock, next_control);
+			continue;
+		}
+		lock.unlock();
+		ControlLogRates();
+		lock.lock();
+		next_control = boost::get_system_time() + boost::posix_time::milliseconds(RATE_CONTROL_INTERVAL_MS);
+	}
+}
+
+bool Novatel::Reconnect() {
+	boost::system_time start = boost::get_system_time();
+	SetConnectionState(RECONNECTING);
+	std::string port = port_;
+	int baudrate = baud_rate_;
+
+	// what to ask for again once connected
+	std::string logs;
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		for (size_t log_id=0; log_id<requested_logs_.size(); log_id++) {
+			const BinaryLogInfo *info = FindBinaryLog(BINARY_LOG_TYPE(log_id));
+			if (!requested_logs_[log_id] || (info == NULL))
+				continue;
+			std::map<uint16_t, std::string>::const_iterator trigger = log_triggers_.find(log_id);
+			logs += std::string(logs.empty() ? "" : ";") + info->name + " " +
+				(trigger != log_triggers_.end() ? trigger->second : info->default_trigger);
+		}
+	}
+	std::vector<std::string> commands;
+	{
+		boost::lock_guard<boost::mutex> lock(supervisor_mutex_);
+		for (std::map<std::string, std::string>::const_iterator it = restore_commands_.begin();
+				it != restore_commands_.end(); ++it)
+			commands.push_back(it->second);
+	}
+
+	// the port may still be open if the receiver only went quiet
+	ClosePort(false);
+
+	// a USB serial adapter takes a moment to come back, so start retrying
+	// quickly.  After a few attempts search the baud rates too, in case the
+	// receiver restarted at its default rate.
+	uint32_t delay_ms = 10;
+	for (int attempt=0; ; attempt++) {
+		{
+			boost::unique_lock<boost::mutex> lock(supervisor_mutex_);
+			if (!supervising_)
+				return false;
+		}
+		SetConnectionState(RECONNECTING);
+		if (FindReceiver(port, baudrate, attempt >= 3))
+			break;
+		boost::unique_lock<boost::mutex> lock(supervisor_mutex_);
+		if (supervising_)
+			supervisor_condition_.timed_wait(lock, boost::posix_time::milliseconds(delay_ms));
+		delay_ms = std::min<uint32_t>(delay_ms*2, 500);
+	}
+
+	// logs already running as before are not sent again
+	std::vector<boost::shared_future<CommandResult> > results;
+	for (size_t ii=0; ii<commands.size(); ii++)
+		results.push_back(boost::shared_future<CommandResult>(SendCommandAsync(commands[ii], ResponseTimeout())));
+	if (!logs.empty())
+		ConfigureLogs(logs);
+	// only logs subscribed to while disconnected are still missing
+	if (auto_logging_)
+		RequestSubscribedLogs();
+	for (size_t ii=0; ii<results.size(); ii++) {
+		if (!results[ii].timed_wait_until(boost::get_system_time() + boost::posix_time::milliseconds(ResponseTimeout())))
+			ExpireCommands();
+		if (results[ii].get().status != COMMAND_OK)
+			log_error_("Failed to restore `" + commands[ii] + "`: " + results[ii].get().message);
+	}
+	is_connected_ = true;
+	SetConnectionState(CONNECTED);
+
+	reconnect_count_.fetch_add(1, boost::memory_order_relaxed);
+	std::stringstream output;
+	output << "Reconnected to receiver in " << (boost::get_system_time()-start).total_milliseconds() << " ms.";
+	log_info_(output.str());
+	return true;
+}
+
+void Novatel::PortLost(const std::string &reason) {
+	log_error_(reason);
+	reading_status_ = false;
+	is_connected_ = false;
+	gap_start_ = read_timestamp_;
+	gap_pending_ = true;
+	boost::lock_guard<boost::mutex> lock(supervisor_mutex_);
+	port_lost_ = true;
+	supervisor_condition_.notify_all();
+}
+
+uint32_t Novatel::SilenceTimeout() {
+	// the shortest ONTIME period among the logs requested
+	double period = 0;
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		for (std::map<uint16_t, std::string>::const_iterator it = log_triggers_.begin();
+				it != log_triggers_.end(); ++it) {
+			std::vector<std::string> tokens;
+			Tokenize(it->second, tokens, " ");
+			if (!requested_logs_[it->first] || (tokens.size() < 2) || (tokens[0] != "ONTIME"))
+				continue;
+			double log_period = atof(tokens[1].c_str());
+			if ((log_period > 0) && ((period == 0) || (log_period < period)))
+				period = log_period;
+		}
+	}
+	if (period == 0)
+		return 0;
+	// a read can return up to 50 ms late
+	return std::max<uint32_t>(250, uint32_t(3000*period) + 50);
+}
+
+void Novatel::NotifyGap(double resumed_timestamp) {
+	const SubscriberMap &subscribers = dispatch_subscribers_->subscribers;
+	for (SubscriberMap::const_iterator it = subscribers.begin(); it != subscribers.end(); ++it) {
+		for (size_t ii=0; ii<it->second.size(); ii++)
+			it->second[ii]->Gap(gap_start_, resumed_timestamp);
+	}
+}
+
+bool Novatel::Ping(int num_attempts) {
+
+	while ((num_attempts--)>0) {
+        std::stringstream output;
+        output << "Searching for Novatel receiver..." << std::endl;
+        log_info_(output.str());
+		if (UpdateVersion()) {
+            std::stringstream output;
+            output << "Found Novatel receiver." << std::endl;
+            output << "\tModel: " << model_ << std::endl;
+            output << "\tSerial Number: " << serial_number_ << std::endl;
+            output << "\tHardware version: " << hardware_version_ << std::endl;
+            output << "\tSoftware version: " << software_version_ << std::endl << std::endl;;
+            output << "Receiver capabilities:" << std::endl;
+            output << "\tL2: ";
+			if (l2_capable_)
+                output << "+" << std::endl;
+			else
+                output << "-" << std::endl;
+            output << "\tRaw measurements: ";
+			if (raw_capable_)
+                output << "+" << std::endl;
+			else
+                output << "-" << std::endl;
+            output << "\tRTK: ";
+			if (rtk_capable_)
+                output << "+" << std::endl;
+			else
+                output << "-" << std::endl;
+            output << "\tSPAN: ";
+			if (span_capable_)
+                output << "+" << std::endl;
+			else
+                output << "-" << std::endl;
+            output << "\tGLONASS: ";
+			if (glonass_capable_)
+                output << "+" << std::endl;
+			else
+                output << "-" << std::endl;
+            log_info_(output.str());
+            return true;
+		}
+	}
+
+	// no response found
+	return false;
+
+}
+
+bool Novatel::SendCommand(std::string cmd_msg, uint32_t timeout_ms) {
+	boost::unique_future<CommandResult> future = SendCommandAsync(cmd_msg, timeout_ms);
+	return WaitForCommand(future, cmd_msg, timeout_ms);
+}
+
+bool Novatel::SendTypedCommand(const std::string &command, BINARY_COMMAND_ID command_id,
+                               const void *body, size_t body_length, uint32_t timeout_ms) {
+	std::string binary_message;
+	if (binary_commands_)
+		binary_message = EncodeCommand(command_id, body, body_length);
+	boost::unique_future<CommandResult> future =
+		SendCommandAsync_(command, binary_message, timeout_ms, CommandCallback());
+	return WaitForCommand(future, command, timeout_ms);
+}
+
+bool Novatel::WaitForCommand(boost::unique_future<CommandResult> &future,
+                             const std::string &command, uint32_t timeout_ms) {
+	// expire the command here in case the read thread is not running
+	if (!future.timed_wait_until(boost::get_system_time() + boost::posix_time::milliseconds(timeout_ms)))
+		ExpireCommands();
+	CommandResult result = future.get();
+	switch (result.status) {
+		case COMMAND_OK:
+			log_info_("Command `" + command + "` sent to GPS receiver.");
+			return true;
+		case COMMAND_ERROR:
+			log_error_("Command '" + command + "' rejected by receiver: " + result.message);
+			return false;
+		default:
+			log_error_("Command '" + command + "' failed: " + result.message);
+			return false;
+	}
+}
+
+boost::unique_future<CommandResult> Novatel::SendCommandAsync(const std::string &command,
+	uint32_t timeout_ms, CommandCallback callback) {
+	return SendCommandAsync_(command, std::string(), timeout_ms, callback);
+}
+
+boost::unique_future<CommandResult> Novatel::SendBinaryCommandAsync(const std::string &description,
+	const std::string &message, uint32_t timeout_ms, CommandCallback callback) {
+	return SendCommandAsync_(description, message, timeout_ms, callback);
+}
+
+boost::unique_future<CommandResult> Novatel::SendCommandAsync_(const std::string &command,
+	const std::string &binary_message, uint32_t timeout_ms, CommandCallback callback) {
+	PendingCommand pending;
+	pending.command = command;
+	pending.deadline = boost::get_system_time() + boost::posix_time::milliseconds(timeout_ms);
+	pending.promise.reset(new boost::promise<CommandResult>());
+	pending.callback = callback;
+	boost::unique_future<CommandResult> future = pending.promise->get_future();
+
+	try {
+		if (!SerialPort())
+			throw std::runtime_error("not connected");
+		if (binary_message.empty())
+			WriteCommand(command, &pending);
+		else
+			WriteBinaryCommand(binary_message, &pending);
+	} catch (std::exception &e) {
+		CompleteCommand(pending, COMMAND_WRITE_FAILED, e.what());
+	}
+	return boost::move(future);
+}
+
+bool Novatel::SetSvElevationAngleCutoff(float angle) {
+    try {
+        std::stringstream ang_cmd;
+        ang_cmd << "ECUTOFF " << angle;
+        ElevationCutoffCommand cutoff;
+        cutoff.angle = angle;
+        return SendTypedCommand(ang_cmd.str(), ECUTOFF_CMD_ID, cutoff);
+    } catch (std::exception &e) {
+        std::stringstream output;
+        output << "Error in Novatel::SetSvElevationCutoff(): " << e.what();
+        log_error_(output.str());
+        return false;
+    }
+}
+
+void Novatel::PDPFilterDisable() {
+    try{
+    std::stringstream pdp_cmd;
+    pdp_cmd << "PDPFILTER DISABLE";
+    SingleValueCommand pdp_switch;
+    pdp_switch.value = DISABLE;
+    bool result = SendTypedCommand(pdp_cmd.str(), PDPFILTER_CMD_ID, pdp_switch);
+    } catch (std::exception &e) {
+        std::stringstream output;
+        output << "Error in Novatel::PDPFilterDisable(): " << e.what();
+        log_error_(output.str());
+    }
+}
+
+void Novatel::PDPFilterEnable() {
+    try{
+    std::stringstream pdp_cmd;
+    pdp_cmd << "PDPFILTER ENABLE";
+    SingleValueCommand pdp_switch;
+    pdp_switch.value = ENABLE;
+    bool result = SendTypedCommand(pdp_cmd.str(), PDPFILTER_CMD_ID, pdp_switch);
+    } catch (std::exception &e) {
+        std::stringstream output;
+        output << "Error in Novatel::PDPFilterEnable(): " << e.what();
+        log_error_(output.str());
+    }
+}
+
+void Novatel::PDPFilterReset() {
+    try{
+    std::stringstream pdp_cmd;
+    pdp_cmd << "PDPFILTER RESET";
+    SingleValueCommand pdp_switch;
+    pdp_switch.value = RESET;
+    bool result = SendTypedCommand(pdp_cmd.str(), PDPFILTER_CMD_ID, pdp_switch);
+    } catch (std::exception &e) {
+        std::stringstream output;
         output << "Error in Novatel::PDPFilterReset(): " << e.what();
         log_error_(output.str());
     }
@@ -412,7 +1488,10 @@ void Novatel::PDPModeConfigure(PDPMode mode, PDPDynamics dynamics) {
             return;
         }
 
-        bool result = SendCommand(pdp_cmd.str());
+        PdpModeCommand pdp_mode;
+        pdp_mode.mode = mode;
+        pdp_mode.dynamics = dynamics;
+        bool result = SendTypedCommand(pdp_cmd.str(), PDPMODE_CMD_ID, pdp_mode);
     } catch (std::exception &e) {
         std::stringstream output;
         output << "Error in Novatel::PDPModeConfigure(): " << e.what();
@@ -425,7 +1504,9 @@ void Novatel::SetPositionTimeout(uint32_t seconds){
         if(0<=seconds<=86400) {
             std::stringstream pdp_cmd;
             pdp_cmd << "POSTIMEOUT " << seconds;
-            bool result = SendCommand(pdp_cmd.str());
+            SingleValueCommand timeout;
+            timeout.value = seconds;
+            bool result = SendTypedCommand(pdp_cmd.str(), POSTIMEOUT_CMD_ID, timeout);
         } else
             log_error_("Seconds is not a valid value!");
     } catch (std::exception &e) {
@@ -438,14 +1519,21 @@ void Novatel::SetPositionTimeout(uint32_t seconds){
 bool Novatel::SetInitialPosition(double latitude, double longitude, double height) {
     std::stringstream pos_cmd;
     pos_cmd << "SETAPPROXPOS " << latitude << " " << longitude << " " << height;
-    return SendCommand(pos_cmd.str());
+    ApproximatePositionCommand position;
+    position.latitude = latitude;
+    position.longitude = longitude;
+    position.height = height;
+    return SendTypedCommand(pos_cmd.str(), SETAPPROXPOS_CMD_ID, position);
 
 }
 
 bool Novatel::SetInitialTime(uint32_t gps_week, double gps_seconds) {
     std::stringstream time_cmd;
     time_cmd << "SETAPPROXTIME " << gps_week << " " << gps_seconds;
-    return SendCommand(time_cmd.str());
+    ApproximateTimeCommand time;
+    time.gps_week = gps_week;
+    time.gps_seconds = gps_seconds;
+    return SendTypedCommand(time_cmd.str(), SETAPPROXTIME_CMD_ID, time);
 }
 
 bool Novatel::SetCarrierSmoothing(uint32_t l1_time_constant, uint32_t l2_time_constant) {
@@ -460,7 +1548,10 @@ bool Novatel::SetCarrierSmoothing(uint32_t l1_time_constant, uint32_t l2_time_co
         } else {
             smooth_cmd << "CSMOOTH " << l1_time_constant << " " << l2_time_constant;
         }
-        return SendCommand(smooth_cmd.str());
+        CarrierSmoothingCommand smoothing;
+        smoothing.l1_time_constant = l1_time_constant;
+        smoothing.l2_time_constant = l2_time_constant;
+        return SendTypedCommand(smooth_cmd.str(), CSMOOTH_CMD_ID, smoothing);
     } catch (std::exception &e) {
         std::stringstream output;
         output << "Error in Novatel::SetCarrierSmoothing(): " << e.what();
@@ -473,8 +1564,10 @@ bool Novatel::HardwareReset(uint8_t rst_delay) {
     // Resets receiver to cold start, does NOT clear non-volatile memory!
     try {
         std::stringstream rst_cmd;
-        rst_cmd << "RESET " << rst_delay;
-        return SendCommand(rst_cmd.str());
+        rst_cmd << "RESET " << (int) rst_delay;
+        SingleValueCommand reset;
+        reset.value = rst_delay;
+        return SendTypedCommand(rst_cmd.str(), RESET_CMD_ID, reset);
     } catch (std::exception &e) {
         std::stringstream output;
         output << "Error in Novatel::HardwareReset(): " << e.what();
@@ -487,7 +1580,9 @@ bool Novatel::HotStartReset() {
     try {
         std::stringstream rst_cmd;
         rst_cmd << "FRESET " << LAST_POSITION;
-        return SendCommand(rst_cmd.str());
+        SingleValueCommand target;
+        target.value = LAST_POSITION;
+        return SendTypedCommand(rst_cmd.str(), FRESET_CMD_ID, target);
     } catch (std::exception &e) {
         std::stringstream output;
         output << "Error in Novatel::HotStartReset(): " << e.what();
@@ -500,10 +1595,13 @@ bool Novatel::WarmStartReset() {
     try {
         std::stringstream rst_pos_cmd;
         std::stringstream rst_time_cmd;
+        SingleValueCommand target;
         rst_pos_cmd << "FRESET " << LAST_POSITION;
-        bool pos_reset = SendCommand(rst_pos_cmd.str());
+        target.value = LAST_POSITION;
+        bool pos_reset = SendTypedCommand(rst_pos_cmd.str(), FRESET_CMD_ID, target);
         rst_time_cmd << "FRESET " << LBAND_TCXO_OFFSET ;
-        bool time_reset = SendCommand(rst_time_cmd.str());
+        target.value = LBAND_TCXO_OFFSET;
+        bool time_reset = SendTypedCommand(rst_time_cmd.str(), FRESET_CMD_ID, target);
         return (pos_reset && time_reset);
     } catch (std::exception &e) {
         std::stringstream output;
@@ -517,7 +1615,9 @@ bool Novatel::ColdStartReset() {
     try {
         std::stringstream rst_cmd;
         rst_cmd << "FRESET " << STANDARD;
-        return SendCommand(rst_cmd.str());
+        SingleValueCommand target;
+        target.value = STANDARD;
+        return SendTypedCommand(rst_cmd.str(), FRESET_CMD_ID, target);
     } catch (std::exception &e) {
         std::stringstream output;
         output << "Error in Novatel::ColdStartReset(): " << e.what();
@@ -528,9 +1628,11 @@ bool Novatel::ColdStartReset() {
 
 void Novatel::SaveConfiguration() {
     try {
-        bool result = SendCommand("SAVECONFIG");
-        if(result)
+        bool result = SendTypedCommand("SAVECONFIG", SAVECONFIG_CMD_ID, NULL, 0);
+        if(result) {
             log_info_("Receiver configuration has been saved.");
+            UpdateReceiverCache(true);
+        }
         else
             log_error_("Failed to save receiver configuration!");
     } catch (std::exception &e) {
@@ -540,49 +1642,188 @@ void Novatel::SaveConfiguration() {
     }
 }
 
-void Novatel::ConfigureLogs(std::string log_string) {
+bool Novatel::ConfigureLogs(std::string log_string) {
 	// parse log_string on semicolons (;)
 	std::vector<std::string> logs;
 
 	Tokenize(log_string, logs, ";");
+	if (!CheckBandwidth(&logs, true))
+		return false;
 
-	// request each log from the receiver and wait for an ack
-	for (std::vector<std::string>::iterator it = logs.begin() ; it != logs.end(); ++it)
+	// logs the receiver is already sending as asked are left alone
 	{
-		// try each command up to five times
-		int ii=0;
-		while (ii<5) {
-			try {
-				// send log command to gps (e.g. "LOG BESTUTMB ONTIME 1.0")
-				serial_port_->write("LOG " + *it + "\r\n");
-				std::stringstream cmd;
-				cmd << "LOG " << *it << "\r\n";
-				log_info_(cmd.str());
-				// wait for acknowledgement (or 2 seconds)
-				boost::mutex::scoped_lock lock(ack_mutex_);
-				boost::system_time const timeout=boost::get_system_time()+ boost::posix_time::milliseconds(2000);
-				if (ack_condition_.timed_wait(lock,timeout)) {
-					log_info_("Ack received for requested log: " + *it);
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		std::vector<std::string> changed;
+		for (size_t ii=0; ii<logs.size(); ii++) {
+			if (IsLogRequested(logs[ii]))
+				log_info_("Log already configured: " + logs[ii]);
+			else
+				changed.push_back(logs[ii]);
+		}
+		logs.swap(changed);
+	}
+
+	// request all logs at once, then collect the responses.  Logs without
+	// a response are sent again, up to five times in total.
+	bool all_acknowledged = true;
+	for (int attempt=0; (attempt<5) && !logs.empty(); attempt++) {
+		std::vector<boost::shared_future<CommandResult> > results;
+		for (size_t ii=0; ii<logs.size(); ii++) {
+			// send log command to gps (e.g. "LOG BESTUTMB ONTIME 1.0")
+			results.push_back(boost::shared_future<CommandResult>(
+				SendCommandAsync("LOG " + logs[ii], 2000)));
+			log_info_("LOG " + logs[ii]);
+		}
+
+		std::vector<std::string> unacknowledged;
+		for (size_t ii=0; ii<logs.size(); ii++) {
+			// expire the commands here in case the read thread is not running
+			if (!results[ii].timed_wait_until(boost::get_system_time() + boost::posix_time::milliseconds(2000)))
+				ExpireCommands();
+			const CommandResult &result = results[ii].get();
+			switch (result.status) {
+				case COMMAND_OK: {
+					log_info_("Ack received for requested log: " + logs[ii]);
+					boost::lock_guard<boost::mutex> registry_lock(subscribers_mutex_);
+					RecordLogRequest(logs[ii]);
 					break;
-				} else {
-					log_error_("No acknowledgement received for log: " + *it);
 				}
-			} catch (std::exception &e) {
-				std::stringstream output;
-		        output << "Error configuring receiver logs: " << e.what();
-		        log_error_(output.str());
+				case COMMAND_ERROR:
+					log_error_("Receiver rejected log `" + logs[ii] + "`: " + result.message);
+					all_acknowledged = false;
+					break;
+				case COMMAND_TIMEOUT:
+					log_error_("No acknowledgement received for log: " + logs[ii]);
+					unacknowledged.push_back(logs[ii]);
+					break;
+				default:
+					log_error_("Error configuring receiver logs: " + result.message);
+					return false;
 			}
 		}
+		logs.swap(unacknowledged);
+	}
+	UpdateReceiverCache(false);
+
+	return all_acknowledged && logs.empty();
+}
+
+bool Novatel::SetLogConfiguration(std::string log_string) {
+	std::vector<LogListEntry> running;
+	if (!ReadLogList(&running)) {
+		log_warning_("No LOGLIST from the receiver; requesting every log.");
+		return ConfigureLogs(log_string);
+	}
+
+	// logs given with a port or under a name the driver does not know are
+	// always sent
+	std::vector<std::string> logs;
+	Tokenize(log_string, logs, ";");
+	if (!CheckBandwidth(&logs, false))
+		return false;
+	std::set<uint16_t> desired;
+	std::vector<std::string> changes;
+	LogIdSet wanted;
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		// tables are only freed under this lock, so copy what is needed
+		wanted = subscribers_.load()->wanted;
+		for (size_t ii=0; ii<logs.size(); ii++) {
+			std::vector<std::string> tokens;
+			Tokenize(logs[ii], tokens, " ");
+			BINARY_LOG_TYPE log_type;
+			if (!tokens.empty() && BinaryLogTypeFromName(tokens[0], &log_type))
+				desired.insert(log_type);
+			if (!IsLogRequested(logs[ii]))
+				changes.push_back("LOG " + logs[ii]);
+		}
+	}
+
+	// everything else running on this port is stopped, unless subscribed to
+	std::vector<std::string> unlog_messages;
+	for (size_t ii=0; ii<running.size(); ii++) {
+		bool binary = (running[ii].message_type & 0x60) == 0;
+		uint16_t log_id = running[ii].message_id;
+		if (binary && (desired.count(log_id) || ((log_id < MAX_LOG_ID) && wanted[log_id])))
+			continue;
+		const BinaryLogInfo *info = FindBinaryLog(BINARY_LOG_TYPE(log_id));
+		std::stringstream description;
+		description << "UNLOG ";
+		if (info != NULL)
+			description << info->name;
+		else
+			description << log_id;
+		description << (binary ? "" : " (ASCII)");
+		changes.push_back(description.str());
+		unlog_messages.push_back(EncodeUnlogCommand(BINARY_LOG_TYPE(log_id), running[ii].message_type));
+	}
 
+	if (changes.empty()) {
+		log_info_("Receiver logs already match the configuration.");
+		return true;
+	}
+
+	// LOG commands first, then UNLOGs, all written back to back
+	std::vector<boost::shared_future<CommandResult> > results;
+	size_t log_count = changes.size() - unlog_messages.size();
+	for (size_t ii=0; ii<changes.size(); ii++) {
+		log_info_(changes[ii]);
+		if (ii < log_count)
+			results.push_back(boost::shared_future<CommandResult>(SendCommandAsync(changes[ii], 2000)));
+		else
+			results.push_back(boost::shared_future<CommandResult>(
+				SendBinaryCommandAsync(changes[ii], unlog_messages[ii-log_count], 2000)));
 	}
 
+	bool all_acknowledged = true;
+	for (size_t ii=0; ii<changes.size(); ii++) {
+		if (!results[ii].timed_wait_until(boost::get_system_time() + boost::posix_time::milliseconds(2000)))
+			ExpireCommands();
+		const CommandResult &result = results[ii].get();
+		if (result.status != COMMAND_OK) {
+			log_error_("Failed to change receiver logs with `" + changes[ii] + "`: " + result.message);
+			all_acknowledged = false;
+			continue;
+		}
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		if (ii < log_count) {
+			RecordLogRequest(changes[ii].substr(4));
+		} else {
+			const LogListEntry &entry = running[ii-log_count];
+			if (((entry.message_type & 0x60) == 0) && (entry.message_id < MAX_LOG_ID))
+				requested_logs_.reset(entry.message_id);
+		}
+	}
+	UpdateReceiverCache(false);
+	return all_acknowledged;
 }
 
 void Novatel::Unlog(std::string log) {
     try {
         std::stringstream unlog_cmd;
         unlog_cmd << "UNLOG " << log;
-        bool result = SendCommand(unlog_cmd.str());
+        std::vector<std::string> tokens;
+        Tokenize(log, tokens, " ");
+        BINARY_LOG_TYPE log_type;
+        bool result;
+        // only a bare binary log name can be sent as a binary command
+        if ((tokens.size() == 1) && BinaryLogTypeFromName(tokens[0], &log_type)) {
+            UnlogCommand unlog;
+            unlog.port = THISPORT_ADDRESS;
+            unlog.message_id = log_type;
+            unlog.message_type = 0;
+            unlog.reserved = 0;
+            result = SendTypedCommand(unlog_cmd.str(), UNLOG_CMD_ID, unlog);
+        } else {
+            result = SendCommand(unlog_cmd.str());
+        }
+        if (result) {
+            boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+            for (size_t ii=0; ii<tokens.size(); ii++) {
+                if (BinaryLogTypeFromName(tokens[ii], &log_type) && (log_type < MAX_LOG_ID))
+                    requested_logs_.reset(log_type);
+            }
+        }
     } catch (std::exception &e) {
         std::stringstream output;
         output << "Error in Novatel::Unlog(): " << e.what();
@@ -592,7 +1833,14 @@ void Novatel::Unlog(std::string log) {
 
 void Novatel::UnlogAll() {
     try {
-        bool result = SendCommand("UNLOGALL");
+        UnlogAllCommand unlog_all;
+        unlog_all.port = ALL_PORTS;
+        unlog_all.held = 0;
+        bool result = SendTypedCommand("UNLOGALL", UNLOGALL_CMD_ID, unlog_all);
+        if (result) {
+            boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+            requested_logs_.reset();
+        }
     } catch (std::exception &e) {
         std::stringstream output;
         output << "Error in Novatel::UnlogAll(): " << e.what();
@@ -606,11 +1854,10 @@ void Novatel::ConfigureInterfaceMode(std::string com_port,
 	try {
 		// send command to set interface mode on com port
 		// ex: INTERFACEMODE COM2 RX_MODE TX_MODE
-		serial_port_->write("INTERFACEMODE " + com_port + " " + rx_mode + " " + tx_mode + "\r\n");
-		// wait for acknowledgement (or 2 seconds)
-		boost::mutex::scoped_lock lock(ack_mutex_);
-		boost::system_time const timeout=boost::get_system_time()+ boost::posix_time::milliseconds(2000);
-		if (ack_condition_.timed_wait(lock,timeout)) {
+		std::string command = "INTERFACEMODE " + com_port + " " + rx_mode + " " + tx_mode;
+		if (SendCommand(command)) {
+			boost::lock_guard<boost::mutex> lock(supervisor_mutex_);
+			restore_commands_["INTERFACEMODE " + com_port] = command;
 			log_info_("Ack received.  Interface mode for port " + 
 				com_port + " set to: " + rx_mode + " " + tx_mode);
 		} else {
@@ -628,12 +1875,12 @@ void Novatel::ConfigureBaudRate(std::string com_port, int baudrate) {
 		// send command to set baud rate on GPS com port
 		// ex: COM com1 9600 n 8 1 n off on
 		std::stringstream cmd;
-		cmd << "COM " << com_port << " " << baudrate << " n 8 1 n off on\r\n";
-		serial_port_->write(cmd.str());
-		// wait for acknowledgement (or 2 seconds)
-		boost::mutex::scoped_lock lock(ack_mutex_);
-		boost::system_time const timeout=boost::get_system_time()+ boost::posix_time::milliseconds(2000);
-		if (ack_condition_.timed_wait(lock,timeout)) {
+		cmd << "COM " << com_port << " " << baudrate << " n 8 1 n off on";
+		if (SendCommand(cmd.str())) {
+			{
+				boost::lock_guard<boost::mutex> lock(supervisor_mutex_);
+				restore_commands_["COM " + com_port] = cmd.str();
+			}
 			std::stringstream log_out;
 			log_out << "Ack received.  Baud rate on com port " <<
 				com_port << " set to " << baudrate << std::endl;
@@ -648,6 +1895,58 @@ void Novatel::ConfigureBaudRate(std::string com_port, int baudrate) {
 	}
 }
 
+int Novatel::SufficientBaudRate(double bytes_per_second, double max_utilization, int max_baudrate) {
+	for (size_t ii=0; ii<sizeof(SUPPORTED_BAUD_RATES)/sizeof(SUPPORTED_BAUD_RATES[0]); ii++) {
+		if (SUPPORTED_BAUD_RATES[ii] > max_baudrate)
+			break;
+		if (bytes_per_second <= max_utilization*SUPPORTED_BAUD_RATES[ii]/10.0)
+			return SUPPORTED_BAUD_RATES[ii];
+	}
+	return 0;
+}
+
+bool Novatel::SetBaudRate(int baudrate, std::string com_port) {
+	if (!is_connected_ || port_.empty()) {
+		log_error_("Cannot change baud rate: not connected.");
+		return false;
+	}
+	int old_baudrate = baud_rate_;
+	if (baudrate == old_baudrate)
+		return true;
+	std::string port = port_;
+	// logs requested while reconnecting must not change the rate again
+	changing_baud_rate_ = true;
+
+	std::stringstream cmd;
+	cmd << "COM " << com_port << " " << baudrate << " n 8 1 n off on";
+	std::stringstream baud_msg;
+	baud_msg << "Changing baud rate from " << old_baudrate << " to " << baudrate;
+	log_info_(baud_msg.str());
+	// as in Connect(), the receiver answers at the new rate, so don't wait
+	// for it; closing the port lets the writer finish writing the command.
+	// The receiver's logs keep running and are read back when connecting.
+	WriteCommand(cmd.str(), NULL);
+	ClosePort(false);
+	boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+	bool changed = Connect(port, baudrate, false);
+	if (changed) {
+		// the rate is kept through reconnects by baud_rate_, not by replaying this
+		boost::lock_guard<boost::mutex> lock(supervisor_mutex_);
+		restore_commands_.erase("COM " + com_port);
+	} else {
+		// the receiver ignored the command, or the host port cannot run at
+		// the new rate; searching finds the receiver either way and sets it
+		// back to the old rate
+		std::stringstream output;
+		output << "Receiver did not answer at " << baudrate << " baud; returning to " << old_baudrate << ".";
+		log_warning_(output.str());
+		if (!Connect(port, old_baudrate, true))
+			log_error_("Lost the receiver changing baud rate.");
+	}
+	changing_baud_rate_ = false;
+	return changed;
+}
+
 bool Novatel::UpdateVersion()
 {
 	// request the receiver version and wait for a response
@@ -656,42 +1955,32 @@ bool Novatel::UpdateVersion()
 	//    1,GPSCARD,"L12RV","DZZ06040010","OEMV2G-2.00-2T","3.000A19","3.000A9",
 	//    "2006/Feb/ 9","17:14:33"*5e8df6e0
 
+	// the binary log is picked out of the data stream by the read thread
+	// as soon as it arrives
+	if (!reading_status_) {
+		log_error_("Cannot request version information: not connected.");
+		return false;
+	}
+	uint32_t timeout_ms = ResponseTimeout();
+	boost::unique_future<Version> version = Query<Version>(VERSIONB_LOG_TYPE, timeout_ms);
+	// expire the query here in case the read thread has stopped
+	if (!version.timed_wait_until(boost::get_system_time() + boost::posix_time::milliseconds(timeout_ms)))
+		ExpireQueries();
 	try {
-		// clear port
-		serial_port_->flush();
-		// read out any data currently in the buffer
-		std::string read_data = serial_port_->read(5000);
-		while (read_data.length())
-			read_data = serial_port_->read(5000);
-
-		// send request for version
-		serial_port_->write("log versiona once\r\n");
-		// wait for response from the receiver
-		boost::this_thread::sleep(boost::posix_time::milliseconds(500));
-		// read from the serial port until a new line character is seen
-		std::string gps_response = serial_port_->read(15000);
-
-		std::vector<std::string> packets;
-
-		Tokenize(gps_response, packets, "\n");
-
-		// loop through all packets in file and check for version messages
-		// stop when the first is found or all packets are read
-		for (size_t ii=0; ii<packets.size(); ii++) {
-			if (ParseVersion(packets[ii])) {
-				return true;
-			}
-		} 
+		return ParseVersion(version.get());
 	} catch (std::exception &e) {
-        std::stringstream output;
-        output << "Error reading version info from receiver: " << e.what();
-        log_error_(output.str());
-        return false;
-    }
-
-
-	return false;
+		std::stringstream output;
+		output << "Error reading version info from receiver: " << e.what();
+		log_error_(output.str());
+		return false;
+	}
+}
 
+//! Removes the quotes around a string field of an ASCII log
+static std::string Unquote(const std::string &field) {
+	if ((field.length() >= 2) && (field[0] == '"') && (field[field.length()-1] == '"'))
+		return field.substr(1, field.length()-2);
+	return field;
 }
 
 bool Novatel::ParseVersion(std::string packet) {
@@ -744,17 +2033,46 @@ bool Novatel::ParseVersion(std::string packet) {
 		// device type is 2nd token
 		string device_type=*(++current_token);
 		// model is 3rd token
-		model_=*(++current_token);
+		string model=*(++current_token);
 		// serial number is 4th token
-		serial_number_=*(++current_token);
+		string serial_number=*(++current_token);
 		// model is 5rd token
-		hardware_version_=*(++current_token);
+		string hardware_version=*(++current_token);
 		// model is 6rd token
-		software_version_=*(++current_token);
+		string software_version=*(++current_token);
+
+		SetVersion(Unquote(model), Unquote(serial_number), Unquote(hardware_version),
+		           Unquote(software_version));
+		return true;
+}
+
+//! Copies a string field of a binary log, which need not be null terminated
+static std::string FixedString(const char *field, size_t size) {
+	return std::string(field, strnlen(field, size));
+}
+
+bool Novatel::ParseVersion(const Version &version) {
+	if (version.number_of_components < 1) {
+		log_error_("Error parsing received version. No components listed.");
+		return false;
+	}
+	SetVersion(FixedString(version.model, sizeof(version.model)),
+	           FixedString(version.serial_number, sizeof(version.serial_number)),
+	           FixedString(version.hardware_version, sizeof(version.hardware_version)),
+	           FixedString(version.software_version, sizeof(version.software_version)));
+	return true;
+}
+
+void Novatel::SetVersion(const std::string &model, const std::string &serial_number,
+                         const std::string &hardware_version, const std::string &software_version) {
+		model_=model;
+		serial_number_=serial_number;
+		hardware_version_=hardware_version;
+		software_version_=software_version;
 
 		// parse the version:
 		if (hardware_version_.length()>3)
-            protocol_version_=hardware_version_.substr(1,4);
+            protocol_version_=hardware_version_.substr(0,4);
 		else
 			protocol_version_="UNKNOWN";
 
@@ -796,9 +2114,346 @@ bool Novatel::ParseVersion(std::string packet) {
             l2_capable_=true;
             raw_capable_=true;
         }
+}
 
-		return true;
+uint64_t Novatel::WriteCommand(const std::string &command, const PendingCommand *pending) {
+	OutboundWrite write;
+	write.data = command + "\r\n";
+	write.queued = boost::get_system_time();
+	write.binary = false;
+	write.command_id = 0;
+	// queued under the lock so the sequence numbers follow the write order
+	boost::lock_guard<boost::mutex> lock(command_mutex_);
+	write.sequence = commands_sent_++;
+	PendingCommand &queued = pending_commands_[write.sequence];
+	if (pending != NULL) {
+		queued = *pending;
+	} else {
+		queued.command = command;
+		queued.deadline = write.queued + boost::posix_time::milliseconds(ResponseTimeout());
+	}
+	queued.sequence = write.sequence;
+	queued.queued = write.queued;
+	{
+		boost::lock_guard<boost::mutex> write_lock(write_mutex_);
+		write_queue_.push_back(write);
+	}
+	write_condition_.notify_one();
+	return write.sequence;
+}
+
+void Novatel::WriteBinaryCommand(const std::string &message, const PendingCommand *pending) {
+	OutboundWrite write;
+	write.data = message;
+	write.queued = boost::get_system_time();
+	write.binary = true;
+	write.command_id = uint8_t(message[4]) | (uint8_t(message[5]) << 8);
+	boost::lock_guard<boost::mutex> lock(command_mutex_);
+	write.sequence = binary_commands_sent_++;
+	// queue something even if nobody waits, so the response is not taken
+	// for the response to a later command with the same id
+	PendingCommand queued;
+	if (pending != NULL)
+		queued = *pending;
+	else
+		queued.deadline = write.queued + boost::posix_time::milliseconds(2000);
+	queued.sequence = write.sequence;
+	queued.queued = write.queued;
+	pending_binary_commands_[write.command_id].push_back(queued);
+	{
+		boost::lock_guard<boost::mutex> write_lock(write_mutex_);
+		write_queue_.push_back(write);
+	}
+	write_condition_.notify_one();
+}
+
+void Novatel::FailWrites(const std::vector<OutboundWrite> &writes, const std::string &error) {
+	std::vector<PendingCommand> failed;
+	{
+		boost::lock_guard<boost::mutex> lock(command_mutex_);
+		for (size_t ii=0; ii<writes.size(); ii++) {
+			const OutboundWrite &write = writes[ii];
+			if (!write.binary) {
+				// no response will come, so none may be matched to this command
+				if (write.sequence >= responses_received_)
+					unsent_commands_.insert(write.sequence);
+				std::map<uint64_t, PendingCommand>::iterator it = pending_commands_.find(write.sequence);
+				if (it != pending_commands_.end()) {
+					failed.push_back(it->second);
+					pending_commands_.erase(it);
+				}
+				continue;
+			}
+			std::map<uint16_t, std::deque<PendingCommand> >::iterator queue =
+				pending_binary_commands_.find(write.command_id);
+			if (queue == pending_binary_commands_.end())
+				continue;
+			for (std::deque<PendingCommand>::iterator it = queue->second.begin();
+			     it != queue->second.end(); ++it) {
+				if (it->sequence == write.sequence) {
+					failed.push_back(*it);
+					queue->second.erase(it);
+					break;
+				}
+			}
+			if (queue->second.empty())
+				pending_binary_commands_.erase(queue);
+		}
+	}
+	for (size_t ii=0; ii<failed.size(); ii++)
+		CompleteCommand(failed[ii], COMMAND_WRITE_FAILED, error);
+}
+
+bool Novatel::SendCorrections(const unsigned char *data, size_t length) {
+	{
+		boost::lock_guard<boost::mutex> lock(write_mutex_);
+		if (!writing_status_)
+			return false;
+		// as many bytes as the port can send in two seconds
+		size_t max_backlog = (baud_rate_ > 0) ? baud_rate_/5 : MAX_NOUT_SIZE;
+		if (correction_queue_.size() + length > max_backlog) {
+			writer_statistics_.corrections_dropped += length;
+			return false;
+		}
+		correction_queue_.append((const char*) data, length);
+	}
+	write_condition_.notify_one();
+	return true;
+}
+
+MetricsSnapshot Novatel::GetMetrics() {
+	MetricsSnapshot snapshot;
+	metrics_.Collect(&snapshot);
+	for (size_t ii=0; ii<MAX_LOG_ID; ii++) {
+		LogLatency *latency = log_latency_[ii].load(boost::memory_order_acquire);
+		if (latency == NULL)
+			continue;
+		LogLatencySummary &summary = snapshot.latencies[ii];
+		for (size_t jj=0; jj<LATENCY_STAGES; jj++)
+			summary.stages[jj] = latency->stages[jj].Summarize();
+	}
+	snapshot.connected = is_connected_;
+	{
+		boost::lock_guard<boost::mutex> lock(write_mutex_);
+		snapshot.write_queue_depth = write_queue_.size();
+		snapshot.correction_backlog = correction_queue_.size();
+	}
+	{
+		boost::lock_guard<boost::mutex> lock(command_mutex_);
+		snapshot.pending_commands = pending_commands_.size();
+		for (std::map<uint16_t, std::deque<PendingCommand> >::const_iterator it = pending_binary_commands_.begin();
+				it != pending_binary_commands_.end(); ++it)
+			snapshot.pending_commands += it->second.size();
+	}
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		snapshot.pending_queries = pending_queries_.size();
+	}
+	return snapshot;
+}
+
+bool Novatel::ServeMetrics(const std::string &path) {
+	std::string error;
+	if (!metrics_server_.Start(path, boost::bind(&Novatel::GetPrometheusMetrics, this), &error)) {
+		log_error_("Cannot serve metrics on " + path + ": " + error);
+		return false;
+	}
+	log_info_("Serving metrics on " + path);
+	return true;
+}
+
+bool Novatel::WriteTrace(const std::string &path) {
+	std::ofstream file(path.c_str());
+	file << GetTrace();
+	file.close();
+	if (!file) {
+		log_error_("Cannot write trace to " + path);
+		return false;
+	}
+	return true;
+}
+
+WriterStatistics Novatel::GetWriterStatistics() {
+	boost::lock_guard<boost::mutex> lock(write_mutex_);
+	WriterStatistics statistics = writer_statistics_;
+	statistics.queue_depth = write_queue_.size();
+	statistics.correction_backlog = correction_queue_.size();
+	return statistics;
+}
+
+void Novatel::CompleteCommand(const PendingCommand &pending, CommandStatus status,
+                              const std::string &message) {
+	CommandResult result;
+	result.status = status;
+	result.command = pending.command;
+	result.message = message;
+	metrics_.Add(SHARED_SHARD, METRIC_COMMANDS);
+	if (status == COMMAND_ERROR)
+		metrics_.Add(SHARED_SHARD, METRIC_COMMAND_ERRORS);
+	else if (status == COMMAND_TIMEOUT)
+		metrics_.Add(SHARED_SHARD, METRIC_COMMAND_TIMEOUTS);
+	if (((status == COMMAND_OK) || (status == COMMAND_ERROR)) && !pending.queued.is_not_a_date_time())
+		metrics_.AddRoundTrip((boost::get_system_time() - pending.queued).total_microseconds());
+	if (tracer_.IsTracing()) {
+		uint64_t now_ns = MonotonicNanoseconds();
+		tracer_.Record(SHARED_SHARD, TRACE_COMMAND_DONE, now_ns, now_ns, 0, status);
+	}
+	if (pending.callback)
+		pending.callback(result);
+	if (pending.promise)
+		pending.promise->set_value(result);
+}
+
+void Novatel::ExpireCommands() {
+	std::vector<PendingCommand> expired;
+	{
+		boost::lock_guard<boost::mutex> lock(command_mutex_);
+		if (pending_commands_.empty() && pending_binary_commands_.empty())
+			return;
+		boost::system_time now = boost::get_system_time();
+		std::map<uint64_t, PendingCommand>::iterator it = pending_commands_.begin();
+		while (it != pending_commands_.end()) {
+			if (it->second.deadline <= now) {
+				// its response is lost; match the next response to a later command
+				if (responses_received_ <= it->first)
+					responses_received_ = it->first + 1;
+				expired.push_back(it->second);
+				pending_commands_.erase(it++);
+			} else {
+				++it;
+			}
+		}
+		std::map<uint16_t, std::deque<PendingCommand> >::iterator binary =
+			pending_binary_commands_.begin();
+		while (binary != pending_binary_commands_.end()) {
+			std::deque<PendingCommand> &queue = binary->second;
+			for (size_t ii=0; ii<queue.size(); ) {
+				if (queue[ii].deadline <= now) {
+					expired.push_back(queue[ii]);
+					queue.erase(queue.begin()+ii);
+				} else {
+					ii++;
+				}
+			}
+			if (queue.empty())
+				pending_binary_commands_.erase(binary++);
+			else
+				++binary;
+		}
+	}
+	for (size_t ii=0; ii<expired.size(); ii++)
+		CompleteCommand(expired[ii], COMMAND_TIMEOUT, "no response from receiver");
+}
+
+void Novatel::AbandonCommands(const std::string &reason) {
+	std::vector<PendingCommand> abandoned;
+	{
+		boost::lock_guard<boost::mutex> lock(command_mutex_);
+		for (std::map<uint64_t, PendingCommand>::iterator it = pending_commands_.begin();
+				it != pending_commands_.end(); ++it)
+			abandoned.push_back(it->second);
+		for (std::map<uint16_t, std::deque<PendingCommand> >::iterator it = pending_binary_commands_.begin();
+				it != pending_binary_commands_.end(); ++it)
+			abandoned.insert(abandoned.end(), it->second.begin(), it->second.end());
+		pending_commands_.clear();
+		pending_binary_commands_.clear();
+		unsent_commands_.clear();
+		commands_sent_ = 0;
+		responses_received_ = 0;
+		binary_commands_sent_ = 0;
+	}
+	for (size_t ii=0; ii<abandoned.size(); ii++)
+		CompleteCommand(abandoned[ii], COMMAND_WRITE_FAILED, reason);
+}
+
+void Novatel::HandleResponse(const std::string &line) {
+	bool ok;
+	std::string message;
+	if (line.compare(0, 2, "OK") == 0) {
+		ok = true;
+	} else if (line.compare(0, 5, "ERROR") == 0) {
+		ok = false;
+		size_t start = line.find(':');
+		if (start != std::string::npos)
+			message = line.substr(start+1);
+	} else {
+		// abbreviated ASCII log rather than a response
+		return;
+	}
+
+	bool matched = false;
+	PendingCommand pending;
+	std::vector<PendingCommand> expired;
+	{
+		boost::lock_guard<boost::mutex> lock(command_mutex_);
+		// skip commands that never reached the receiver, and those whose
+		// response is overdue, since it was lost and this is for a later one
+		boost::system_time now = boost::get_system_time();
+		for (;;) {
+			std::map<uint64_t, PendingCommand>::iterator it = pending_commands_.find(responses_received_);
+			if (unsent_commands_.erase(responses_received_)) {
+				responses_received_++;
+			} else if ((it != pending_commands_.end()) && (it->second.deadline <= now)) {
+				expired.push_back(it->second);
+				pending_commands_.erase(it);
+				responses_received_++;
+			} else {
+				break;
+			}
+		}
+		unsent_commands_.erase(unsent_commands_.begin(),
+		                       unsent_commands_.lower_bound(responses_received_));
+		// ignore responses to commands not written through WriteCommand()
+		if (responses_received_ < commands_sent_) {
+			std::map<uint64_t, PendingCommand>::iterator it =
+				pending_commands_.find(responses_received_++);
+			if (it != pending_commands_.end()) {
+				pending = it->second;
+				pending_commands_.erase(it);
+				matched = true;
+			}
+		}
+	}
+
+	for (size_t ii=0; ii<expired.size(); ii++)
+		CompleteCommand(expired[ii], COMMAND_TIMEOUT, "no response from receiver");
+	if (ok)
+		handle_acknowledgement_();
+	if (matched)
+		CompleteCommand(pending, ok ? COMMAND_OK : COMMAND_ERROR, message);
+	else if (!ok)
+		log_warning_("Receiver responded with error: " + message);
+}
+
+void Novatel::HandleBinaryResponse(unsigned char *message, size_t length) {
+	BinaryResponse response;
+	if (!DecodeResponse(message, length, &response)) {
+		log_warning_("Discarded binary response with a bad CRC.");
+		return;
+	}
+	bool ok = (response.response_id == 1);
+
+	bool matched = false;
+	PendingCommand pending;
+	{
+		boost::lock_guard<boost::mutex> lock(command_mutex_);
+		std::map<uint16_t, std::deque<PendingCommand> >::iterator it =
+			pending_binary_commands_.find(response.command_id);
+		if (it != pending_binary_commands_.end()) {
+			pending = it->second.front();
+			it->second.pop_front();
+			if (it->second.empty())
+				pending_binary_commands_.erase(it);
+			matched = true;
+		}
+	}
 
+	if (ok)
+		handle_acknowledgement_();
+	if (matched && pending.promise)
+		CompleteCommand(pending, ok ? COMMAND_OK : COMMAND_ERROR, ok ? "" : response.message);
+	else if (!ok)
+		log_warning_("Receiver responded with error: " + response.message);
 }
 
 void Novatel::StartReading() {
@@ -812,98 +2467,268 @@ void Novatel::StartReading() {
 
 void Novatel::StopReading() {
 	reading_status_=false;
+	// reads time out every 50 ms, so the thread ends promptly
+	if (read_thread_ptr_ && (read_thread_ptr_->get_id() != boost::this_thread::get_id())) {
+		read_thread_ptr_->join();
+		read_thread_ptr_.reset();
+	}
+}
+
+//! Correction bytes written at once: what the port sends in 20 ms
+static size_t CorrectionChunkSize(int baud_rate) {
+	if (baud_rate <= 0)
+		return 1024;
+	return std::max<size_t>(baud_rate/10/50, 16);
+}
+
+void Novatel::StartWriting() {
+	boost::lock_guard<boost::mutex> lock(write_mutex_);
+	if (writing_status_)
+		return;
+	writing_status_ = true;
+	write_thread_ptr_ = boost::shared_ptr<boost::thread >
+		(new boost::thread(boost::bind(&Novatel::WriteSerialPort, this)));
+}
+
+void Novatel::StopWriting() {
+	{
+		boost::lock_guard<boost::mutex> lock(write_mutex_);
+		writing_status_ = false;
+	}
+	write_condition_.notify_all();
+	if (write_thread_ptr_) {
+		write_thread_ptr_->join();
+		write_thread_ptr_.reset();
+	}
+}
+
+void Novatel::WriteSerialPort() {
+	std::vector<OutboundWrite> batch;
+	std::string buffer;
+	// corrections are held back until the port has sent what was written before
+	boost::system_time next_correction = boost::get_system_time();
+	// the port outlives the thread, which is stopped before it is closed
+	boost::shared_ptr<serial::Serial> serial_port = SerialPort();
+	log_info_("Started write thread.");
+
+	boost::unique_lock<boost::mutex> lock(write_mutex_);
+	for (;;) {
+		bool corrections_due = writing_status_ && !correction_queue_.empty() &&
+			(boost::get_system_time() >= next_correction);
+		if (write_queue_.empty() && !corrections_due) {
+			// commands queued before stopping have been written
+			if (!writing_status_)
+				break;
+			if (correction_queue_.empty())
+				write_condition_.wait(lock);
+			else
+				write_condition_.timed_wait(lock, next_correction);
+			continue;
+		}
+
+		// coalesce every command waiting into one write, followed by a
+		// chunk of corrections if they are due
+		batch.assign(write_queue_.begin(), write_queue_.end());
+		write_queue_.clear();
+		buffer.clear();
+		for (size_t ii=0; ii<batch.size(); ii++)
+			buffer += batch[ii].data;
+		if (corrections_due) {
+			size_t chunk = std::min(correction_queue_.size(), CorrectionChunkSize(baud_rate_));
+			buffer.append(correction_queue_, 0, chunk);
+			correction_queue_.erase(0, chunk);
+		}
+		lock.unlock();
+
+		boost::system_time write_start = boost::get_system_time();
+		uint64_t write_start_ns = tracer_.IsTracing() ? MonotonicNanoseconds() : 0;
+		std::string error;
+		try {
+			if (!serial_port)
+				throw std::runtime_error("not connected");
+			serial_port->write(buffer);
+		} catch (std::exception &e) {
+			error = e.what();
+			if (error.empty())
+				error = "write failed";
+		}
+		boost::system_time write_end = boost::get_system_time();
+		if (write_start_ns > 0)
+			tracer_.Record(WRITER_SHARD, TRACE_WRITE, write_start_ns, MonotonicNanoseconds(),
+				uint16_t(batch.size()), uint32_t(buffer.size()));
+		if (!error.empty()) {
+			log_error_("Error writing to serial port: " + error);
+			FailWrites(batch, error);
+		}
+		if (baud_rate_ > 0)
+			next_correction = write_start + boost::posix_time::microseconds(
+				int64_t(buffer.size()*10*1000000.0/baud_rate_));
+
+		lock.lock();
+		writer_statistics_.writes++;
+		if (!error.empty()) {
+			writer_statistics_.write_errors++;
+			continue;
+		}
+		writer_statistics_.bytes_written += buffer.size();
+		metrics_.Add(WRITER_SHARD, METRIC_BYTES_WRITTEN, buffer.size());
+		for (size_t ii=0; ii<batch.size(); ii++) {
+			double latency = (write_end - batch[ii].queued).total_microseconds()/1000.0;
+			total_write_latency_ms_ += latency;
+			writer_statistics_.max_latency_ms = std::max(writer_statistics_.max_latency_ms, latency);
+			if (ii == 0)
+				writer_statistics_.last_latency_ms = latency;
+		}
+		writer_statistics_.commands_written += batch.size();
+		if (writer_statistics_.commands_written > 0)
+			writer_statistics_.mean_latency_ms =
+				total_write_latency_ms_/writer_statistics_.commands_written;
+	}
+
+	correction_queue_.clear();
 }
 
 void Novatel::ReadSerialPort() {
 	unsigned char buffer[MAX_NOUT_SIZE];
-	size_t len;
+	boost::system_time last_data = boost::get_system_time();
+	boost::shared_ptr<serial::Serial> serial_port = SerialPort();
 	log_info_("Started read thread.");
 
 	// continuously read data from serial port
 	while (reading_status_) {
+		size_t len = 0;
+		uint64_t read_start_ns = tracer_.IsTracing() ? MonotonicNanoseconds() : 0;
 		try {
 			// read data
-			len = serial_port_->read(buffer, MAX_NOUT_SIZE);
+			if (!serial_port)
+				throw std::runtime_error("not connected");
+			len = serial_port->read(buffer, MAX_NOUT_SIZE);
 		} catch (std::exception &e) {
 	        std::stringstream output;
 	        output << "Error reading from serial port: " << e.what();
-	        log_error_(output.str());
-	        //return;
+	        PortLost(output.str());
+	        break;
     	}
+
+		// a receiver sending ONTIME logs is never quiet for long
+		boost::system_time now = boost::get_system_time();
+		if (len > 0) {
+			last_data = now;
+		} else if ((now-last_data).total_milliseconds() >= 250) {
+			uint32_t silence_ms = SilenceTimeout();
+			if ((silence_ms > 0) && ((now-last_data).total_milliseconds() >= silence_ms)) {
+				std::stringstream output;
+				output << "No data from receiver for " << (now-last_data).total_milliseconds() << " ms.";
+				PortLost(output.str());
+				break;
+			}
+		}
+
 		// timestamp the read
 		if (time_handler_) 
 			read_timestamp_ = time_handler_();
 		else 
 			read_timestamp_ = 0;
+		// reads that time out are left out of the trace
+		if ((read_start_ns > 0) && (len > 0))
+			tracer_.Record(READER_SHARD, TRACE_READ, read_start_ns, MonotonicNanoseconds(), 0, uint32_t(len));
+		if (latency_tracking_ && (len > 0)) {
+			read_monotonic_us_ = MonotonicMicroseconds();
+			read_wall_time_ = WallClockSeconds();
+		} else {
+			read_monotonic_us_ = 0;
+		}
 
 		//std::cout << read_timestamp_ <<  "  bytes: " << len << std::endl;
 		// add data to the buffer to be parsed
+		if (len > 0)
+			bytes_received_.fetch_add(len, boost::memory_order_relaxed);
 		BufferIncomingData(buffer, len);
+		ExpireCommands();
+		ExpireQueries();
 	}
 
 }
 
 void Novatel::BufferIncomingData(unsigned char *message, unsigned int length)
 {
-	BINARY_LOG_TYPE message_id;
+	// pick up any subscription changes made since the last read.  The
+	// table stays valid until read_epoch_ moves on at the end of the read.
+	// Besides the table load, a read costs the two read_epoch_ increments
+	// that let PublishSubscribers() free old tables without a lock.
+	read_epoch_.fetch_add(1, boost::memory_order_seq_cst);
+	dispatch_subscribers_ = subscribers_.load(boost::memory_order_seq_cst);
+	if ((length > 0) && gap_pending_.load(boost::memory_order_relaxed) &&
+	    gap_pending_.exchange(false, boost::memory_order_relaxed))
+		NotifyGap(read_timestamp_);
+	metrics_.Add(READER_SHARD, METRIC_BYTES_READ, length);
+
 	// add incoming data to buffer
 	for (unsigned int ii=0; ii<length; ii++) {
 		// make sure bufIndex is not larger than buffer
 		if (buffer_index_ >= MAX_NOUT_SIZE) {
 			buffer_index_=0;
+			metrics_.Add(READER_SHARD, METRIC_BUFFER_OVERFLOWS);
             log_warning_("Overflowed receive buffer. Buffer cleared.");
 		}
 
+		if (reading_acknowledgement_) {
+			if ((message[ii] == '\r') || (message[ii] == '\n')) {
+				// end of the response line
+				reading_acknowledgement_ = false;
+				HandleResponse(response_buffer_);
+				continue;
+			} else if ((message[ii] != 0xAA) && (response_buffer_.size() < MAX_RESPONSE_LENGTH)) {
+				response_buffer_ += message[ii];
+				continue;
+			}
+			// not a response after all, look for a binary message
+			reading_acknowledgement_ = false;
+		}
+
 		if (buffer_index_ == 0) {	// looking for beginning of message
 			if (message[ii] == 0xAA) {	// beginning of msg found - add to buffer
 				data_buffer_[buffer_index_++] = message[ii];
 				bytes_remaining_ = 0;
 			} else if (message[ii] == '<') {
-				// received beginning of acknowledgement
+				// received beginning of a response (e.g. "<OK" or "<ERROR:...")
 				reading_acknowledgement_ = true;
-				buffer_index_ = 1;
+				response_buffer_.clear();
 			} else {
         //log_debug_("BufferIncomingData::Received unknown data.");
 			}
 		} else if (buffer_index_ == 1) {	// verify 2nd character of header
 			if (message[ii] == 0x44) {	// 2nd byte ok - add to buffer
 				data_buffer_[buffer_index_++] = message[ii];
-			} else if ( (message[ii] == 'O') && reading_acknowledgement_ ) {
-				// 2nd byte of acknowledgement
-				buffer_index_ = 2;
 			} else {
 				// start looking for new message again
 				buffer_index_ = 0;
 				bytes_remaining_=0;
-				reading_acknowledgement_=false;
+				metrics_.Add(READER_SHARD, METRIC_RESYNCS);
 			} // end if (msg[i]==0x44)
 		} else if (buffer_index_ == 2) {	// verify 3rd character of header
 			if (message[ii] == 0x12) {	// 2nd byte ok - add to buffer
 				data_buffer_[buffer_index_++] = message[ii];
-			} else if ( (message[ii] == 'K') && (reading_acknowledgement_) ) {
-				// final byte of acknowledgement received
-				buffer_index_ = 0;
-				reading_acknowledgement_ = false;
-				boost::lock_guard<boost::mutex> lock(ack_mutex_);
-				ack_received_ = true;
-				ack_condition_.notify_all();
-
-				// ACK received
-				handle_acknowledgement_();
 			} else {
 				// start looking for new message again
 				buffer_index_ = 0;
 				bytes_remaining_ = 0;
-				reading_acknowledgement_ = false;
+				metrics_.Add(READER_SHARD, METRIC_RESYNCS);
 			} // end if (msg[i]==0x12)
 		} else if (buffer_index_ == 3) {	// number of bytes in header - not including sync
 			data_buffer_[buffer_index_++] = message[ii];
 			// length of header is in byte 4
 			header_length_ = message[ii];
+			// the header holds at least the 10 bytes up to the message length
+			if (header_length_ < 10) {
+				buffer_index_ = 0;
+				bytes_remaining_ = 0;
+				metrics_.Add(READER_SHARD, METRIC_RESYNCS);
+			}
 		} else if (buffer_index_ == 5) { // get message id
 			data_buffer_[buffer_index_++] = message[ii];
 			bytes_remaining_--;
-			message_id = BINARY_LOG_TYPE( ((data_buffer_[buffer_index_-1]) << 8) + data_buffer_[buffer_index_-2] );
+			message_id_ = BINARY_LOG_TYPE( ((data_buffer_[buffer_index_-1]) << 8) + data_buffer_[buffer_index_-2] );
 		// } else if (buffer_index_ == 8) {	// set number of bytes
 		// 	data_buffer_[buffer_index_++] = message[ii];
 		// 	// length of message is in byte 8
@@ -913,11 +2738,83 @@ void Novatel::BufferIncomingData(unsigned char *message, unsigned int length)
 		} else if (buffer_index_ == 9) {
 			data_buffer_[buffer_index_++] = message[ii];
 			bytes_remaining_ = (header_length_ - 10) + 4 + (data_buffer_[9] << 8) + data_buffer_[8];
+			// a message that could not be buffered is not skipped either
+			if (buffer_index_ + bytes_remaining_ > MAX_NOUT_SIZE) {
+				buffer_index_ = 0;
+				bytes_remaining_ = 0;
+				metrics_.Add(READER_SHARD, METRIC_BUFFER_OVERFLOWS);
+				log_warning_("Message longer than the receive buffer. Buffer cleared.");
+				continue;
+			}
+			// rates of the logs arriving for ControlLogRates()
+			metrics_.Add(READER_SHARD, METRIC_FRAMES);
+			if (!(data_buffer_[6] & RESPONSE_BIT)) {
+				if (message_id_ < MAX_LOG_ID)
+					log_counts_[message_id_].fetch_add(1, boost::memory_order_relaxed);
+				metrics_.CountLog(message_id_);
+				if (MessageType(message_id_) == NULL)
+					metrics_.Add(READER_SHARD, METRIC_UNKNOWN_LOGS);
+			}
+			// sizes of variable length logs for PlanBandwidth()
+			if (message_id_ < MAX_LOG_ID)
+				observed_log_sizes_[message_id_].store(uint16_t(buffer_index_ + bytes_remaining_),
+					boost::memory_order_relaxed);
+			// logs nobody listens to are counted through without being
+			// stored or decoded; responses (bit 7 of byte 6) are always kept
+			skipping_message_ = !(data_buffer_[6] & 0x80) &&
+				((message_id_ >= MAX_LOG_ID) || !dispatch_subscribers_->wanted[message_id_]);
+		} else if (skipping_message_) {
+			if (--bytes_remaining_ == 0) {
+				buffer_index_ = 0;
+				skipping_message_ = false;
+			}
 		} else if (bytes_remaining_ == 1) {	// add last byte and parse
 			data_buffer_[buffer_index_++] = message[ii];
 			// BINARY_LOG_TYPE message_id = (BINARY_LOG_TYPE) (((data_buffer_[5]) << 8) + data_buffer_[4]);
+			// the read completed when its last byte arrived, so work back
+			// from there to when the last byte of this message arrived
+			frame_timestamp_ = read_timestamp_;
+			if (baud_rate_ > 0)
+				frame_timestamp_ -= (length-1-ii)*10.0/baud_rate_;
 			// log_info_("Sending to ParseBinary");
-			ParseBinary(data_buffer_, buffer_index_, message_id);
+			if (tracer_.IsTracing()) {
+				uint64_t now_ns = MonotonicNanoseconds();
+				tracer_.Record(READER_SHARD, TRACE_FRAME, now_ns, now_ns, message_id_, uint32_t(buffer_index_));
+			}
+			if (data_buffer_[6] & RESPONSE_BIT) {
+				HandleBinaryResponse(data_buffer_, buffer_index_);
+			} else {
+				// counted, though the message is still decoded as before
+				uint32_t crc;
+				memcpy(&crc, data_buffer_+buffer_index_-4, 4);
+				if (CalculateBlockCRC32(buffer_index_-4, data_buffer_) != crc)
+					metrics_.Add(READER_SHARD, METRIC_CRC_FAILURES);
+				if (header_length_ == HEADER_SIZE) {
+					RecordReceiverLoad((const Oem4BinaryHeader*)data_buffer_);
+					MonitorLogTiming((const Oem4BinaryHeader*)data_buffer_);
+				}
+				frame_monotonic_us_ = 0;
+				parse_timestamp_ = read_timestamp_;
+				if (latency_tracking_ && (message_id_ < MAX_LOG_ID)) {
+					frame_monotonic_us_ = MonotonicMicroseconds();
+					LogLatency *latency = LatencyOf(message_id_);
+					if (read_monotonic_us_ > 0) {
+						uint64_t framing_us = frame_monotonic_us_ - read_monotonic_us_;
+						latency->stages[LATENCY_READ_TO_FRAME].Record(framing_us);
+						parse_timestamp_ = read_timestamp_ + framing_us/1e6;
+						const Oem4BinaryHeader *header = (const Oem4BinaryHeader*)data_buffer_;
+						if ((header_length_ == HEADER_SIZE) && (header->gps_week > 0)) {
+							// GPS time started 1980-01-06, 315964800 s after the Unix epoch
+							double gps_time = 315964800.0 + header->gps_week*604800.0 +
+								header->gps_millisecs/1000.0 - gps_utc_offset_;
+							double age = read_wall_time_ - (read_timestamp_ - frame_timestamp_) - gps_time;
+							// a host clock behind the receiver's counts as no age
+							latency->stages[LATENCY_MESSAGE_AGE].Record(age > 0 ? uint64_t(age*1e6) : 0);
+						}
+					}
+				}
+				ParseBinary(data_buffer_, buffer_index_, message_id_);
+			}
 			// reset counters
 			buffer_index_ = 0;
 			bytes_remaining_ = 0;
@@ -926,6 +2823,837 @@ void Novatel::BufferIncomingData(unsigned char *message, unsigned int length)
 			bytes_remaining_--;
 		}
 	}	// end for
+
+	// hand on batched messages if they are due
+	if ((batch_flush_period_ <= 0) || (read_timestamp_ < last_batch_flush_) ||
+	    (read_timestamp_ - last_batch_flush_ >= batch_flush_period_)) {
+		FlushBatches();
+		last_batch_flush_ = read_timestamp_;
+	}
+
+	read_epoch_.fetch_add(1, boost::memory_order_release);
+}
+
+void Novatel::FlushBatches() {
+	for (SubscriberMap::const_iterator it = dispatch_subscribers_->subscribers.begin();
+	     it != dispatch_subscribers_->subscribers.end(); ++it) {
+		for (SubscriberList::const_iterator sub = it->second.begin(); sub != it->second.end(); ++sub)
+			(*sub)->Flush();
+	}
+}
+
+//! number of subscribers in the list, not counting the data callback
+static size_t CountSubscribers(const std::vector<boost::shared_ptr<Subscriber> > &subscribers) {
+	size_t count = 0;
+	for (size_t ii=0; ii<subscribers.size(); ii++) {
+		if ((subscribers[ii]->id() != 0) && subscribers[ii]->RequestsLog())
+			count++;
+	}
+	return count;
+}
+
+SubscriptionId Novatel::AddSubscriber(boost::shared_ptr<Subscriber> subscriber,
+                                      const std::type_info &message_type) {
+	const std::type_info *expected_type = MessageType(subscriber->log_type());
+	if ((expected_type==NULL) || (*expected_type!=message_type)) {
+		std::stringstream output;
+		output << "Cannot subscribe to log " << subscriber->log_type() <<
+			" with structure " << message_type.name();
+		log_error_(output.str());
+		return 0;
+	}
+
+	bool first_subscriber;
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		subscriber->set_id(next_subscription_id_++);
+		SubscriberMap subscribers(subscribers_.load()->subscribers);
+		SubscriberList &list = subscribers[subscriber->log_type()];
+		first_subscriber = (CountSubscribers(list) == 0);
+		// the data callback, if any, stays last
+		SubscriberList::iterator position = list.end();
+		if (!list.empty() && (list.back()->id() == 0))
+			--position;
+		list.insert(position, subscriber);
+		PublishSubscribers(subscribers);
+		first_subscriber = first_subscriber && auto_logging_ &&
+			!requested_logs_[subscriber->log_type()];
+	}
+	if (first_subscriber)
+		SendAutoLogCommand(subscriber->log_type(), true);
+	return subscriber->id();
+}
+
+bool Novatel::Unsubscribe(SubscriptionId id) {
+	if (id == 0)
+		return false;
+	BINARY_LOG_TYPE log_type;
+	bool last_subscriber;
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		SubscriberMap subscribers(subscribers_.load()->subscribers);
+		SubscriberMap::iterator it;
+		SubscriberList::iterator sub;
+		for (it = subscribers.begin(); it != subscribers.end(); ++it) {
+			sub = it->second.begin();
+			while ((sub != it->second.end()) && ((*sub)->id() != id))
+				++sub;
+			if (sub != it->second.end())
+				break;
+		}
+		if (it == subscribers.end())
+			return false;
+		log_type = (*sub)->log_type();
+		bool requested_log = (*sub)->RequestsLog();
+		it->second.erase(sub);
+		// leave the log running if a data callback still uses it
+		bool has_callback = !it->second.empty() && (it->second.back()->id() == 0);
+		last_subscriber = requested_log && !has_callback && (CountSubscribers(it->second) == 0);
+		if (it->second.empty())
+			subscribers.erase(it);
+		PublishSubscribers(subscribers);
+		last_subscriber = last_subscriber && auto_logging_ && requested_logs_[log_type];
+	}
+	if (last_subscriber)
+		SendAutoLogCommand(log_type, false);
+	return true;
+}
+
+void Novatel::ReplaceCallback(BINARY_LOG_TYPE log_type, boost::shared_ptr<Subscriber> callback) {
+	boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+	SubscriberMap subscribers(subscribers_.load()->subscribers);
+	SubscriberList &list = subscribers[log_type];
+	if (!list.empty() && (list.back()->id() == 0))
+		list.pop_back();
+	if (callback)
+		list.push_back(callback);
+	if (list.empty())
+		subscribers.erase(log_type);
+	PublishSubscribers(subscribers);
+}
+
+void Novatel::PublishSubscribers(const SubscriberMap &subscribers) {
+	SubscriberTable *table = new SubscriberTable();
+	table->subscribers = subscribers;
+	for (SubscriberMap::const_iterator it = subscribers.begin(); it != subscribers.end(); ++it) {
+		if (it->first < MAX_LOG_ID)
+			table->wanted.set(it->first);
+	}
+
+	const SubscriberTable *old_table = subscribers_.exchange(table, boost::memory_order_seq_cst);
+	// if no read is in progress now, any later read will load the new table
+	uint64_t epoch = read_epoch_.load(boost::memory_order_seq_cst);
+	if (epoch & 1)
+		retired_tables_.push_back(std::make_pair(old_table, epoch));
+	else
+		delete old_table;
+	ReclaimSubscriberTables();
+}
+
+void Novatel::ReclaimSubscriberTables() {
+	uint64_t epoch = read_epoch_.load(boost::memory_order_seq_cst);
+	size_t kept = 0;
+	for (size_t ii=0; ii<retired_tables_.size(); ii++) {
+		// the read that might have been using the table has finished
+		if (retired_tables_[ii].second != epoch)
+			delete retired_tables_[ii].first;
+		else
+			retired_tables_[kept++] = retired_tables_[ii];
+	}
+	retired_tables_.resize(kept);
+}
+
+void Novatel::RecordLogRequest(const std::string &log) {
+	// LOG [port] message [trigger [period [offset [hold]]]]
+	std::vector<std::string> tokens;
+	Tokenize(log, tokens, " ");
+	for (size_t ii=0; ii<tokens.size(); ii++) {
+		BINARY_LOG_TYPE log_type;
+		if (!BinaryLogTypeFromName(tokens[ii], &log_type) || (log_type >= MAX_LOG_ID))
+			continue;
+		std::string trigger;
+		for (size_t jj=ii+1; jj<tokens.size(); jj++)
+			trigger += (jj>ii+1 ? " " : "") + tokens[jj];
+		if (!trigger.empty())
+			log_triggers_[log_type] = trigger;
+		requested_logs_.set(log_type);
+		// logs requested ONTIME are expected at that period
+		std::map<uint16_t, std::string>::const_iterator requested = log_triggers_.find(log_type);
+		std::vector<std::string> trigger_tokens;
+		if (requested != log_triggers_.end())
+			Tokenize(requested->second, trigger_tokens, " ");
+		uint32_t period_ms = 0;
+		if ((trigger_tokens.size() > 1) && (trigger_tokens[0] == "ONTIME"))
+			period_ms = uint32_t(atof(trigger_tokens[1].c_str())*1000 + 0.5);
+		SetExpectedPeriod(log_type, period_ms);
+		return;
+	}
+}
+
+bool Novatel::IsLogRequested(const std::string &log) {
+	// only logs on this port are recorded, so a log given with a port is always sent
+	std::vector<std::string> tokens;
+	Tokenize(log, tokens, " ");
+	BINARY_LOG_TYPE log_type;
+	if (tokens.empty() || !BinaryLogTypeFromName(tokens[0], &log_type) ||
+			(log_type >= MAX_LOG_ID) || !requested_logs_[log_type])
+		return false;
+	std::string trigger;
+	for (size_t ii=1; ii<tokens.size(); ii++)
+		trigger += (ii>1 ? " " : "") + tokens[ii];
+	std::map<uint16_t, std::string>::const_iterator requested = log_triggers_.find(log_type);
+	return (requested != log_triggers_.end()) && TriggersMatch(requested->second, trigger);
+}
+
+//! Periods the receiver accepts for ONTIME logs [sec]
+static const double ONTIME_PERIODS[] = {0.01, 0.02, 0.05, 0.1, 0.2, 0.25, 0.5, 1, 2, 5, 10, 15, 20, 30, 60};
+static const size_t ONTIME_PERIOD_COUNT = sizeof(ONTIME_PERIODS)/sizeof(ONTIME_PERIODS[0]);
+
+//! Next period the receiver accepts after period, or period if none
+static double LongerOntimePeriod(double period) {
+	for (size_t ii=0; ii<ONTIME_PERIOD_COUNT; ii++) {
+		if (ONTIME_PERIODS[ii] > period + 1e-9)
+			return ONTIME_PERIODS[ii];
+	}
+	return period;
+}
+
+//! Period the receiver accepts before period, or period if none
+static double ShorterOntimePeriod(double period) {
+	for (size_t ii=ONTIME_PERIOD_COUNT; ii>0; ii--) {
+		if (ONTIME_PERIODS[ii-1] < period - 1e-9)
+			return ONTIME_PERIODS[ii-1];
+	}
+	return period;
+}
+
+//! ONTIME trigger with its period replaced, keeping any offset and hold
+static std::string WithOntimePeriod(const std::string &trigger, double period) {
+	std::vector<std::string> tokens;
+	Tokenize(trigger, tokens, " ");
+	std::stringstream result;
+	result << "ONTIME " << period;
+	for (size_t ii=2; ii<tokens.size(); ii++)
+		result << " " << tokens[ii];
+	return result.str();
+}
+
+//! Period of an ONTIME trigger, or 0 for other triggers
+static double OntimePeriod(const std::string &trigger) {
+	std::vector<std::string> tokens;
+	Tokenize(trigger, tokens, " ");
+	if ((tokens.size() < 2) || (tokens[0] != "ONTIME"))
+		return 0;
+	return atof(tokens[1].c_str());
+}
+
+BandwidthPlan Novatel::PlanBandwidth(const std::string &log_string, bool replan) {
+	BandwidthPlan plan;
+	plan.capacity = (baud_rate_ > 0) ? baud_rate_/10.0 : 0;
+
+	// LOG [port] message [trigger [period [offset [hold]]]]; later
+	// requests for a log replace earlier ones
+	std::vector<std::string> logs;
+	Tokenize(log_string, logs, ";");
+	std::map<uint16_t, size_t> index;
+	for (size_t ii=0; ii<logs.size(); ii++) {
+		std::vector<std::string> tokens;
+		Tokenize(logs[ii], tokens, " ");
+		LogBandwidth log;
+		if (tokens.empty() || !BinaryLogTypeFromName(tokens[0], &log.log_type))
+			continue;  // another port, or a log the driver does not know
+		log.log = logs[ii];
+		log.rate = 0;
+		log.replanned = false;
+		std::string trigger = (tokens.size() > 1) ? tokens[1] : "";
+		std::transform(trigger.begin(), trigger.end(), trigger.begin(), ::toupper);
+		log.periodic = (trigger == "ONTIME") && (tokens.size() > 2) && (atof(tokens[2].c_str()) > 0);
+		if (log.periodic)
+			log.rate = 1.0/atof(tokens[2].c_str());
+		else if ((trigger == "ONNEW") &&
+				((log.log_type == RAWIMU_LOG_TYPE) || (log.log_type == RAWIMUS_LOG_TYPE)))
+			log.rate = TYPICAL_IMU_RATE;
+		log.message_bytes = 0;
+		if (log.log_type < MAX_LOG_ID)
+			log.message_bytes = observed_log_sizes_[log.log_type].load(boost::memory_order_relaxed);
+		if (log.message_bytes == 0)
+			log.message_bytes = NominalLogSize(log.log_type);
+		log.size_known = log.message_bytes > 0;
+		log.bytes_per_second = log.rate*log.message_bytes;
+		if (index.count(log.log_type)) {
+			plan.logs[index[log.log_type]] = log;
+		} else {
+			index[log.log_type] = plan.logs.size();
+			plan.logs.push_back(log);
+		}
+	}
+
+	// lengthen the period of the largest load a step at a time until the logs fit
+	while (replan && (plan.capacity > 0)) {
+		double total = 0;
+		LogBandwidth *largest = NULL;
+		for (size_t ii=0; ii<plan.logs.size(); ii++) {
+			LogBandwidth &log = plan.logs[ii];
+			total += log.bytes_per_second;
+			bool lengthened = log.periodic && (LongerOntimePeriod(1.0/log.rate) != 1.0/log.rate);
+			if (lengthened && ((largest == NULL) || (log.bytes_per_second > largest->bytes_per_second)))
+				largest = &log;
+		}
+		if ((total <= max_utilization_*plan.capacity) || (largest == NULL))
+			break;
+		double period = LongerOntimePeriod(1.0/largest->rate);
+		std::vector<std::string> tokens;
+		Tokenize(largest->log, tokens, " ");
+		std::stringstream log;
+		log << tokens[0] << " " << tokens[1] << " " << period;
+		for (size_t ii=3; ii<tokens.size(); ii++)
+			log << " " << tokens[ii];
+		largest->log = log.str();
+		largest->rate = 1.0/period;
+		largest->bytes_per_second = largest->rate*largest->message_bytes;
+		largest->replanned = true;
+	}
+
+	plan.bytes_per_second = 0;
+	for (size_t ii=0; ii<plan.logs.size(); ii++)
+		plan.bytes_per_second += plan.logs[ii].bytes_per_second;
+	plan.utilization = (plan.capacity > 0) ? plan.bytes_per_second/plan.capacity : 0;
+	plan.fits = plan.utilization <= max_utilization_;
+	return plan;
+}
+
+bool Novatel::CheckBandwidth(std::vector<std::string> *logs, bool include_requested) {
+	if ((bandwidth_policy_ == BANDWIDTH_IGNORE) || (baud_rate_ <= 0))
+		return true;
+
+	// the logs already running come first, so the new ones replace them
+	std::string log_string;
+	if (include_requested) {
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		for (size_t log_id=0; log_id<requested_logs_.size(); log_id++) {
+			const BinaryLogInfo *info = FindBinaryLog(BINARY_LOG_TYPE(log_id));
+			if (!requested_logs_[log_id] || (info == NULL))
+				continue;
+			std::map<uint16_t, std::string>::const_iterator trigger = log_triggers_.find(log_id);
+			log_string += std::string(info->name) + " " +
+				(trigger != log_triggers_.end() ? trigger->second : info->default_trigger) + ";";
+		}
+	}
+	for (size_t ii=0; ii<logs->size(); ii++)
+		log_string += (*logs)[ii] + ";";
+
+	BandwidthPlan plan = PlanBandwidth(log_string, bandwidth_policy_ == BANDWIDTH_REPLAN);
+	for (size_t ii=0; ii<plan.logs.size(); ii++) {
+		if (!plan.logs[ii].size_known && (plan.logs[ii].rate > 0))
+			log_warning_("Size of log `" + plan.logs[ii].log + "` unknown; left out of the bandwidth plan.");
+	}
+	if (plan.fits)
+		return true;
+
+	std::stringstream output;
+	output << "Logs need " << int(plan.bytes_per_second) << " bytes/s, " << int(plan.utilization*100)
+		<< "% of the " << int(plan.capacity) << " bytes/s the port carries at " << baud_rate_ << " baud.";
+	switch (bandwidth_policy_) {
+		case BANDWIDTH_RAISE_BAUD: {
+			int baudrate = SufficientBaudRate(plan.bytes_per_second, max_utilization_, max_baud_rate_);
+			if ((baudrate == 0) || changing_baud_rate_) {
+				log_warning_(output.str());
+				return true;
+			}
+			std::stringstream raise_msg;
+			raise_msg << output.str() << " Raising the baud rate to " << baudrate << ".";
+			log_info_(raise_msg.str());
+			if (!SetBaudRate(baudrate))
+				log_warning_(output.str());
+			return true;
+		}
+		case BANDWIDTH_REJECT:
+			log_error_(output.str() + " Logs not requested.");
+			return false;
+		case BANDWIDTH_REPLAN: {
+			// replanned logs take the place of the logs asked for, and
+			// logs already running that were slowed down are requested again
+			std::set<BINARY_LOG_TYPE> asked;
+			std::vector<std::string> replanned;
+			for (size_t ii=0; ii<logs->size(); ii++) {
+				std::vector<std::string> tokens;
+				Tokenize((*logs)[ii], tokens, " ");
+				BINARY_LOG_TYPE log_type;
+				if (tokens.empty() || !BinaryLogTypeFromName(tokens[0], &log_type))
+					replanned.push_back((*logs)[ii]);
+				else
+					asked.insert(log_type);
+			}
+			for (size_t ii=0; ii<plan.logs.size(); ii++) {
+				if (asked.count(plan.logs[ii].log_type) || plan.logs[ii].replanned)
+					replanned.push_back(plan.logs[ii].log);
+			}
+			logs->swap(replanned);
+			if (!plan.fits)
+				log_warning_(output.str() + " Replanned logs still do not fit.");
+			else
+				log_warning_(output.str() + " Periods lengthened to fit.");
+			return true;
+		}
+		default:
+			log_warning_(output.str());
+			return true;
+	}
+}
+
+// bits of the receiver status word
+static const uint32_t CPU_OVERLOAD_BIT = 0x00000080;
+static const uint32_t PORT_OVERRUN_BITS = 0x00000F00;  //!< COM1-3 and USB buffer overruns
+//! Idle time below which the receiver is overloaded, and above which it has headroom [0.5%]
+static const uint8_t OVERLOADED_IDLE = 20;
+static const uint8_t HEADROOM_IDLE = 60;
+//! Seconds with headroom before a slowed log is sped up a step
+static const int HEADROOM_INTERVALS = 5;
+//! Longest a log is slowed down to, as a multiple of the period requested
+static const double MAX_SLOWDOWN = 8;
+
+void Novatel::RecordReceiverLoad(const Oem4BinaryHeader *header) {
+	receiver_status_.fetch_or(header->status, boost::memory_order_relaxed);
+	uint8_t idle = receiver_idle_.load(boost::memory_order_relaxed);
+	while ((header->idle < idle) &&
+		!receiver_idle_.compare_exchange_weak(idle, header->idle, boost::memory_order_relaxed)) {}
+}
+
+//! Milliseconds in a GPS week
+static const int64_t WEEK_MS = 7*24*3600*1000LL;
+
+void Novatel::set_log_timing_callback(LogTimingCallback handler) {
+	boost::lock_guard<boost::mutex> lock(timing_mutex_);
+	log_timing_callback_ = handler;
+}
+
+void Novatel::SetExpectedPeriod(BINARY_LOG_TYPE log_type, uint32_t period_ms) {
+	if (log_type >= MAX_LOG_ID)
+		return;
+	boost::lock_guard<boost::mutex> lock(timing_mutex_);
+	if (log_timing_[log_type] == NULL) {
+		if (period_ms == 0)
+			return;
+		log_timing_[log_type] = new LogTiming();
+		log_timing_[log_type]->last_epoch_ms = -1;
+	}
+	log_timing_[log_type]->configured_period_ms = period_ms;
+	log_timing_[log_type]->statistics.period = (period_ms ? period_ms :
+		log_timing_[log_type]->learned_period_ms)/1000.0;
+}
+
+void Novatel::MonitorLogTiming(const Oem4BinaryHeader *header) {
+	// only the last message of a set sharing an epoch counts
+	if ((header->message_id >= MAX_LOG_ID) || (header->sequence != 0))
+		return;
+	int64_t epoch_ms = header->gps_week*WEEK_MS + header->gps_millisecs;
+	LogTimingEvent event;
+	event.log_type = BINARY_LOG_TYPE(header->message_id);
+	event.gps_time = header->gps_millisecs/1000.0;
+	event.missed = 0;
+	{
+		boost::lock_guard<boost::mutex> lock(timing_mutex_);
+		LogTiming *&timing = log_timing_[header->message_id];
+		if (timing == NULL) {
+			timing = new LogTiming();
+			timing->last_epoch_ms = -1;
+		}
+		LogTimingStatistics &statistics = timing->statistics;
+		statistics.messages++;
+		if (timing->last_epoch_ms < 0) {
+			timing->last_epoch_ms = epoch_ms;
+			timing->last_arrival = frame_timestamp_;
+			return;
+		}
+		int64_t step_ms = epoch_ms - timing->last_epoch_ms;
+		event.previous_gps_time = (timing->last_epoch_ms % WEEK_MS)/1000.0;
+		if (step_ms == 0) {
+			statistics.duplicates++;
+			event.type = LOG_DUPLICATE;
+		} else if (step_ms < 0) {
+			statistics.out_of_order++;
+			event.type = LOG_OUT_OF_ORDER;
+		} else {
+			// a log without a configured period is expected at a step seen twice in a row
+			if (step_ms == timing->last_step_ms)
+				timing->learned_period_ms = uint32_t(step_ms);
+			timing->last_step_ms = step_ms;
+			uint32_t period_ms = timing->configured_period_ms ?
+				timing->configured_period_ms : timing->learned_period_ms;
+			statistics.period = period_ms/1000.0;
+
+			// jitter is how much later or earlier than its epoch a message came
+			if ((frame_timestamp_ > 0) && (timing->last_arrival > 0)) {
+				double jitter_ms = fabs((frame_timestamp_ - timing->last_arrival)*1000 - step_ms);
+				statistics.max_jitter_ms = std::max(statistics.max_jitter_ms, jitter_ms);
+				size_t bin = 0;
+				for (double limit=1; (bin < LOG_JITTER_BINS-1) && (jitter_ms >= limit); limit*=2)
+					bin++;
+				statistics.jitter_histogram[bin]++;
+			}
+			timing->last_epoch_ms = epoch_ms;
+			timing->last_arrival = frame_timestamp_;
+
+			if ((period_ms == 0) || (2*step_ms <= 3*int64_t(period_ms)))
+				return;
+			event.missed = uint32_t((step_ms + period_ms/2)/period_ms) - 1;
+			statistics.gaps++;
+			statistics.missed += event.missed;
+			event.type = LOG_GAP;
+		}
+	}
+	LogTimingCallback callback;
+	{
+		boost::lock_guard<boost::mutex> lock(timing_mutex_);
+		callback = log_timing_callback_;
+	}
+	if (callback)
+		callback(event);
+}
+
+Novatel::LogLatency *Novatel::LatencyOf(uint16_t message_id) {
+	LogLatency *latency = log_latency_[message_id].load(boost::memory_order_acquire);
+	if (latency == NULL) {
+		latency = new LogLatency();
+		log_latency_[message_id].store(latency, boost::memory_order_release);
+	}
+	return latency;
+}
+
+LatencySummary Novatel::GetLatency(BINARY_LOG_TYPE log_type, LatencyStage stage) {
+	LogLatency *latency = NULL;
+	if ((log_type < MAX_LOG_ID) && (stage < LATENCY_STAGES))
+		latency = log_latency_[log_type].load(boost::memory_order_acquire);
+	if (latency == NULL)
+		return LatencySummary();
+	return latency->stages[stage].Summarize();
+}
+
+LogTimingStatistics Novatel::GetLogTimingStatistics(BINARY_LOG_TYPE log_type) {
+	boost::lock_guard<boost::mutex> lock(timing_mutex_);
+	if ((log_type >= MAX_LOG_ID) || (log_timing_[log_type] == NULL))
+		return LogTimingStatistics();
+	return log_timing_[log_type]->statistics;
+}
+
+void Novatel::ControlLogRates() {
+	bool enabled;
+	LogIdSet low_priority;
+	{
+		boost::lock_guard<boost::mutex> lock(supervisor_mutex_);
+		enabled = adaptive_log_rates_;
+		low_priority = low_priority_logs_;
+	}
+	boost::system_time now = boost::get_system_time();
+	double interval = (now - last_rate_control_).total_milliseconds()/1000.0;
+	last_rate_control_ = now;
+	uint8_t idle = receiver_idle_.exchange(255, boost::memory_order_relaxed);
+	uint32_t status = receiver_status_.exchange(0, boost::memory_order_relaxed);
+	if (!is_connected_)
+		return;
+
+	// ONTIME logs arriving less often than asked for are being dropped
+	std::string dropped;
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		for (std::map<uint16_t, std::string>::const_iterator it = log_triggers_.begin();
+				it != log_triggers_.end(); ++it) {
+			uint32_t count = log_counts_[it->first].exchange(0, boost::memory_order_relaxed);
+			double period = OntimePeriod(it->second);
+			if (!requested_logs_[it->first] || (period <= 0) || log_rates_changed_)
+				continue;
+			double expected = interval/period;
+			if ((expected >= 2) && (count < 0.9*expected)) {
+				const char *name = BinaryLogName(BINARY_LOG_TYPE(it->first));
+				dropped += std::string(dropped.empty() ? "" : ", ") + (name ? name : "?");
+			}
+		}
+	}
+	log_rates_changed_ = false;
+
+	bool overloaded = (status & (CPU_OVERLOAD_BIT | PORT_OVERRUN_BITS)) ||
+		(idle < OVERLOADED_IDLE) || !dropped.empty();
+	if (overloaded) {
+		healthy_intervals_ = 0;
+	} else if ((idle == 255) || (idle > HEADROOM_IDLE)) {
+		healthy_intervals_++;
+	}
+	bool restore = !enabled || (healthy_intervals_ >= HEADROOM_INTERVALS);
+	std::string logs = AdjustLogRates(enabled && overloaded, restore, low_priority);
+	if (logs.empty())
+		return;
+	healthy_intervals_ = 0;
+	log_rates_changed_ = true;
+
+	std::stringstream output;
+	if (overloaded) {
+		output << "Receiver overloaded (idle " << idle/2.0 << "%, status 0x" << std::hex << status << std::dec;
+		if (!dropped.empty())
+			output << ", dropping " << dropped;
+		output << "); slowing down low priority logs: " << logs;
+	} else {
+		output << "Receiver has headroom again; speeding up logs: " << logs;
+	}
+	log_warning_(output.str());
+	ConfigureLogs(logs);
+}
+
+std::string Novatel::AdjustLogRates(bool overloaded, bool restore, const LogIdSet &low_priority) {
+	boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+	std::string logs;
+
+	// a log requested again since it was slowed down is the caller's again
+	for (std::map<uint16_t, std::pair<std::string, std::string> >::iterator it = throttled_logs_.begin();
+			it != throttled_logs_.end(); ) {
+		std::map<uint16_t, std::string>::const_iterator trigger = log_triggers_.find(it->first);
+		if (!requested_logs_[it->first] || (trigger == log_triggers_.end()) ||
+				(trigger->second != it->second.second))
+			throttled_logs_.erase(it++);
+		else
+			++it;
+	}
+
+	if (overloaded) {
+		for (std::map<uint16_t, std::string>::const_iterator it = log_triggers_.begin();
+				it != log_triggers_.end(); ++it) {
+			const char *name = BinaryLogName(BINARY_LOG_TYPE(it->first));
+			double period = OntimePeriod(it->second);
+			if (!requested_logs_[it->first] || !low_priority[it->first] || (period <= 0) || (name == NULL))
+				continue;
+			std::map<uint16_t, std::pair<std::string, std::string> >::iterator throttled =
+				throttled_logs_.find(it->first);
+			double requested = (throttled != throttled_logs_.end()) ?
+				OntimePeriod(throttled->second.first) : period;
+			double longer = LongerOntimePeriod(period);
+			if ((longer == period) || (longer > MAX_SLOWDOWN*requested + 1e-9))
+				continue;
+			std::string trigger = WithOntimePeriod(it->second, longer);
+			if (throttled == throttled_logs_.end())
+				throttled_logs_[it->first] = std::make_pair(it->second, trigger);
+			else
+				throttled->second.second = trigger;
+			logs += std::string(logs.empty() ? "" : ";") + name + " " + trigger;
+		}
+	} else if (restore) {
+		for (std::map<uint16_t, std::pair<std::string, std::string> >::iterator it = throttled_logs_.begin();
+				it != throttled_logs_.end(); ) {
+			const char *name = BinaryLogName(BINARY_LOG_TYPE(it->first));
+			double requested = OntimePeriod(it->second.first);
+			double shorter = ShorterOntimePeriod(OntimePeriod(it->second.second));
+			std::string trigger;
+			if (shorter <= requested + 1e-9) {
+				trigger = it->second.first;
+				throttled_logs_.erase(it++);
+			} else {
+				trigger = WithOntimePeriod(it->second.second, shorter);
+				it->second.second = trigger;
+				++it;
+			}
+			logs += std::string(logs.empty() ? "" : ";") + name + " " + trigger;
+		}
+	}
+	return logs;
+}
+
+void Novatel::SetAutoLogging(bool enable) {
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		auto_logging_ = enable;
+	}
+	if (enable)
+		RequestSubscribedLogs();
+}
+
+void Novatel::RequestSubscribedLogs() {
+	std::vector<BINARY_LOG_TYPE> missing;
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		const SubscriberMap &subscribers = subscribers_.load()->subscribers;
+		for (SubscriberMap::const_iterator it = subscribers.begin(); it != subscribers.end(); ++it) {
+			if ((it->first < MAX_LOG_ID) && !requested_logs_[it->first] &&
+			    (CountSubscribers(it->second) > 0))
+				missing.push_back(BINARY_LOG_TYPE(it->first));
+		}
+	}
+	for (size_t ii=0; ii<missing.size(); ii++)
+		SendAutoLogCommand(missing[ii], true);
+}
+
+void Novatel::SendAutoLogCommand(BINARY_LOG_TYPE log_type, bool log) {
+	const BinaryLogInfo *info = FindBinaryLog(log_type);
+	if (info == NULL) {
+		std::stringstream output;
+		output << "Cannot request unknown log " << log_type << " automatically.";
+		log_warning_(output.str());
+		return;
+	}
+
+	std::string cmd;
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		if (log) {
+			std::map<uint16_t, std::string>::const_iterator trigger = log_triggers_.find(log_type);
+			cmd = std::string("LOG ") + info->name + " " +
+				(trigger != log_triggers_.end() ? trigger->second : info->default_trigger);
+		} else {
+			cmd = std::string("UNLOG ") + info->name;
+		}
+		boost::shared_ptr<serial::Serial> serial_port = SerialPort();
+		if (!serial_port || !serial_port->isOpen())
+			return; // requested when the next connection is made
+	}
+
+	// the response is not waited for, since this may run on the read thread
+	PendingCommand pending;
+	pending.command = cmd;
+	pending.deadline = boost::get_system_time() + boost::posix_time::milliseconds(ResponseTimeout());
+	pending.callback = boost::bind(&Novatel::AutoLogCommandDone, this, log_type, log, _1);
+	try {
+		WriteCommand(cmd, &pending);
+		log_info_("Sent `" + cmd + "` for subscribers.");
+	} catch (std::exception &e) {
+		std::stringstream output;
+		output << "Error sending `" << cmd << "`: " << e.what();
+		log_error_(output.str());
+	}
+}
+
+void Novatel::AutoLogCommandDone(BINARY_LOG_TYPE log_type, bool log, const CommandResult &result) {
+	if (result.status != COMMAND_OK) {
+		log_warning_("Receiver did not accept `" + result.command + "`: " + result.message);
+		return;
+	}
+	boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+	requested_logs_[log_type] = log;
+}
+
+void Novatel::StartQuery(boost::shared_ptr<QueryBase> query, const std::type_info &message_type,
+                         uint32_t timeout_ms) {
+	const BinaryLogInfo *info = FindBinaryLog(query->log_type());
+	if (info == NULL) {
+		query->Fail("unknown log");
+		return;
+	}
+	SubscriptionId id = AddSubscriber(query, message_type);
+	if (id == 0) {
+		query->Fail(std::string("cannot decode ") + info->name + " into the requested structure");
+		return;
+	}
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		PendingQuery &pending = pending_queries_[id];
+		pending.query = query;
+		pending.deadline = boost::get_system_time() + boost::posix_time::milliseconds(timeout_ms);
+	}
+	SendCommandAsync(std::string("LOG ") + info->name + " ONCE", timeout_ms,
+		boost::bind(&Novatel::QueryCommandDone, this, id, _1));
+}
+
+void Novatel::QueryCommandDone(SubscriptionId id, const CommandResult &result) {
+	if (result.status == COMMAND_OK)
+		return;
+	boost::shared_ptr<QueryBase> query;
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		std::map<SubscriptionId, PendingQuery>::iterator it = pending_queries_.find(id);
+		if (it == pending_queries_.end())
+			return;
+		query = it->second.query;
+		pending_queries_.erase(it);
+	}
+	query->Fail("`" + result.command + "` failed: " +
+		(result.message.empty() ? "no response from receiver" : result.message));
+	Unsubscribe(id);
+}
+
+void Novatel::ExpireQueries() {
+	std::vector<std::pair<SubscriptionId, boost::shared_ptr<QueryBase> > > finished;
+	{
+		boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+		if (pending_queries_.empty())
+			return;
+		boost::system_time now = boost::get_system_time();
+		std::map<SubscriptionId, PendingQuery>::iterator it = pending_queries_.begin();
+		while (it != pending_queries_.end()) {
+			if (it->second.query->completed() || (it->second.deadline <= now)) {
+				finished.push_back(std::make_pair(it->first, it->second.query));
+				pending_queries_.erase(it++);
+			} else {
+				++it;
+			}
+		}
+	}
+	for (size_t ii=0; ii<finished.size(); ii++) {
+		finished[ii].second->Fail("no reply from receiver");
+		Unsubscribe(finished[ii].first);
+	}
+}
+
+bool Novatel::GetPoolStatistics(SubscriptionId id, PoolStatistics *statistics) {
+	if (id == 0)
+		return false;
+	// tables are only freed by writers, which hold the same lock
+	boost::lock_guard<boost::mutex> lock(subscribers_mutex_);
+	const SubscriberMap &subscribers = subscribers_.load()->subscribers;
+	for (SubscriberMap::const_iterator it = subscribers.begin(); it != subscribers.end(); ++it) {
+		for (SubscriberList::const_iterator sub = it->second.begin(); sub != it->second.end(); ++sub) {
+			if ((*sub)->id() == id)
+				return (*sub)->GetPoolStatistics(statistics);
+		}
+	}
+	return false;
+}
+
+template <typename T>
+void Novatel::Dispatch(unsigned char *message, size_t length, BINARY_LOG_TYPE message_id) {
+	accepted_subscribers_.clear();
+	SubscriberMap::const_iterator it = dispatch_subscribers_->subscribers.find(message_id);
+	if (it != dispatch_subscribers_->subscribers.end()) {
+		for (SubscriberList::const_iterator sub = it->second.begin(); sub != it->second.end(); ++sub) {
+			if ((*sub)->Accept(message))
+				accepted_subscribers_.push_back(sub->get());
+		}
+	}
+	if (accepted_subscribers_.empty())
+		return;
+
+	T decoded;
+	uint64_t decode_start_ns = tracer_.IsTracing() ? MonotonicNanoseconds() : 0;
+	bool decoded_ok = DecodeMessage(message, length, decoded);
+	if (decode_start_ns > 0)
+		tracer_.Record(READER_SHARD, TRACE_DECODE, decode_start_ns, MonotonicNanoseconds(), message_id);
+	if (!decoded_ok) {
+		std::stringstream ss;
+		ss << "Novatel Driver: " << DecodeFailure(decoded) << " (id " << message_id << ")\n";
+		ss << "\tlength = " << length << "\n";
+		ss << "\tsizeof msg = " << sizeof(decoded);
+		log_warning_(ss.str());
+		return;
+	}
+
+	// each subscriber waits for those before it, which counts towards its dispatch latency
+	LogLatency *latency = NULL;
+	uint64_t decoded_us = 0;
+	if (frame_monotonic_us_ > 0) {
+		latency = LatencyOf(message_id);
+		decoded_us = MonotonicMicroseconds();
+		latency->stages[LATENCY_FRAME_TO_DECODE].Record(decoded_us - frame_monotonic_us_);
+	}
+	uint64_t delivery_us = decoded_us;
+	for (size_t ii=0; ii<accepted_subscribers_.size(); ii++) {
+		uint64_t delivery_ns = (decode_start_ns > 0) ? MonotonicNanoseconds() : 0;
+		if (latency != NULL)
+			latency->stages[LATENCY_DECODE_TO_DISPATCH].Record(delivery_us - decoded_us);
+		accepted_subscribers_[ii]->Deliver(&decoded, frame_timestamp_);
+		if (delivery_ns > 0)
+			tracer_.Record(READER_SHARD, TRACE_CALLBACK, delivery_ns, MonotonicNanoseconds(),
+				message_id, uint32_t(accepted_subscribers_[ii]->id()));
+		if (latency != NULL) {
+			uint64_t delivered_us = MonotonicMicroseconds();
+			latency->stages[LATENCY_CALLBACK].Record(delivered_us - delivery_us);
+			delivery_us = delivered_us;
+		}
+	}
 }
 
 
@@ -939,270 +3667,106 @@ void Novatel::ParseBinary(unsigned char *message, size_t length, BINARY_LOG_TYPE
     //stringstream output;
     //output << "Parsing Log: " << message_id << endl;
     //log_debug_(output.str());
-		uint16_t payload_length;
-		uint16_t header_length;
-
-		// obtain the received crc
-		// for (int)
 
     switch (message_id) {
         case BESTGPSPOS_LOG_TYPE:
-            Position best_gps;
-
-            memcpy(&best_gps, message, sizeof(best_gps));
-            if (best_gps_position_callback_)
-            	best_gps_position_callback_(best_gps, read_timestamp_);
+            Dispatch<Position>(message, length, message_id);
             break;
         case BESTLEVERARM_LOG_TYPE:
-            BestLeverArm best_lever;
-            memcpy(&best_lever, message, sizeof(best_lever));
-            if (best_lever_arm_callback_)
-            	best_lever_arm_callback_(best_lever, read_timestamp_);
+            Dispatch<BestLeverArm>(message, length, message_id);
             break;
         case BESTPOSB_LOG_TYPE:
-            Position best_pos;
-            memcpy(&best_pos, message, sizeof(best_pos));
-            if (best_position_callback_)
-            	best_position_callback_(best_pos, read_timestamp_);
+            Dispatch<Position>(message, length, message_id);
             break;
         case BESTUTMB_LOG_TYPE:
-            UtmPosition best_utm;
-            memcpy(&best_utm, message, sizeof(best_utm));
-            if (best_utm_position_callback_)
-           		best_utm_position_callback_(best_utm, read_timestamp_);
+            Dispatch<UtmPosition>(message, length, message_id);
             break;
         case BESTVELB_LOG_TYPE:
-            Velocity best_vel;
-            memcpy(&best_vel, message, sizeof(best_vel));
-            if (best_velocity_callback_)
-            	best_velocity_callback_(best_vel, read_timestamp_);
+            Dispatch<Velocity>(message, length, message_id);
             break;
         case BESTXYZB_LOG_TYPE:
-            PositionEcef best_xyz;
-            memcpy(&best_xyz, message, sizeof(best_xyz));
-            if (best_position_ecef_callback_)
-            	best_position_ecef_callback_(best_xyz, read_timestamp_);
+            Dispatch<PositionEcef>(message, length, message_id);
             break;
         case INSPVA_LOG_TYPE:
-            InsPositionVelocityAttitude ins_pva;
-            memcpy(&ins_pva, message, sizeof(ins_pva));
-            if (ins_position_velocity_attitude_callback_)
-            	ins_position_velocity_attitude_callback_(ins_pva, read_timestamp_);
+            Dispatch<InsPositionVelocityAttitude>(message, length, message_id);
             break;
         case INSPVAS_LOG_TYPE:
-            InsPositionVelocityAttitudeShort ins_pva_short;
-            memcpy(&ins_pva, message, sizeof(ins_pva_short));
-            if (ins_position_velocity_attitude_short_callback_)
-            	ins_position_velocity_attitude_short_callback_(ins_pva_short, read_timestamp_);
+            Dispatch<InsPositionVelocityAttitudeShort>(message, length, message_id);
             break;
         case VEHICLEBODYROTATION_LOG_TYPE:
-            VehicleBodyRotation vehicle_body_rotation;
-            memcpy(&vehicle_body_rotation, message, sizeof(vehicle_body_rotation));
-            if (vehicle_body_rotation_callback_)
-            	vehicle_body_rotation_callback_(vehicle_body_rotation, read_timestamp_);
+            Dispatch<VehicleBodyRotation>(message, length, message_id);
             break;
         case INSSPD_LOG_TYPE:
-            InsSpeed ins_speed;
-            memcpy(&ins_speed, message, sizeof(ins_speed));
-            if (ins_speed_callback_)
-            	ins_speed_callback_(ins_speed, read_timestamp_);
+            Dispatch<InsSpeed>(message, length, message_id);
             break;
         case RAWIMU_LOG_TYPE:
-            RawImu raw_imu;
-            memcpy(&raw_imu, message, sizeof(raw_imu));
-            if (raw_imu_callback_)
-            	raw_imu_callback_(raw_imu, read_timestamp_);
+            Dispatch<RawImu>(message, length, message_id);
             break;
         case RAWIMUS_LOG_TYPE:
-            RawImuShort raw_imu_s;
-            memcpy(&raw_imu_s, message, sizeof(raw_imu_s));
-            if (raw_imu_short_callback_)
-            	raw_imu_short_callback_(raw_imu_s, read_timestamp_);
+            Dispatch<RawImuShort>(message, length, message_id);
             break;
         case INSCOV_LOG_TYPE:
-            InsCovariance ins_cov;
-            memcpy(&ins_cov, message, sizeof(ins_cov));
-            if (ins_covariance_callback_)
-            	ins_covariance_callback_(ins_cov, read_timestamp_);
+            Dispatch<InsCovariance>(message, length, message_id);
             break;
         case INSCOVS_LOG_TYPE:
-            InsCovarianceShort ins_cov_s;
-            memcpy(&ins_cov_s, message, sizeof(ins_cov_s));
-            if (ins_covariance_short_callback_)
-            	ins_covariance_short_callback_(ins_cov_s, read_timestamp_);
+            Dispatch<InsCovarianceShort>(message, length, message_id);
             break;
         case PSRDOPB_LOG_TYPE:
-            Dop psr_dop;
-            header_length = (uint16_t) *(message+3);
-            payload_length = (((uint16_t) *(message+9)) << 8) + ((uint16_t) *(message+8));
-
-            // Copy header and unrepeated fields
-            memcpy(&psr_dop, message, header_length+24);
-            //Copy repeated fields
-            memcpy(&psr_dop.prn, message+header_length+28, (4*psr_dop.number_of_prns));
-            //Copy CRC
-            memcpy(&psr_dop.crc, message+header_length+payload_length, 4);
-
-            if (pseudorange_dop_callback_)
-            	pseudorange_dop_callback_(psr_dop, read_timestamp_);
+            Dispatch<Dop>(message, length, message_id);
             break;
         case RTKDOPB_LOG_TYPE:
-            Dop rtk_dop;
-            memcpy(&rtk_dop, message, sizeof(rtk_dop));
-            if (rtk_dop_callback_)
-            	rtk_dop_callback_(rtk_dop, read_timestamp_);
+            Dispatch<Dop>(message, length, message_id);
             break;
         case BSLNXYZ_LOG_TYPE:
-            BaselineEcef baseline_xyz;
-            memcpy(&baseline_xyz, message, sizeof(baseline_xyz));
-            if (baseline_ecef_callback_)
-            	baseline_ecef_callback_(baseline_xyz, read_timestamp_);
+            Dispatch<BaselineEcef>(message, length, message_id);
             break;
         case IONUTCB_LOG_TYPE:
-            IonosphericModel ion;
-            memcpy(&ion, message, sizeof(ion));
-            if (ionospheric_model_callback_)
-            	ionospheric_model_callback_(ion, read_timestamp_);
+            Dispatch<IonosphericModel>(message, length, message_id);
             break;
         case RANGEB_LOG_TYPE:
-            RangeMeasurements ranges;
-            header_length = (uint16_t) *(message+3);
-            payload_length = (((uint16_t) *(message+9)) << 8) + ((uint16_t) *(message+8));
-
-            // Copy header and #observations following
-            memcpy(&ranges, message, header_length+4);
-            //Copy repeated fields
-            memcpy(&ranges.range_data, message+header_length+4, (44*ranges.number_of_observations));
-            //Copy CRC
-            memcpy(&ranges.crc, message+header_length+payload_length, 4);
-
-            if (range_measurements_callback_)
-            	range_measurements_callback_(ranges, read_timestamp_);
+            Dispatch<RangeMeasurements>(message, length, message_id);
             break;
-        case RANGECMPB_LOG_TYPE: {
-	          CompressedRangeMeasurements cmp_ranges;
-	        	header_length = (uint16_t) *(message+3);
-	        	payload_length = (((uint16_t) *(message+9)) << 8) + ((uint16_t) *(message+8));
-	        	// unsigned long crc_of_received = CalculateBlockCRC32(length-4, message);
-	        	
-	        	// std::stringstream asdf;
-	        	// asdf << "------\nheader_length: " << header_length << "\npayload_length: " << payload_length << "\n";
-	        	// asdf << "length idx: " << length << "\nsizeof: " << sizeof(cmp_ranges) << "\n";
-	        	//asdf << "crc of received: " << crc_of_received << "\n";
-	        	// log_info_(asdf.str().c_str()); asdf.str("");
-
-	        	//Copy header and unrepeated message block
-	        	memcpy(&cmp_ranges.header,message, header_length);
-	        	memcpy(&cmp_ranges.number_of_observations, message+header_length, 4);
-	        	// Copy Repeated portion of message block)
-                memcpy(&cmp_ranges.range_data, message+header_length+4, (24*cmp_ranges.number_of_observations));
-	        	// Copy the CRC
-	        	memcpy(&cmp_ranges.crc, message+header_length+payload_length, 4);
-	          
-	        	// asdf << "sizeof after memcpy : " << sizeof(cmp_ranges) << "\n";
-	        	// asdf << "crc after shoving: " ;
-						// log_info_(asdf.str().c_str()); asdf.str("");
-						// printHex((char*)cmp_ranges.crc,4);
-	        	// asdf << "\nMessage from BufferIncomingData\n";
-	        	// log_info_(asdf.str().c_str()); asdf.str("");
-	        	// printHex((char*)message,length);
-	        	
-	        	//printHex((char*)cmp_ranges.range_data[0],sizeof(24*((int32_t)*(message+header_length))));
-
-	            // memcpy(&cmp_ranges, message, length);
-	            if (compressed_range_measurements_callback_)
-		            	compressed_range_measurements_callback_(cmp_ranges, read_timestamp_);
-	            break;
-          }
-        case GPSEPHEMB_LOG_TYPE: {
-            GpsEphemeris ephemeris;
-            if (length>sizeof(ephemeris)) {
-            	std::stringstream ss;
-            	ss << "Novatel Driver: GpsEphemeris mismatch\n";
-            	ss << "\tlength = " << length << "\n";
-	            ss << "\tsizeof msg = " << sizeof(ephemeris);
-	            log_warning_(ss.str().c_str());
-	          } else {
-	            memcpy(&ephemeris, message, sizeof(ephemeris));
-	            if (gps_ephemeris_callback_)
-	            	gps_ephemeris_callback_(ephemeris, read_timestamp_);
-	          }
+        case RANGECMPB_LOG_TYPE:
+            Dispatch<CompressedRangeMeasurements>(message, length, message_id);
+            break;
+        case GPSEPHEMB_LOG_TYPE:
+            Dispatch<GpsEphemeris>(message, length, message_id);
             break;
-        }
         case RAWEPHEMB_LOG_TYPE:
-            RawEphemeris raw_ephemeris;
-            memcpy(&raw_ephemeris, message, sizeof(raw_ephemeris));
-            if (raw_ephemeris_callback_)
-                raw_ephemeris_callback_(raw_ephemeris, read_timestamp_);
+            Dispatch<RawEphemeris>(message, length, message_id);
             break;
         case SATXYZB_LOG_TYPE:
-            SatellitePositions sat_pos;
-            header_length = (uint16_t) *(message+3);
-            payload_length = (((uint16_t) *(message+9)) << 8) + ((uint16_t) *(message+8));
-
-            // Copy header and unrepeated part of message
-            memcpy(&sat_pos, message, header_length+12);
-            //Copy repeated fields
-            memcpy(&sat_pos.data, message+header_length+12, (68*sat_pos.number_of_satellites));
-            //Copy CRC
-            memcpy(&ranges.crc, message+header_length+payload_length, 4);
-
-            if (satellite_positions_callback_)
-            	satellite_positions_callback_(sat_pos, read_timestamp_);
+            Dispatch<SatellitePositions>(message, length, message_id);
             break;
         case SATVISB_LOG_TYPE:
-            SatelliteVisibility sat_vis;
-            header_length = (uint16_t) *(message+3);
-            payload_length = (((uint16_t) *(message+9)) << 8) + ((uint16_t) *(message+8));
-
-            // Copy header and unrepeated part of message
-            memcpy(&sat_pos, message, header_length+12);
-            //Copy repeated fields
-            memcpy(&sat_vis.data, message+header_length+12, (40*sat_vis.number_of_satellites));
-            //Copy CRC
-            memcpy(&ranges.crc, message+header_length+payload_length, 4);
-
-            if(satellite_visibility_callback_)
-                satellite_visibility_callback_(sat_vis, read_timestamp_);
+            Dispatch<SatelliteVisibility>(message, length, message_id);
             break;
         case TIMEB_LOG_TYPE:
-            TimeOffset time_offset;
-            memcpy(&time_offset, message, sizeof(time_offset));
-            if (time_offset_callback_)
-            	time_offset_callback_(time_offset, read_timestamp_);
+            Dispatch<TimeOffset>(message, length, message_id);
             break;
         case TRACKSTATB_LOG_TYPE:
-            TrackStatus tracking_status;
-            header_length = (uint16_t) *(message+3);
-            payload_length = (((uint16_t) *(message+9)) << 8) + ((uint16_t) *(message+8));
-
-            // Copy header and unrepeated part of message
-            memcpy(&tracking_status, message, header_length+16);
-            //Copy repeated fields
-            memcpy(&tracking_status.data, message+header_length+16, (40*tracking_status.number_of_channels));
-            //Copy CRC
-            memcpy(&tracking_status.crc, message+header_length+payload_length, 4);
-
-            if(tracking_status_callback_)
-                tracking_status_callback_(tracking_status, read_timestamp_);
+            Dispatch<TrackStatus>(message, length, message_id);
             break;
         case RXHWLEVELSB_LOG_TYPE:
-            ReceiverHardwareStatus hw_levels;
-            memcpy(&hw_levels, message, sizeof(hw_levels));
-            if (receiver_hardware_status_callback_)
-            	receiver_hardware_status_callback_(hw_levels, read_timestamp_);
+            Dispatch<ReceiverHardwareStatus>(message, length, message_id);
             break;
         case PSRPOSB_LOG_TYPE:
-            Position psr_pos;
-            memcpy(&psr_pos, message, sizeof(psr_pos));
-            if (best_pseudorange_position_callback_)
-            	best_pseudorange_position_callback_(psr_pos, read_timestamp_);
+            Dispatch<Position>(message, length, message_id);
             break;
         case RTKPOSB_LOG_TYPE:
-            Position rtk_pos;
-            memcpy(&rtk_pos, message, sizeof(rtk_pos));
-            if (rtk_position_callback_)
-            	rtk_position_callback_(rtk_pos, read_timestamp_);
+            Dispatch<Position>(message, length, message_id);
+            break;
+        case VERSIONB_LOG_TYPE:
+            Dispatch<Version>(message, length, message_id);
+            break;
+        case RXSTATUSB_LOG_TYPE:
+            Dispatch<RXStatus>(message, length, message_id);
+            break;
+        case RXCONFIGB_LOG_TYPE:
+            Dispatch<ReceiverConfiguration>(message, length, message_id);
+            break;
+        case LOGLISTB_LOG_TYPE:
+            Dispatch<LogList>(message, length, message_id);
             break;
         default:
             break;
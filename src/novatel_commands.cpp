@@ -0,0 +1,76 @@
+#include "novatel/novatel_commands.h"
+#include <cstring>
+
+// defined in novatel.cpp
+unsigned long CalculateBlockCRC32(unsigned long ulCount, unsigned char *ucBuffer);
+
+using namespace novatel;
+
+std::string novatel::EncodeCommand(BINARY_COMMAND_ID command_id, const void *body,
+                                   size_t body_length) {
+    Oem4BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    header.sync1 = 0xAA;
+    header.sync2 = 0x44;
+    header.sync3 = 0x12;
+    header.header_length = HEADER_SIZE;
+    header.message_id = command_id;
+    header.message_type = 0;    // binary, not a response
+    header.port_address = THISPORT_ADDRESS;
+    header.message_length = body_length;
+
+    std::string message(HEADER_SIZE + body_length + 4, '\0');
+    unsigned char *data = (unsigned char*) &message[0];
+    memcpy(data, &header, HEADER_SIZE);
+    if (body_length > 0)
+        memcpy(data + HEADER_SIZE, body, body_length);
+    uint32_t crc = CalculateBlockCRC32(HEADER_SIZE + body_length, data);
+    memcpy(data + HEADER_SIZE + body_length, &crc, 4);
+    return message;
+}
+
+std::string novatel::EncodeLogCommand(BINARY_LOG_TYPE log_type, LogMode trigger,
+                                      double period, double offset, bool hold) {
+    LogCommand log;
+    log.port = THISPORT_ADDRESS;
+    log.message_id = log_type;
+    log.message_type = 0;
+    log.reserved = 0;
+    log.trigger = trigger;
+    log.period = period;
+    log.offset = offset;
+    log.hold = hold ? 1 : 0;
+    return EncodeCommand(LOG_CMD_ID, log);
+}
+
+std::string novatel::EncodeUnlogCommand(BINARY_LOG_TYPE log_type, uint8_t message_type) {
+    UnlogCommand unlog;
+    unlog.port = THISPORT_ADDRESS;
+    unlog.message_id = log_type;
+    unlog.message_type = message_type;
+    unlog.reserved = 0;
+    return EncodeCommand(UNLOG_CMD_ID, unlog);
+}
+
+bool novatel::DecodeResponse(const unsigned char *message, size_t length,
+                             BinaryResponse *response) {
+    if ((length < HEADER_SIZE + 8) || (message[3] != HEADER_SIZE) ||
+        !(message[6] & RESPONSE_BIT))
+        return false;
+    size_t body_length = (((uint16_t) message[9]) << 8) + message[8];
+    if ((body_length < 4) || (HEADER_SIZE + body_length + 4 > length))
+        return false;
+
+    uint32_t crc;
+    memcpy(&crc, message + HEADER_SIZE + body_length, 4);
+    if (crc != (uint32_t) CalculateBlockCRC32(HEADER_SIZE + body_length,
+                                              (unsigned char*) message))
+        return false;
+
+    response->command_id = message[4] | (message[5] << 8);
+    memcpy(&response->response_id, message + HEADER_SIZE, 4);
+    // the text may be padded with nulls
+    const char *text = (const char*) message + HEADER_SIZE + 4;
+    response->message.assign(text, strnlen(text, body_length - 4));
+    return true;
+}
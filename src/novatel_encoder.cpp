@@ -0,0 +1,116 @@
+#include "novatel/novatel_encoder.h"
+#include <cstring>
+#include <algorithm>
+
+// defined in novatel.cpp
+unsigned long CalculateBlockCRC32(unsigned long ulCount, unsigned char *ucBuffer);
+
+using namespace novatel;
+
+static void AppendCRC(std::string &message) {
+    uint32_t crc = CalculateBlockCRC32(message.size(), (unsigned char*)&message[0]);
+    message.append((const char*)&crc, 4);
+}
+
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const void *message, size_t body_length) {
+    std::string encoded((const char*)message, HEADER_SIZE + body_length);
+    Oem4BinaryHeader *header = (Oem4BinaryHeader*)&encoded[0];
+    header->sync1 = 0xAA;
+    header->sync2 = 0x44;
+    header->sync3 = 0x12;
+    header->header_length = HEADER_SIZE;
+    header->message_id = log_type;
+    header->message_length = body_length;
+    AppendCRC(encoded);
+    return encoded;
+}
+
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const void *message, size_t fixed_length,
+                               const void *records, size_t record_size, uint32_t number_of_records) {
+    size_t body_length = fixed_length + number_of_records*record_size;
+    std::string encoded((const char*)message, HEADER_SIZE + fixed_length);
+    encoded.append((const char*)records, number_of_records*record_size);
+    memcpy(&encoded[HEADER_SIZE + fixed_length - 4], &number_of_records, 4);
+    Oem4BinaryHeader *header = (Oem4BinaryHeader*)&encoded[0];
+    header->sync1 = 0xAA;
+    header->sync2 = 0x44;
+    header->sync3 = 0x12;
+    header->header_length = HEADER_SIZE;
+    header->message_id = log_type;
+    header->message_length = body_length;
+    AppendCRC(encoded);
+    return encoded;
+}
+
+std::string novatel::EncodeShortLog(BINARY_LOG_TYPE log_type, const void *message, size_t body_length) {
+    std::string encoded((const char*)message, SHORT_HEADER_SIZE + body_length);
+    OEM4ShortBinaryHeader *header = (OEM4ShortBinaryHeader*)&encoded[0];
+    header->sync1 = 0xAA;
+    header->sync2 = 0x44;
+    header->sync3 = 0x13;
+    header->message_length = body_length;
+    header->message_id = log_type;
+    AppendCRC(encoded);
+    return encoded;
+}
+
+/* --------------------------------------------------------------------------
+Logs with a repeated block.  The lengths of the body before the block must
+agree with the DecodeMessage() overloads in novatel.cpp.
+-------------------------------------------------------------------------- */
+static uint32_t RecordCount(int64_t number_of_records, uint32_t max_records) {
+    return uint32_t(std::max<int64_t>(0, std::min<int64_t>(number_of_records, max_records)));
+}
+
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const Dop &message) {
+    return EncodeLog(log_type, &message, 28, message.prn, sizeof(message.prn[0]),
+                     RecordCount(message.number_of_prns, MAX_CHAN));
+}
+
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const RangeMeasurements &message) {
+    return EncodeLog(log_type, &message, 4, message.range_data, sizeof(RangeData),
+                     RecordCount(message.number_of_observations, MAX_CHAN));
+}
+
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const CompressedRangeMeasurements &message) {
+    return EncodeLog(log_type, &message, 4, message.range_data, sizeof(CompressedRangeData),
+                     RecordCount(message.number_of_observations, MAX_CHAN));
+}
+
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const SatellitePositions &message) {
+    return EncodeLog(log_type, &message, 12, message.data, sizeof(SatellitePositionData),
+                     RecordCount(message.number_of_satellites, MAX_CHAN));
+}
+
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const SatelliteVisibility &message) {
+    return EncodeLog(log_type, &message, 12, message.data, sizeof(SatelliteVisibilityData),
+                     RecordCount(message.number_of_satellites, MAX_CHAN));
+}
+
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const TrackStatus &message) {
+    return EncodeLog(log_type, &message, 16, message.data, sizeof(TrackStatusData),
+                     RecordCount(message.number_of_channels, MAX_CHAN));
+}
+
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const LogList &message) {
+    return EncodeLog(log_type, &message, 4, message.logs, sizeof(LogListEntry),
+                     RecordCount(message.number_of_logs, MAX_LOG_LIST));
+}
+
+// RXCONFIG carries the header, body and CRC of a command instead of records
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const ReceiverConfiguration &message) {
+    size_t command_length = std::min<size_t>(message.command_header.message_length + 4, MAX_RXCONFIG_LENGTH);
+    return EncodeLog(log_type, &message, HEADER_SIZE + command_length);
+}
+
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const InsPositionVelocityAttitudeShort &message) {
+    return EncodeShortLog(log_type, &message, sizeof(message) - SHORT_HEADER_SIZE - 4);
+}
+
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const RawImuShort &message) {
+    return EncodeShortLog(log_type, &message, sizeof(message) - SHORT_HEADER_SIZE - 4);
+}
+
+std::string novatel::EncodeLog(BINARY_LOG_TYPE log_type, const InsCovarianceShort &message) {
+    return EncodeShortLog(log_type, &message, sizeof(message) - SHORT_HEADER_SIZE - 4);
+}
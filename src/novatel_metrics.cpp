@@ -0,0 +1,266 @@
+#include "novatel/novatel_metrics.h"
+#include "novatel/novatel.h"
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <poll.h>
+
+using namespace novatel;
+
+MetricsRegistry::MetricsRegistry() {
+    for (size_t ii=0; ii<METRICS_SHARDS; ii++) {
+        for (size_t jj=0; jj<METRIC_COUNTERS; jj++)
+            shards_[ii].counters[jj] = 0;
+    }
+    round_trip_max_us_ = 0;
+    for (size_t ii=0; ii<MAX_LOG_ID; ii++)
+        log_frames_[ii] = 0;
+}
+
+void MetricsRegistry::AddRoundTrip(uint64_t round_trip_us) {
+    Add(SHARED_SHARD, METRIC_COMMAND_ROUND_TRIPS);
+    Add(SHARED_SHARD, METRIC_COMMAND_ROUND_TRIP_US, round_trip_us);
+    uint64_t max_us = round_trip_max_us_.load(boost::memory_order_relaxed);
+    while ((round_trip_us > max_us) &&
+        !round_trip_max_us_.compare_exchange_weak(max_us, round_trip_us, boost::memory_order_relaxed)) {}
+}
+
+void MetricsRegistry::Collect(MetricsSnapshot *snapshot) const {
+    for (size_t jj=0; jj<METRIC_COUNTERS; jj++) {
+        snapshot->counters[jj] = 0;
+        for (size_t ii=0; ii<METRICS_SHARDS; ii++)
+            snapshot->counters[jj] += shards_[ii].counters[jj].load(boost::memory_order_relaxed);
+    }
+    snapshot->command_round_trip_max_us = round_trip_max_us_.load(boost::memory_order_relaxed);
+    snapshot->log_frames.clear();
+    for (size_t ii=0; ii<MAX_LOG_ID; ii++) {
+        uint64_t frames = log_frames_[ii].load(boost::memory_order_relaxed);
+        if (frames > 0)
+            snapshot->log_frames[ii] = frames;
+    }
+}
+
+LatencyHistogram::LatencyHistogram() {
+    for (size_t ii=0; ii<LATENCY_BUCKETS; ii++)
+        counts_[ii] = 0;
+    sum_us_ = 0;
+    max_us_ = 0;
+}
+
+uint64_t LatencyHistogram::BucketTop(size_t index) {
+    if (index < LATENCY_SUB_BUCKETS)
+        return index;
+    int shift = index/LATENCY_SUB_BUCKETS - 1;
+    uint64_t bottom = uint64_t(LATENCY_SUB_BUCKETS + index%LATENCY_SUB_BUCKETS) << shift;
+    return bottom + (uint64_t(1) << shift) - 1;
+}
+
+LatencySummary LatencyHistogram::Summarize() const {
+    uint64_t counts[LATENCY_BUCKETS];
+    LatencySummary summary;
+    summary.count = 0;
+    for (size_t ii=0; ii<LATENCY_BUCKETS; ii++) {
+        counts[ii] = counts_[ii].load(boost::memory_order_relaxed);
+        summary.count += counts[ii];
+    }
+    summary.max_us = max_us_.load(boost::memory_order_relaxed);
+    summary.mean_us = summary.count ? double(sum_us_.load(boost::memory_order_relaxed))/summary.count : 0;
+
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    uint64_t *percentiles[] = {&summary.p50_us, &summary.p90_us, &summary.p99_us, &summary.p999_us};
+    size_t bucket = 0;
+    uint64_t seen = 0;
+    for (size_t ii=0; ii<4; ii++) {
+        // the rank of the quantile, rounded up so p100 is the last value
+        uint64_t rank = uint64_t(ceil(quantiles[ii]*summary.count));
+        if (rank == 0) {
+            *percentiles[ii] = 0;
+            continue;
+        }
+        while ((seen + counts[bucket] < rank) && (bucket < LATENCY_BUCKETS-1))
+            seen += counts[bucket++];
+        // the top of the last bucket may be past the largest value seen
+        *percentiles[ii] = std::min(BucketTop(bucket), summary.max_us);
+    }
+    return summary;
+}
+
+//! Name and help text of each counter, in MetricsCounter order
+static const struct {
+    const char *name;
+    const char *help;
+} COUNTER_INFO[METRIC_COUNTERS] = {
+    {"bytes_read_total", "Bytes read from the serial port."},
+    {"frames_total", "Binary logs and responses received."},
+    {"crc_failures_total", "Binary logs received with a bad CRC."},
+    {"resyncs_total", "Sync bytes not followed by the rest of a header."},
+    {"buffer_overflows_total", "Messages too long for the receive buffer."},
+    {"unknown_logs_total", "Binary logs the driver does not decode."},
+    {"bytes_written_total", "Bytes written to the serial port."},
+    {"commands_total", "Commands completed, whatever the result."},
+    {"command_errors_total", "Commands rejected by the receiver."},
+    {"command_timeouts_total", "Commands without a response."},
+    {NULL, NULL},  // written as a summary
+    {NULL, NULL},
+};
+
+static void WriteMetric(std::ostream &out, const std::string &name, const char *type,
+                        const char *help, double value) {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+    out << name << " " << value << "\n";
+}
+
+std::string novatel::FormatPrometheusMetrics(const MetricsSnapshot &snapshot, const std::string &prefix) {
+    std::stringstream out;
+    out.precision(15);
+    for (size_t ii=0; ii<METRIC_COUNTERS; ii++) {
+        if (COUNTER_INFO[ii].name != NULL)
+            WriteMetric(out, prefix + "_" + COUNTER_INFO[ii].name, "counter", COUNTER_INFO[ii].help,
+                double(snapshot.counters[ii]));
+    }
+
+    std::string name = prefix + "_log_frames_total";
+    out << "# HELP " << name << " Binary logs received, by log.\n";
+    out << "# TYPE " << name << " counter\n";
+    for (std::map<uint16_t, uint64_t>::const_iterator it = snapshot.log_frames.begin();
+            it != snapshot.log_frames.end(); ++it) {
+        const char *log_name = BinaryLogName(BINARY_LOG_TYPE(it->first));
+        out << name << "{id=\"" << it->first << "\"";
+        if (log_name != NULL)
+            out << ",log=\"" << log_name << "\"";
+        out << "} " << it->second << "\n";
+    }
+
+    static const char *STAGE_NAMES[LATENCY_STAGES] =
+        {"read_to_frame", "frame_to_decode", "decode_to_dispatch", "callback", "message_age"};
+    name = prefix + "_latency_seconds";
+    out << "# HELP " << name << " Time taken by each stage a binary log goes through, by log.\n";
+    out << "# TYPE " << name << " summary\n";
+    for (std::map<uint16_t, LogLatencySummary>::const_iterator it = snapshot.latencies.begin();
+            it != snapshot.latencies.end(); ++it) {
+        const char *log_name = BinaryLogName(BINARY_LOG_TYPE(it->first));
+        std::stringstream labels;
+        labels << "id=\"" << it->first << "\"";
+        if (log_name != NULL)
+            labels << ",log=\"" << log_name << "\"";
+        for (size_t ii=0; ii<LATENCY_STAGES; ii++) {
+            const LatencySummary &stage = it->second.stages[ii];
+            if (stage.count == 0)
+                continue;
+            std::string stage_labels = labels.str() + ",stage=\"" + STAGE_NAMES[ii] + "\"";
+            out << name << "{" << stage_labels << ",quantile=\"0.5\"} " << stage.p50_us/1e6 << "\n";
+            out << name << "{" << stage_labels << ",quantile=\"0.9\"} " << stage.p90_us/1e6 << "\n";
+            out << name << "{" << stage_labels << ",quantile=\"0.99\"} " << stage.p99_us/1e6 << "\n";
+            out << name << "{" << stage_labels << ",quantile=\"0.999\"} " << stage.p999_us/1e6 << "\n";
+            out << name << "_sum{" << stage_labels << "} " << stage.mean_us*stage.count/1e6 << "\n";
+            out << name << "_count{" << stage_labels << "} " << stage.count << "\n";
+        }
+    }
+
+    name = prefix + "_command_round_trip_seconds";
+    out << "# HELP " << name << " Time from queueing a command to its response.\n";
+    out << "# TYPE " << name << " summary\n";
+    out << name << "_sum " << snapshot.counters[METRIC_COMMAND_ROUND_TRIP_US]/1e6 << "\n";
+    out << name << "_count " << snapshot.counters[METRIC_COMMAND_ROUND_TRIPS] << "\n";
+    WriteMetric(out, prefix + "_command_round_trip_max_seconds", "gauge",
+        "Longest time from queueing a command to its response.", snapshot.command_round_trip_max_us/1e6);
+
+    WriteMetric(out, prefix + "_connected", "gauge", "1 while connected to the receiver.",
+        snapshot.connected ? 1 : 0);
+    WriteMetric(out, prefix + "_write_queue_depth", "gauge", "Commands waiting for the write thread.",
+        double(snapshot.write_queue_depth));
+    WriteMetric(out, prefix + "_correction_backlog_bytes", "gauge", "Correction bytes waiting for the write thread.",
+        double(snapshot.correction_backlog));
+    WriteMetric(out, prefix + "_pending_commands", "gauge", "Commands waiting for a response.",
+        double(snapshot.pending_commands));
+    WriteMetric(out, prefix + "_pending_queries", "gauge", "Queries waiting for their log.",
+        double(snapshot.pending_queries));
+    return out.str();
+}
+
+MetricsServer::MetricsServer() : listen_fd_(-1) {
+    serving_ = false;
+}
+
+MetricsServer::~MetricsServer() {
+    Stop();
+}
+
+bool MetricsServer::Start(const std::string &path, TextCallback text, std::string *error) {
+    Stop();
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || (path.size() >= sizeof(address.sun_path))) {
+        *error = "socket path empty or too long";
+        return false;
+    }
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path)-1);
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        *error = strerror(errno);
+        return false;
+    }
+    unlink(path.c_str());
+    if ((bind(listen_fd_, (sockaddr*)&address, sizeof(address)) < 0) || (listen(listen_fd_, 4) < 0)) {
+        *error = strerror(errno);
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    path_ = path;
+    text_ = text;
+    serving_ = true;
+    thread_ptr_.reset(new boost::thread(boost::bind(&MetricsServer::Serve, this)));
+    return true;
+}
+
+void MetricsServer::Stop() {
+    serving_ = false;
+    if (thread_ptr_) {
+        thread_ptr_->join();
+        thread_ptr_.reset();
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        unlink(path_.c_str());
+    }
+}
+
+void MetricsServer::Serve() {
+    while (serving_) {
+        // wake up now and then to see if the server was stopped
+        pollfd listener = {listen_fd_, POLLIN, 0};
+        if (poll(&listener, 1, 100) <= 0)
+            continue;
+        int client = accept(listen_fd_, NULL, NULL);
+        if (client < 0)
+            continue;
+        // a client that stops reading is given up on after a second, and
+        // sends time out often enough to see if the server was stopped
+        timeval send_timeout = {0, 100000};
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+        std::string text = text_();
+        size_t written = 0;
+        for (int timeouts=0; serving_ && (written < text.size()) && (timeouts < 10); ) {
+            ssize_t result = send(client, text.data()+written, text.size()-written, MSG_NOSIGNAL);
+            if ((result < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+                timeouts++;
+                continue;
+            }
+            if (result <= 0)
+                break;
+            written += result;
+        }
+        close(client);
+    }
+}
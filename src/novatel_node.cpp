@@ -454,6 +454,8 @@ public:
     this->psrpos_publisher_ = nh_.advertise<sensor_msgs::NavSatFix>(psrpos_topic_,0);
 
     //em_.setDataCallback(boost::bind(&EM61Node::HandleEmData, this, _1));
+    if (auto_baud_)
+      gps_.SetBandwidthPolicy(BANDWIDTH_RAISE_BAUD);
     gps_.Connect(port_,baudrate_);
 
     // configure default log sets
@@ -572,6 +574,9 @@ protected:
     nh_.param("baudrate", baudrate_, 9600);
     ROS_INFO_STREAM(name_ << ": Baudrate: " << baudrate_);
 
+    nh_.param("auto_baud", auto_baud_, false);
+    ROS_INFO_STREAM(name_ << ": Raise baudrate to fit logs: " << auto_baud_);
+
     nh_.param("log_commands", log_commands_, std::string("BESTUTMB ONTIME 1.0"));
     ROS_INFO_STREAM(name_ << ": Log Commands: " << log_commands_);
 
@@ -629,6 +634,7 @@ protected:
   double psrpos_default_logs_period_;
   std::string ephem_log_;
   int baudrate_;
+  bool auto_baud_;
   double poll_rate_;
 
   Velocity cur_velocity_;
@@ -0,0 +1,118 @@
+#include "novatel/novatel_trace.h"
+#include "novatel/novatel.h"
+#include <sstream>
+#include <algorithm>
+
+using namespace novatel;
+
+Tracer::Tracer() {
+    tracing_ = false;
+}
+
+Tracer::~Tracer() {
+    for (size_t ii=0; ii<METRICS_SHARDS; ii++)
+        delete [] rings_[ii].events;
+}
+
+void Tracer::Start(size_t events_per_thread) {
+    boost::lock_guard<boost::mutex> lock(start_mutex_);
+    if (rings_[0].capacity == 0) {
+        // a slot more than asked for, since a full ring gives up its oldest
+        size_t capacity = 1;
+        while (capacity < events_per_thread+1)
+            capacity <<= 1;
+        for (size_t ii=0; ii<METRICS_SHARDS; ii++) {
+            rings_[ii].events = new TraceEvent[capacity];
+            rings_[ii].capacity = capacity;
+        }
+    }
+    tracing_.store(true, boost::memory_order_release);
+}
+
+std::vector<TraceEvent> Tracer::Events(MetricsShard ring) const {
+    std::vector<TraceEvent> events;
+    boost::lock_guard<boost::mutex> lock(start_mutex_);
+    const Ring &source = rings_[ring];
+    if (source.capacity == 0)
+        return events;
+    // the owner writes the slot of event head before publishing it, and in
+    // a full ring that is the oldest slot, so it is never copied
+    uint64_t head = source.head.load(boost::memory_order_acquire);
+    uint64_t first = head >= source.capacity ? head - source.capacity + 1 : 0;
+    for (uint64_t ii=first; ii<head; ii++)
+        events.push_back(source.events[ii & (source.capacity-1)]);
+    // likewise drop the events the owner overwrote, or began to, while copying
+    head = source.head.load(boost::memory_order_acquire);
+    uint64_t valid = head >= source.capacity ? head - source.capacity + 1 : 0;
+    if (valid > first)
+        events.erase(events.begin(), events.begin() + std::min<uint64_t>(valid - first, events.size()));
+    return events;
+}
+
+static bool EarlierEvent(const std::pair<TraceEvent, size_t> &a, const std::pair<TraceEvent, size_t> &b) {
+    return a.first.start_ns < b.first.start_ns;
+}
+
+std::string Tracer::ChromeTraceJson() const {
+    static const char *THREAD_NAMES[METRICS_SHARDS] = {"novatel read", "novatel write", "novatel other"};
+    static const char *EVENT_NAMES[TRACE_EVENT_TYPES] =
+        {"read", "frame", "decode", "callback", "write", "command done"};
+
+    std::vector<std::pair<TraceEvent, size_t> > events;
+    for (size_t ii=0; ii<METRICS_SHARDS; ii++) {
+        std::vector<TraceEvent> ring = Events(MetricsShard(ii));
+        for (size_t jj=0; jj<ring.size(); jj++)
+            events.push_back(std::make_pair(ring[jj], ii));
+    }
+    std::stable_sort(events.begin(), events.end(), EarlierEvent);
+
+    std::stringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t ii=0; ii<METRICS_SHARDS; ii++) {
+        out << (ii ? ",\n" : "\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ii+1
+            << ",\"args\":{\"name\":\"" << THREAD_NAMES[ii] << "\"}}";
+    }
+    for (size_t ii=0; ii<events.size(); ii++) {
+        const TraceEvent &event = events[ii].first;
+        if (event.type >= TRACE_EVENT_TYPES)
+            continue;
+        const char *log_name = NULL;
+        if ((event.type == TRACE_FRAME) || (event.type == TRACE_DECODE) || (event.type == TRACE_CALLBACK))
+            log_name = BinaryLogName(BINARY_LOG_TYPE(event.id));
+        out << ",\n{\"name\":\"" << EVENT_NAMES[event.type];
+        if (log_name != NULL)
+            out << " " << log_name;
+        out << "\",\"cat\":\"novatel\",\"pid\":1,\"tid\":" << events[ii].second+1
+            << ",\"ts\":" << event.start_ns/1000.0;
+        if (event.duration_ns > 0)
+            out << ",\"ph\":\"X\",\"dur\":" << event.duration_ns/1000.0;
+        else
+            out << ",\"ph\":\"i\",\"s\":\"t\"";
+        out << ",\"args\":{";
+        switch (event.type) {
+            case TRACE_READ:
+                out << "\"bytes\":" << event.value;
+                break;
+            case TRACE_FRAME:
+                out << "\"id\":" << event.id << ",\"bytes\":" << event.value;
+                break;
+            case TRACE_DECODE:
+                out << "\"id\":" << event.id;
+                break;
+            case TRACE_CALLBACK:
+                out << "\"id\":" << event.id << ",\"subscriber\":" << event.value;
+                break;
+            case TRACE_WRITE:
+                out << "\"commands\":" << event.id << ",\"bytes\":" << event.value;
+                break;
+            case TRACE_COMMAND_DONE:
+                out << "\"status\":" << event.value;
+                break;
+        }
+        out << "}}";
+    }
+    out << "\n]}\n";
+    return out.str();
+}
@@ -0,0 +1,392 @@
+/*
+ * Benchmarks of the parts of the driver on the read thread: framing,
+ * CRCs, decoding and dispatch, run on the captures in tests/test_data.
+ *
+ * Throughput is reported as bytes_per_second (MB/s) and messages (per
+ * second).  To keep results to compare across versions:
+ *
+ *   novatel_benchmarks --benchmark_out=results.json --benchmark_out_format=json
+ *
+ * and compare two such files with compare.py from Google Benchmark.
+ *
+ * BM_SyntheticStream loads the decoder with logs at rates beyond the
+ * captures' (200 Hz INSPVA, 50 Hz RANGECMP with state.range(0)
+ * satellites); run it with --benchmark_min_time=30 to push gigabytes.
+ *
+ * The BM_Emulator ones run the whole driver against a receiver emulated on
+ * a pseudo terminal, in real time, so take some seconds each.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+#include "novatel/novatel_enums.h"
+#include "novatel/novatel_structures.h"
+#include "novatel_emulator.h"
+#include "novatel_generator.h"
+
+// reaches into the driver as the tests do
+#define private public
+#define protected public
+
+#include "novatel/novatel.h"
+using namespace novatel;
+
+unsigned long CalculateBlockCRC32(unsigned long ulCount, unsigned char *ucBuffer);
+
+#ifndef NOVATEL_TEST_DATA_DIR
+#define NOVATEL_TEST_DATA_DIR "test_data"
+#endif
+
+//! Counts every message handed to it
+class CountingSubscriber : public Subscriber
+{
+public:
+    CountingSubscriber(BINARY_LOG_TYPE log_type) : Subscriber(log_type), messages(0) {}
+    void Deliver(void *message, double timestamp) {messages++;}
+    uint64_t messages;
+};
+
+//! The binary messages in a capture, each from its sync bytes to its CRC
+static std::vector<std::string> SplitFrames(const std::string &data) {
+    std::vector<std::string> frames;
+    size_t index = 0;
+    while (index + 10 <= data.size()) {
+        if (((unsigned char)data[index] != 0xAA) || ((unsigned char)data[index+1] != 0x44) ||
+                ((unsigned char)data[index+2] != 0x12)) {
+            index++;
+            continue;
+        }
+        size_t length = (unsigned char)data[index+3] + 4 +
+            ((unsigned char)data[index+8] | ((unsigned char)data[index+9] << 8));
+        if (index + length > data.size())
+            break;
+        frames.push_back(data.substr(index, length));
+        index += length;
+    }
+    return frames;
+}
+
+static uint16_t FrameId(const std::string &frame) {
+    return (unsigned char)frame[4] | ((unsigned char)frame[5] << 8);
+}
+
+/*!
+ * Subscribes count counting subscribers to each log in frames, so every
+ * message is decoded and dispatched as it would be for an application
+ * using all of them.
+ */
+static std::vector<boost::shared_ptr<CountingSubscriber> > SubscribeAll(Novatel &gps,
+        const std::vector<std::string> &frames, size_t count=1) {
+    std::vector<boost::shared_ptr<CountingSubscriber> > subscribers;
+    boost::lock_guard<boost::mutex> lock(gps.subscribers_mutex_);
+    Novatel::SubscriberMap map(gps.subscribers_.load()->subscribers);
+    for (size_t ii=0; ii<frames.size(); ii++) {
+        BINARY_LOG_TYPE log_type = BINARY_LOG_TYPE(FrameId(frames[ii]));
+        if ((log_type >= MAX_LOG_ID) || map.count(log_type))
+            continue;
+        for (size_t jj=0; jj<count; jj++) {
+            boost::shared_ptr<CountingSubscriber> subscriber(new CountingSubscriber(log_type));
+            subscriber->set_id(gps.next_subscription_id_++);
+            map[log_type].push_back(subscriber);
+            subscribers.push_back(subscriber);
+        }
+    }
+    gps.PublishSubscribers(map);
+    gps.dispatch_subscribers_ = gps.subscribers_.load();
+    return subscribers;
+}
+
+static void IgnoreMessage(const std::string &message) {}
+
+//! A driver that keeps quiet about anything but errors, with no data callbacks
+static Novatel *QuietDriver() {
+    Novatel *gps = new Novatel();
+    gps->setLogDebugCallback(IgnoreMessage);
+    gps->setLogInfoCallback(IgnoreMessage);
+    gps->setLogWarningCallback(IgnoreMessage);
+    // the default one prints every position
+    gps->set_best_position_callback(BestPositionCallback());
+    return gps;
+}
+
+static std::string ReadFile(const std::string &path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+//! Feeds a whole capture to the framer chunk bytes at a time, as reads would
+static void FeedCapture(benchmark::State &state, const std::string &capture, size_t chunk) {
+    Novatel *gps = QuietDriver();
+    std::vector<std::string> frames = SplitFrames(capture);
+    SubscribeAll(*gps, frames);
+    std::string data = capture;
+    while (state.KeepRunning()) {
+        for (size_t offset = 0; offset < data.size(); offset += chunk)
+            gps->BufferIncomingData((unsigned char*)&data[offset], std::min(chunk, data.size()-offset));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations())*data.size());
+    state.counters["messages"] = benchmark::Counter(double(state.iterations())*frames.size(),
+        benchmark::Counter::kIsRate);
+    delete gps;
+}
+
+static void BM_BufferIncomingData(benchmark::State &state, std::string capture) {
+    // the largest read the read thread does
+    FeedCapture(state, capture, MAX_NOUT_SIZE);
+}
+
+static void BM_ChunkSize(benchmark::State &state, std::string capture) {
+    FeedCapture(state, capture, state.range(0));
+}
+
+static void BM_CRC32(benchmark::State &state) {
+    std::vector<unsigned char> block(state.range(0));
+    for (size_t ii=0; ii<block.size(); ii++)
+        block[ii] = (unsigned char)(ii*131);
+    while (state.KeepRunning())
+        benchmark::DoNotOptimize(CalculateBlockCRC32(block.size(), &block[0]));
+    state.SetBytesProcessed(int64_t(state.iterations())*block.size());
+}
+BENCHMARK(BM_CRC32)->RangeMultiplier(4)->Range(16, 8192);
+
+//! Decoding and dispatching one message of a log to a subscriber
+static void BM_ParseBinary(benchmark::State &state, std::string frame) {
+    Novatel *gps = QuietDriver();
+    SubscribeAll(*gps, std::vector<std::string>(1, frame));
+    while (state.KeepRunning())
+        gps->ParseBinary((unsigned char*)&frame[0], frame.size(), BINARY_LOG_TYPE(FrameId(frame)));
+    state.SetBytesProcessed(int64_t(state.iterations())*frame.size());
+    state.counters["messages"] = benchmark::Counter(double(state.iterations()), benchmark::Counter::kIsRate);
+    delete gps;
+}
+
+//! Cost of each subscriber to a log, against BM_ParseBinary's one
+static void BM_Dispatch(benchmark::State &state, std::string frame) {
+    Novatel *gps = QuietDriver();
+    SubscribeAll(*gps, std::vector<std::string>(1, frame), state.range(0));
+    while (state.KeepRunning())
+        gps->ParseBinary((unsigned char*)&frame[0], frame.size(), BINARY_LOG_TYPE(FrameId(frame)));
+    state.counters["messages"] = benchmark::Counter(double(state.iterations()), benchmark::Counter::kIsRate);
+    delete gps;
+}
+
+static void BM_ConvertLLaUTM(benchmark::State &state) {
+    Novatel *gps = QuietDriver();
+    double northing, easting;
+    int zone;
+    bool north;
+    double latitude = 32.6;
+    while (state.KeepRunning()) {
+        gps->ConvertLLaUTM(latitude, -85.5, &northing, &easting, &zone, &north);
+        benchmark::DoNotOptimize(northing);
+        benchmark::DoNotOptimize(easting);
+    }
+    delete gps;
+}
+BENCHMARK(BM_ConvertLLaUTM);
+
+//! Connect, from opening the port to the receiver's version and log list
+static void BM_EmulatorConnect(benchmark::State &state, std::string capture) {
+    ReceiverEmulator emulator;
+    emulator.LoadCapture(capture);
+    emulator.Start(state.range(0));
+    Novatel *gps = QuietDriver();
+    gps->SetAutoReconnect(false);
+    while (state.KeepRunning()) {
+        if (!gps->Connect(emulator.port(), state.range(0), false)) {
+            state.SkipWithError("could not connect to the emulator");
+            break;
+        }
+        state.PauseTiming();
+        gps->Disconnect();
+        state.ResumeTiming();
+    }
+    delete gps;
+}
+
+/*!
+ * Age of BESTPOSB at each stage, from the time the emulator stamped on it,
+ * streamed at state.range(0) Hz with state.range(1) per million bits flipped
+ */
+static void BM_EmulatorStream(benchmark::State &state, std::string capture) {
+    ReceiverEmulator emulator;
+    emulator.LoadCapture(capture);
+    emulator.Start(115200);
+    EmulatorFaults faults;
+    faults.bit_flip_probability = state.range(1)*8e-6;
+    emulator.SetFaults(faults);
+    Novatel *gps = QuietDriver();
+    gps->SetAutoReconnect(false);
+    if (!gps->Connect(emulator.port(), 115200, false)) {
+        state.SkipWithError("could not connect to the emulator");
+        delete gps;
+        return;
+    }
+    boost::shared_ptr<CountingSubscriber> subscriber(new CountingSubscriber(BESTPOSB_LOG_TYPE));
+    gps->AddSubscriber(subscriber, typeid(Position));
+    std::ostringstream log;
+    log << "BESTPOSB ONTIME " << 1.0/state.range(0);
+    gps->ConfigureLogs(log.str());
+    double seconds = 0;
+    while (state.KeepRunning()) {
+        boost::this_thread::sleep(boost::posix_time::seconds(2));
+        seconds += 2;
+    }
+    MetricsSnapshot metrics = gps->GetMetrics();
+    LatencySummary age = gps->GetLatency(BESTPOSB_LOG_TYPE, LATENCY_MESSAGE_AGE);
+    LatencySummary dispatch = gps->GetLatency(BESTPOSB_LOG_TYPE, LATENCY_DECODE_TO_DISPATCH);
+    gps->Disconnect();
+    state.counters["messages"] = double(subscriber->messages)/seconds;
+    state.counters["crc_failures"] = double(metrics.counters[METRIC_CRC_FAILURES]);
+    state.counters["age_p50_us"] = age.p50_us;
+    state.counters["age_p99_us"] = age.p99_us;
+    state.counters["dispatch_p99_us"] = dispatch.p99_us;
+    delete gps;
+}
+
+//! INSPVA at 200 Hz, RANGECMP at 50 Hz with satellites records and BESTPOSB at 20 Hz
+static SyntheticStreamConfig HeavyStream(uint32_t satellites) {
+    SyntheticStreamConfig config;
+    config.satellites = satellites;
+    config.rates[INSPVA_LOG_TYPE] = 200;
+    config.rates[RANGECMPB_LOG_TYPE] = 50;
+    config.rates[BESTPOSB_LOG_TYPE] = 20;
+    return config;
+}
+
+static void BM_GenerateStream(benchmark::State &state) {
+    SyntheticStream stream(HeavyStream(state.range(0)));
+    std::string data;
+    uint64_t bytes = 0;
+    while (state.KeepRunning()) {
+        data.clear();
+        stream.Generate(data, 1 << 20);
+        bytes += data.size();
+    }
+    state.SetBytesProcessed(bytes);
+    state.counters["messages"] = benchmark::Counter(double(stream.logs()), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_GenerateStream)->Arg(12)->Arg(100)->Unit(benchmark::kMillisecond);
+
+//! Framing, decoding and dispatching a minute of the heavy stream, read MAX_NOUT_SIZE at a time
+static void BM_SyntheticStream(benchmark::State &state) {
+    SyntheticStream stream(HeavyStream(state.range(0)));
+    std::string data;
+    while (stream.time() < 60)
+        data += stream.Next();
+    Novatel *gps = QuietDriver();
+    std::vector<std::string> frames = SplitFrames(data);
+    SubscribeAll(*gps, frames);
+    while (state.KeepRunning()) {
+        for (size_t offset = 0; offset < data.size(); offset += MAX_NOUT_SIZE)
+            gps->BufferIncomingData((unsigned char*)&data[offset], std::min<size_t>(MAX_NOUT_SIZE, data.size()-offset));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations())*data.size());
+    state.counters["messages"] = benchmark::Counter(double(state.iterations())*frames.size(),
+        benchmark::Counter::kIsRate);
+    delete gps;
+}
+BENCHMARK(BM_SyntheticStream)->Arg(12)->Arg(100)->Unit(benchmark::kMillisecond);
+
+/*!
+ * The heavy stream with 28 satellites through the emulator at 921600
+ * baud, its fastest rate, as logs delivered per second and dropped by it
+ */
+static void BM_EmulatorSynthetic(benchmark::State &state) {
+    ReceiverEmulator emulator;
+    SyntheticStream stream(HeavyStream(MAX_CHAN));
+    while (stream.time() < 1)
+        emulator.AddFrame(stream.Next());
+    emulator.Start(921600);
+    Novatel *gps = QuietDriver();
+    gps->SetAutoReconnect(false);
+    if (!gps->Connect(emulator.port(), 921600, false)) {
+        state.SkipWithError("could not connect to the emulator");
+        delete gps;
+        return;
+    }
+    std::vector<boost::shared_ptr<CountingSubscriber> > subscribers;
+    BINARY_LOG_TYPE logs[] = {INSPVA_LOG_TYPE, RANGECMPB_LOG_TYPE, BESTPOSB_LOG_TYPE};
+    const std::type_info *types[] = {&typeid(InsPositionVelocityAttitude),
+        &typeid(CompressedRangeMeasurements), &typeid(Position)};
+    for (size_t ii=0; ii<3; ii++) {
+        subscribers.push_back(boost::shared_ptr<CountingSubscriber>(new CountingSubscriber(logs[ii])));
+        gps->AddSubscriber(subscribers.back(), *types[ii]);
+    }
+    gps->ConfigureLogs("INSPVAB ONTIME 0.005;RANGECMPB ONTIME 0.02;BESTPOSB ONTIME 0.05");
+    double seconds = 0;
+    while (state.KeepRunning()) {
+        boost::this_thread::sleep(boost::posix_time::seconds(2));
+        seconds += 2;
+    }
+    gps->Disconnect();
+    uint64_t messages = 0;
+    for (size_t ii=0; ii<subscribers.size(); ii++)
+        messages += subscribers[ii]->messages;
+    state.counters["messages"] = double(messages)/seconds;
+    state.counters["dropped"] = double(emulator.GetStatistics().logs_dropped)/seconds;
+    state.counters["crc_failures"] = double(gps->GetMetrics().counters[METRIC_CRC_FAILURES]);
+    delete gps;
+}
+BENCHMARK(BM_EmulatorSynthetic)->Unit(benchmark::kMillisecond)->Iterations(2);
+
+int main(int argc, char **argv) {
+    benchmark::Initialize(&argc, argv);
+
+    // the benchmarks on captures are registered for each one found
+    std::string data_dir = NOVATEL_TEST_DATA_DIR;
+    if (!boost::filesystem::is_directory(data_dir)) {
+        std::cerr << "No test data in " << data_dir << std::endl;
+        return 1;
+    }
+    std::vector<std::string> captures;
+    for (boost::filesystem::directory_iterator it(data_dir); it != boost::filesystem::directory_iterator(); ++it) {
+        if (it->path().extension() == ".GPS")
+            captures.push_back(it->path().string());
+    }
+    std::sort(captures.begin(), captures.end());
+
+    std::map<uint16_t, std::string> examples;  // first message of each log
+    std::string largest;
+    std::string positions;  // first capture with BESTPOSB in it, for the emulator
+    for (size_t ii=0; ii<captures.size(); ii++) {
+        std::string capture = ReadFile(captures[ii]);
+        std::string name = boost::filesystem::path(captures[ii]).stem().string();
+        benchmark::RegisterBenchmark(("BM_BufferIncomingData/" + name).c_str(), BM_BufferIncomingData, capture);
+        std::vector<std::string> frames = SplitFrames(capture);
+        for (size_t jj=0; jj<frames.size(); jj++) {
+            if (!examples.count(FrameId(frames[jj])))
+                examples[FrameId(frames[jj])] = frames[jj];
+            if ((FrameId(frames[jj]) == BESTPOSB_LOG_TYPE) && positions.empty())
+                positions = captures[ii];
+        }
+        if (capture.size() > largest.size())
+            largest = capture;
+    }
+    if (!largest.empty()) {
+        benchmark::RegisterBenchmark("BM_ChunkSize", BM_ChunkSize, largest)->RangeMultiplier(4)->Range(1, 8192);
+    }
+    for (std::map<uint16_t, std::string>::const_iterator it = examples.begin(); it != examples.end(); ++it) {
+        // logs without a name are not decoded
+        const char *log_name = BinaryLogName(BINARY_LOG_TYPE(it->first));
+        if (log_name != NULL)
+            benchmark::RegisterBenchmark((std::string("BM_ParseBinary/") + log_name).c_str(),
+                BM_ParseBinary, it->second);
+    }
+    if (examples.count(BESTPOSB_LOG_TYPE)) {
+        benchmark::RegisterBenchmark("BM_Dispatch/BESTPOSB", BM_Dispatch, examples[BESTPOSB_LOG_TYPE])
+            ->Arg(1)->Arg(4)->Arg(16);
+    }
+    if (!positions.empty()) {
+        benchmark::RegisterBenchmark("BM_EmulatorConnect", BM_EmulatorConnect, positions)
+            ->Arg(9600)->Arg(115200)->Unit(benchmark::kMillisecond)->Iterations(5);
+        benchmark::RegisterBenchmark("BM_EmulatorStream", BM_EmulatorStream, positions)
+            ->ArgPair(20, 0)->ArgPair(20, 100)->ArgPair(100, 0)->Unit(benchmark::kMillisecond)->Iterations(2);
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
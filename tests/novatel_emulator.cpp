@@ -0,0 +1,547 @@
+#include "novatel_emulator.h"
+#include "novatel/novatel.h"
+#include "novatel/novatel_commands.h"
+#include "novatel/novatel_encoder.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+// defined in novatel.cpp
+unsigned long CalculateBlockCRC32(unsigned long ulCount, unsigned char *ucBuffer);
+
+using namespace novatel;
+
+//! Address of COM1 in message headers, the port the emulator stands in for
+static const uint8_t COM1_ADDRESS = 0x20;
+//! Seconds the emulator can fall behind before it drops logs, as a receiver's port buffer would
+static const double MAX_BACKLOG = 1.0;
+//! GPS time started 1980-01-06, 315964800 s after the Unix epoch; GPS is 18 s ahead of UTC
+static const double GPS_EPOCH = 315964800.0 - 18.0;
+
+static double MonotonicSeconds() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+
+//! GPS seconds since the GPS epoch
+static double GpsSeconds() {
+    return WallClockSeconds() - GPS_EPOCH;
+}
+
+//! Message id of a binary log name such as BESTPOSB, or -1
+static int LogId(const std::string &name) {
+    static std::map<std::string, int> ids;
+    if (ids.empty()) {
+        for (int ii=0; ii<MAX_LOG_ID; ii++) {
+            const char *log_name = BinaryLogName(BINARY_LOG_TYPE(ii));
+            if (log_name != NULL)
+                ids[log_name] = ii;
+        }
+    }
+    std::map<std::string, int>::const_iterator it = ids.find(name);
+    return it == ids.end() ? -1 : it->second;
+}
+
+static speed_t BaudSpeed(int baud_rate) {
+    switch (baud_rate) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B0;
+    }
+}
+
+static int BaudRate(speed_t speed) {
+    switch (speed) {
+        case B9600: return 9600;
+        case B19200: return 19200;
+        case B38400: return 38400;
+        case B57600: return 57600;
+        case B115200: return 115200;
+        case B230400: return 230400;
+        case B460800: return 460800;
+        case B921600: return 921600;
+        default: return 0;
+    }
+}
+
+ReceiverEmulator::ReceiverEmulator() : master_fd_(-1), baud_rate_(115200), pending_baud_rate_(0), line_free_at_(0),
+    stall_until_(0), next_stall_(0), port_overrun_(false), random_state_(12345) {
+    running_ = false;
+}
+
+ReceiverEmulator::~ReceiverEmulator() {
+    Stop();
+}
+
+int novatel::OpenPseudoTerminal() {
+    int master = posix_openpt(O_RDWR|O_NOCTTY);
+    if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0)) {
+        if (master >= 0)
+            close(master);
+        return -1;
+    }
+    struct termios raw;
+    tcgetattr(master, &raw);
+    cfmakeraw(&raw);
+    tcsetattr(master, TCSANOW, &raw);
+    return master;
+}
+
+bool ReceiverEmulator::Start(int baud_rate) {
+    Stop();
+    master_fd_ = OpenPseudoTerminal();
+    if (master_fd_ < 0)
+        return false;
+    fcntl(master_fd_, F_SETFL, fcntl(master_fd_, F_GETFL) | O_NONBLOCK);
+    port_ = ptsname(master_fd_);
+    {
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        baud_rate_ = baud_rate;
+        pending_baud_rate_ = 0;
+        next_stall_ = MonotonicSeconds() + faults_.stall_period_ms/1000.0;
+    }
+    running_ = true;
+    thread_ptr_.reset(new boost::thread(boost::bind(&ReceiverEmulator::Run, this)));
+    return true;
+}
+
+void ReceiverEmulator::Stop() {
+    running_ = false;
+    if (thread_ptr_) {
+        thread_ptr_->join();
+        thread_ptr_.reset();
+    }
+    if (master_fd_ >= 0) {
+        close(master_fd_);
+        master_fd_ = -1;
+    }
+}
+
+bool ReceiverEmulator::LoadCapture(const std::string &path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open())
+        return false;
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    size_t index = 0;
+    while (index + 10 <= data.size()) {
+        if (((unsigned char)data[index] != 0xAA) || ((unsigned char)data[index+1] != 0x44) ||
+                ((unsigned char)data[index+2] != 0x12)) {
+            index++;
+            continue;
+        }
+        size_t length = (unsigned char)data[index+3] + 4 +
+            ((unsigned char)data[index+8] | ((unsigned char)data[index+9] << 8));
+        if (index + length > data.size())
+            break;
+        AddFrame(data.substr(index, length));
+        index += length;
+    }
+    return true;
+}
+
+void ReceiverEmulator::AddFrame(const std::string &frame) {
+    if (frame.size() < HEADER_SIZE + 4)
+        return;
+    uint16_t message_id = (unsigned char)frame[4] | ((unsigned char)frame[5] << 8);
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    frames_[message_id].push_back(frame);
+}
+
+void ReceiverEmulator::StartLog(BINARY_LOG_TYPE log_type, double period) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    ActiveLog &log = active_logs_[log_type];
+    log.period = period;
+    log.next_due = period > 0 ? ceil(GpsSeconds()/period)*period : 0;
+    log.next_frame = 0;
+}
+
+void ReceiverEmulator::SetFaults(const EmulatorFaults &faults) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    faults_ = faults;
+    next_stall_ = MonotonicSeconds() + faults_.stall_period_ms/1000.0;
+}
+
+void ReceiverEmulator::SetBaudRate(int baud_rate) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    baud_rate_ = baud_rate;
+}
+
+EmulatorStatistics ReceiverEmulator::GetStatistics() {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return statistics_;
+}
+
+std::vector<std::string> ReceiverEmulator::GetCommands() {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return commands_;
+}
+
+void ReceiverEmulator::Run() {
+    unsigned char buffer[4096];
+    while (running_) {
+        pollfd ready = {master_fd_, POLLIN, 0};
+        int result = poll(&ready, 1, 1);
+        if ((result > 0) && (ready.revents & POLLIN)) {
+            ssize_t length = read(master_fd_, buffer, sizeof(buffer));
+            if (length > 0)
+                HandleInput(buffer, length);
+        } else if (result > 0) {
+            // nobody has the slave end open
+            usleep(1000);
+        }
+
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        double gps_seconds = GpsSeconds();
+        std::map<uint16_t, ActiveLog>::iterator it = active_logs_.begin();
+        while (it != active_logs_.end()) {
+            if (gps_seconds < it->second.next_due) {
+                ++it;
+                continue;
+            }
+            SendLog(it->first, it->second, gps_seconds);
+            if (it->second.period > 0) {
+                // skip epochs missed rather than bursting to catch up
+                it->second.next_due = (floor(gps_seconds/it->second.period) + 1)*it->second.period;
+                ++it;
+            } else {
+                active_logs_.erase(it++);
+            }
+        }
+        Transmit();
+    }
+}
+
+bool ReceiverEmulator::BaudMismatch() {
+    int host_baud_rate = faults_.host_baud_rate;
+    if (host_baud_rate < 0) {
+        // a pseudo terminal's ends share their settings, so this is what the host set
+        struct termios settings;
+        host_baud_rate = (tcgetattr(master_fd_, &settings) == 0) ? BaudRate(cfgetospeed(&settings)) : 0;
+    }
+    return (host_baud_rate > 0) && (host_baud_rate != baud_rate_);
+}
+
+void ReceiverEmulator::HandleInput(const unsigned char *data, size_t length) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    // at the wrong baud rate nothing the host says makes sense
+    if (BaudMismatch())
+        return;
+    inbox_.append((const char*)data, length);
+    while (!inbox_.empty()) {
+        if ((unsigned char)inbox_[0] == 0xAA) {
+            if (inbox_.size() < 3)
+                break;
+            if (((unsigned char)inbox_[1] != 0x44) || ((unsigned char)inbox_[2] != 0x12)) {
+                inbox_.erase(0, 1);
+                continue;
+            }
+            if (inbox_.size() < 10)
+                break;
+            size_t frame_length = (unsigned char)inbox_[3] + 4 +
+                ((unsigned char)inbox_[8] | ((unsigned char)inbox_[9] << 8));
+            if (inbox_.size() < frame_length)
+                break;
+            HandleBinary(inbox_.substr(0, frame_length));
+            inbox_.erase(0, frame_length);
+            continue;
+        }
+        size_t end = inbox_.find_first_of("\r\n");
+        size_t sync = inbox_.find('\xAA');
+        if ((sync != std::string::npos) && ((end == std::string::npos) || (sync < end))) {
+            inbox_.erase(0, sync);
+            continue;
+        }
+        if (end == std::string::npos) {
+            if (inbox_.size() > MAX_NOUT_SIZE)
+                inbox_.clear();
+            break;
+        }
+        std::string line = inbox_.substr(0, end);
+        inbox_.erase(0, end+1);
+        if (!line.empty())
+            HandleAscii(line);
+    }
+}
+
+void ReceiverEmulator::HandleAscii(const std::string &line) {
+    commands_.push_back(line);
+    statistics_.commands++;
+    std::vector<std::string> tokens;
+    std::string token;
+    for (size_t ii=0; ii<=line.size(); ii++) {
+        if ((ii == line.size()) || (line[ii] == ' ') || (line[ii] == ',')) {
+            if (!token.empty())
+                tokens.push_back(token);
+            token.clear();
+        } else {
+            token += toupper(line[ii]);
+        }
+    }
+    if (tokens.empty())
+        return;
+    const std::string &command = tokens[0];
+    // the port argument is optional
+    size_t argument = 1;
+    if ((tokens.size() > 1) && ((tokens[1].compare(0, 3, "COM") == 0) ||
+            (tokens[1].compare(0, 3, "USB") == 0) || (tokens[1] == "THISPORT")))
+        argument = 2;
+
+    if ((command == "LOG") && (tokens.size() > argument)) {
+        std::string name = tokens[argument];
+        LogMode trigger = ONNEW;
+        double period = 0;
+        if (tokens.size() > argument+1) {
+            const std::string &mode = tokens[argument+1];
+            trigger = (mode == "ONTIME") ? ONTIME : (mode == "ONCE") ? ONCE : (mode == "ONCHANGED") ?
+                ONCHANGED : (mode == "ONNEXT") ? ONNEXT : ONNEW;
+        }
+        if (tokens.size() > argument+2)
+            period = atof(tokens[argument+2].c_str());
+        // VERSIONA is the only ASCII log
+        bool binary_output = (name != "VERSIONA") && (name != "VERSION");
+        if (!binary_output)
+            name = "VERSIONB";
+        std::string response = Log(name, trigger, period);
+        Respond(0, false, response == "OK", response);
+        if ((response == "OK") && !binary_output)
+            SendVersion(true);
+        else if ((response == "OK") && (name == "LOGLISTB"))
+            SendLogList();
+        else if ((response == "OK") && (name == "VERSIONB"))
+            SendVersion(false);
+    } else if ((command == "UNLOG") && (tokens.size() > argument)) {
+        int id = LogId(tokens[argument]);
+        Respond(0, false, (id >= 0) && active_logs_.erase(id), "Message is not being logged");
+    } else if (command == "UNLOGALL") {
+        active_logs_.clear();
+        Respond(0, false, true, "");
+    } else if ((command == "COM") && (tokens.size() > argument)) {
+        int baud_rate = atoi(tokens[argument].c_str());
+        if (BaudRate(BaudSpeed(baud_rate)) == baud_rate) {
+            // the answer goes out at the old rate
+            Respond(0, false, true, "");
+            pending_baud_rate_ = baud_rate;
+        } else {
+            Respond(0, false, false, "Parameter 2 is out of range");
+        }
+    } else if (command == "INTERFACEMODE") {
+        Respond(0, false, true, "");
+    } else {
+        Respond(0, false, false, "Invalid Command Name");
+    }
+}
+
+std::string ReceiverEmulator::Log(const std::string &name, LogMode trigger, double period) {
+    int id = LogId(name);
+    if (id < 0)
+        return "Invalid Message ID";
+    if ((trigger == ONTIME) && (period <= 0))
+        return "Parameter 4 is out of range";
+    // the version and log list are answered when logged
+    if ((id == VERSIONB_LOG_TYPE) || (id == LOGLISTB_LOG_TYPE))
+        return "OK";
+    if ((trigger == ONTIME) || (trigger == ONCHANGED) || (trigger == ONNEW)) {
+        ActiveLog &log = active_logs_[id];
+        log.period = (trigger == ONTIME) ? period : 1.0;
+        log.next_due = ceil(GpsSeconds()/log.period)*log.period;
+        log.next_frame = 0;
+    } else {
+        ActiveLog &log = active_logs_[id];
+        log.period = 0;
+        log.next_due = 0;
+        log.next_frame = 0;
+    }
+    return "OK";
+}
+
+void ReceiverEmulator::HandleBinary(const std::string &frame) {
+    uint32_t crc;
+    memcpy(&crc, frame.data() + frame.size() - 4, 4);
+    if (crc != CalculateBlockCRC32(frame.size()-4, (unsigned char*)frame.data()))
+        return;
+    statistics_.commands++;
+    uint16_t command_id = (unsigned char)frame[4] | ((unsigned char)frame[5] << 8);
+    const char *body = frame.data() + HEADER_SIZE;
+    size_t body_length = frame.size() - HEADER_SIZE - 4;
+    std::stringstream description;
+    description << "binary " << command_id;
+    commands_.push_back(description.str());
+
+    if ((command_id == LOG_CMD_ID) && (body_length >= sizeof(LogCommand))) {
+        LogCommand log;
+        memcpy(&log, body, sizeof(log));
+        const char *name = BinaryLogName(BINARY_LOG_TYPE(log.message_id));
+        std::string response = name ? Log(name, LogMode(log.trigger), log.period) : "Invalid Message ID";
+        Respond(command_id, true, response == "OK", response);
+        if ((response == "OK") && (log.message_id == LOGLISTB_LOG_TYPE))
+            SendLogList();
+        else if ((response == "OK") && (log.message_id == VERSIONB_LOG_TYPE))
+            SendVersion(false);
+    } else if ((command_id == UNLOG_CMD_ID) && (body_length >= sizeof(UnlogCommand))) {
+        UnlogCommand unlog;
+        memcpy(&unlog, body, sizeof(unlog));
+        Respond(command_id, true, active_logs_.erase(unlog.message_id), "Message is not being logged");
+    } else if (command_id == UNLOGALL_CMD_ID) {
+        active_logs_.clear();
+        Respond(command_id, true, true, "");
+    } else {
+        Respond(command_id, true, true, "");
+    }
+}
+
+void ReceiverEmulator::Respond(uint16_t command_id, bool binary, bool ok, const std::string &text) {
+    if (!binary) {
+        outbox_ += ok ? "\r\n<OK\r\n[COM1]" : "\r\n<ERROR:" + text + "\r\n[COM1]";
+        return;
+    }
+    std::string response_text = ok ? "OK" : text;
+    // the text is padded with nulls to a multiple of 4 bytes
+    size_t body_length = 4 + (response_text.size()/4 + 1)*4;
+    std::string frame(HEADER_SIZE + body_length + 4, '\0');
+    Oem4BinaryHeader *header = (Oem4BinaryHeader*)&frame[0];
+    header->sync1 = 0xAA;
+    header->sync2 = 0x44;
+    header->sync3 = 0x12;
+    header->header_length = HEADER_SIZE;
+    header->message_id = command_id;
+    header->message_type = RESPONSE_BIT;
+    header->message_length = body_length;
+    uint32_t response_id = ok ? 1 : 2;
+    memcpy(&frame[HEADER_SIZE], &response_id, 4);
+    memcpy(&frame[HEADER_SIZE+4], response_text.data(), response_text.size());
+    Queue(frame, GpsSeconds());
+}
+
+void ReceiverEmulator::SendVersion(bool ascii) {
+    if (ascii) {
+        outbox_ += "#VERSIONA,COM1,0,90.0,FINESTEERING,0,0.000,00000000,0000,0;"
+            "1,GPSCARD,\"G2SB2G\",\"EMU00000001\",\"OEMV2G-2.00-2T\",\"3.000A19\","
+            "\"3.000A9\",\"2006/Feb/ 9\",\"17:14:33\"*00000000\r\n";
+        return;
+    }
+    Version version;
+    memset(&version, 0, sizeof(version));
+    version.number_of_components = 1;
+    version.component_type = 1;
+    strncpy(version.model, "G2SB2G", sizeof(version.model));
+    strncpy(version.serial_number, "EMU00000001", sizeof(version.serial_number));
+    strncpy(version.hardware_version, "OEMV2G-2.00-2T", sizeof(version.hardware_version));
+    strncpy(version.software_version, "3.000A19", sizeof(version.software_version));
+    Queue(EncodeLog(VERSIONB_LOG_TYPE, version), GpsSeconds());
+}
+
+void ReceiverEmulator::SendLogList() {
+    LogList log_list;
+    memset(&log_list, 0, sizeof(log_list));
+    log_list.number_of_logs = std::min<size_t>(active_logs_.size(), MAX_LOG_LIST);
+    std::map<uint16_t, ActiveLog>::const_iterator it = active_logs_.begin();
+    for (int32_t ii=0; ii<log_list.number_of_logs; ii++, ++it) {
+        LogListEntry &entry = log_list.logs[ii];
+        entry.port = COM1_ADDRESS;
+        entry.message_id = it->first;
+        entry.trigger = it->second.period > 0 ? ONTIME : ONCE;
+        entry.period = it->second.period;
+    }
+    Queue(EncodeLog(LOGLISTB_LOG_TYPE, log_list), GpsSeconds());
+}
+
+void ReceiverEmulator::SendLog(uint16_t message_id, ActiveLog &log, double gps_seconds) {
+    // the backlog a receiver's port buffer would hold before dropping logs
+    if (outbox_.size()*10.0/baud_rate_ > MAX_BACKLOG) {
+        statistics_.logs_dropped++;
+        port_overrun_ = true;
+        return;
+    }
+    std::map<uint16_t, std::vector<std::string> >::const_iterator frames = frames_.find(message_id);
+    std::string frame;
+    if ((frames != frames_.end()) && !frames->second.empty()) {
+        frame = frames->second[log.next_frame++ % frames->second.size()];
+    } else {
+        // nothing captured: an empty body the driver can still frame
+        Oem4BinaryHeader header;
+        memset(&header, 0, sizeof(header));
+        frame = EncodeLog(BINARY_LOG_TYPE(message_id), &header, 0);
+    }
+    statistics_.logs_sent++;
+    Queue(frame, gps_seconds);
+}
+
+void ReceiverEmulator::Queue(std::string frame, double gps_seconds) {
+    Oem4BinaryHeader *header = (Oem4BinaryHeader*)&frame[0];
+    header->port_address = COM1_ADDRESS;
+    header->idle = 180;          // 90%
+    header->time_status = 180;   // FINESTEERING
+    uint64_t gps_ms = uint64_t(gps_seconds*1000 + 0.5);
+    header->gps_week = gps_ms/604800000;
+    header->gps_millisecs = gps_ms%604800000;
+    header->status = port_overrun_ ? 0x100 : 0;   // COM1 buffer overrun
+    port_overrun_ = false;
+    uint32_t crc = CalculateBlockCRC32(frame.size()-4, (unsigned char*)&frame[0]);
+    memcpy(&frame[frame.size()-4], &crc, 4);
+    outbox_ += frame;
+}
+
+void ReceiverEmulator::Transmit() {
+    double now = MonotonicSeconds();
+    if (now < stall_until_)
+        return;
+    if ((faults_.stall_period_ms > 0) && (faults_.stall_ms > 0) && (now >= next_stall_)) {
+        stall_until_ = now + faults_.stall_ms/1000.0;
+        next_stall_ = stall_until_ + faults_.stall_period_ms/1000.0;
+        statistics_.stalls++;
+        return;
+    }
+    if (outbox_.empty())
+        return;
+
+    // send what the line could carry by now, a couple of milliseconds ahead
+    line_free_at_ = std::max(line_free_at_, now);
+    size_t length = std::min(outbox_.size(), size_t((now + 0.002 - line_free_at_)*baud_rate_/10));
+    if (length == 0)
+        return;
+    bool mismatch = BaudMismatch();
+    std::string wire;
+    wire.reserve(length);
+    for (size_t ii=0; ii<length; ii++) {
+        unsigned char byte = outbox_[ii];
+        random_state_ = random_state_*1103515245 + 12345;
+        double draw = (random_state_ >> 8)/double(1 << 24);
+        if (draw < faults_.drop_probability) {
+            statistics_.bytes_dropped++;
+            continue;
+        }
+        if (draw < faults_.drop_probability + faults_.bit_flip_probability) {
+            byte ^= 1 << ((random_state_ >> 4) & 7);
+            statistics_.bits_flipped++;
+        }
+        if (mismatch)
+            byte = (byte*167 + 13) ^ 0x5A;
+        wire += byte;
+    }
+    ssize_t written = wire.empty() ? 0 : write(master_fd_, wire.data(), wire.size());
+    // a full pseudo terminal is tried again later
+    if ((written < 0) && (errno == EAGAIN))
+        return;
+    outbox_.erase(0, length);
+    line_free_at_ += length*10.0/baud_rate_;
+    statistics_.bytes_sent += length;
+    if (outbox_.empty() && (pending_baud_rate_ > 0)) {
+        baud_rate_ = pending_baud_rate_;
+        pending_baud_rate_ = 0;
+    }
+}
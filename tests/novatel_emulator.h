@@ -0,0 +1,155 @@
+/*!
+ * \file novatel_emulator.h
+ *
+ * \section DESCRIPTION
+ *
+ * A stand-in for a receiver on a pseudo terminal, so the driver's
+ * connection, command and streaming paths can be run without hardware.
+ * It answers VERSION, LOG, UNLOG, UNLOGALL, LOGLIST, COM and
+ * INTERFACEMODE, in ASCII or binary, and streams logs from .GPS captures
+ * or synthesized frames at the requested rates, paced at its baud rate.
+ * Faults can be injected on the way out: dropped bytes, flipped bits,
+ * stalls and a baud rate mismatch.
+ *
+ */
+
+#ifndef NOVATEL_EMULATOR_H
+#define NOVATEL_EMULATOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+#include "novatel/novatel_structures.h"
+// Boost Headers
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace novatel {
+
+//! Faults the emulator puts on the line
+struct EmulatorFaults
+{
+    EmulatorFaults() : drop_probability(0), bit_flip_probability(0), stall_period_ms(0),
+        stall_ms(0), host_baud_rate(0) {}
+
+    double drop_probability;      //!< of each byte sent being lost
+    double bit_flip_probability;  //!< of each byte sent having a bit flipped
+    uint32_t stall_period_ms;     //!< the emulator goes quiet every stall_period_ms...
+    uint32_t stall_ms;            //!< ...for stall_ms, holding its output back
+    /*!
+     * Baud rate the host's end of the line is at.  Bytes are garbled both
+     * ways while it differs from the emulator's.  0 assumes they match, -1
+     * reads it from the pseudo terminal as set by the serial library.
+     */
+    int host_baud_rate;
+};
+
+//! What the emulator has done since it started
+struct EmulatorStatistics
+{
+    EmulatorStatistics() : commands(0), logs_sent(0), logs_dropped(0), bytes_sent(0),
+        bytes_dropped(0), bits_flipped(0), stalls(0) {}
+
+    uint64_t commands;       //!< commands answered, ASCII or binary
+    uint64_t logs_sent;
+    uint64_t logs_dropped;   //!< logs not sent because the line was full
+    uint64_t bytes_sent;
+    uint64_t bytes_dropped;  //!< by the drop fault
+    uint64_t bits_flipped;
+    uint64_t stalls;
+};
+
+/*!
+ * Opens a raw pseudo terminal to stand in for a receiver and returns its
+ * master end, or -1 if it cannot be opened.  The driver opens the slave
+ * end, named by ptsname().
+ */
+int OpenPseudoTerminal();
+
+class ReceiverEmulator
+{
+public:
+    ReceiverEmulator();
+    ~ReceiverEmulator();
+
+    /*!
+     * Opens a pseudo terminal and starts answering on it at baud_rate.
+     * Connect the driver to port().
+     */
+    bool Start(int baud_rate=115200);
+    void Stop();
+    //! Path of the pseudo terminal's slave end
+    std::string port() const {return port_;}
+
+    //! Streams the binary logs in a capture when they are requested
+    bool LoadCapture(const std::string &path);
+    //! Streams a binary message (header to CRC) when its log is requested
+    void AddFrame(const std::string &frame);
+
+    /*!
+     * Starts a log as if requested before the driver connected.  A period
+     * of 0 sends it once.
+     */
+    void StartLog(BINARY_LOG_TYPE log_type, double period);
+
+    void SetFaults(const EmulatorFaults &faults);
+    //! The emulator's baud rate, as a COM command would set it
+    void SetBaudRate(int baud_rate);
+    int baud_rate() const {return baud_rate_;}
+
+    EmulatorStatistics GetStatistics();
+    //! ASCII commands received, or the command name of binary ones
+    std::vector<std::string> GetCommands();
+
+private:
+    struct ActiveLog
+    {
+        double period;       //!< [s], 0 to send once
+        double next_due;     //!< GPS seconds since the GPS epoch
+        size_t next_frame;   //!< index into the log's frames
+    };
+
+    void Run();
+    void HandleInput(const unsigned char *data, size_t length);
+    void HandleAscii(const std::string &line);
+    void HandleBinary(const std::string &frame);
+    //! LOG; returns the response text, "OK" if accepted
+    std::string Log(const std::string &name, LogMode trigger, double period);
+    void Respond(uint16_t command_id, bool binary, bool ok, const std::string &text);
+    void SendVersion(bool ascii);
+    void SendLogList();
+    void SendLog(uint16_t message_id, ActiveLog &log, double gps_seconds);
+    //! Queues a binary message after stamping its header with the time and its CRC
+    void Queue(std::string frame, double gps_seconds);
+    void Transmit();
+    bool BaudMismatch();
+
+    int master_fd_;
+    std::string port_;
+    boost::shared_ptr<boost::thread> thread_ptr_;
+    boost::atomic<bool> running_;
+
+    //! guards everything below
+    boost::mutex mutex_;
+    int baud_rate_;
+    int pending_baud_rate_;   //!< set by COM once its answer is sent, 0 if none
+    EmulatorFaults faults_;
+    EmulatorStatistics statistics_;
+    std::vector<std::string> commands_;
+    std::map<uint16_t, std::vector<std::string> > frames_;  //!< messages to stream, by log
+    std::map<uint16_t, ActiveLog> active_logs_;
+    std::string inbox_;
+    std::string outbox_;
+    double line_free_at_;     //!< monotonic seconds when the line has sent what was written
+    double stall_until_;      //!< monotonic seconds
+    double next_stall_;       //!< monotonic seconds
+    bool port_overrun_;       //!< set in the status word after logs were dropped
+    uint32_t random_state_;
+};
+
+}
+
+#endif
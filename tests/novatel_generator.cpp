@@ -0,0 +1,308 @@
+#include "novatel_generator.h"
+#include "novatel/novatel_encoder.h"
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+
+using namespace novatel;
+
+//! Metres in a degree of latitude, and of longitude at the equator
+static const double METERS_PER_DEGREE_LATITUDE = 111132.954;
+static const double METERS_PER_DEGREE_LONGITUDE = 111319.491;
+static const double GRAVITY = 9.80665;
+//! L1 wavelength [m]
+static const double L1_WAVELENGTH = 0.190293673;
+//! Scale of RAWIMU velocity [m/s] and angle [rad] changes, as for the AG17 and AG62
+static const double IMU_VELOCITY_SCALE = 0.3048/67108864.0;
+static const double IMU_ANGLE_SCALE = 1.0/8589934592.0;
+
+//! Where the vehicle is at time seconds into its drive
+struct TrajectoryPoint
+{
+    double north, east;     //!< from the start [m]
+    double heading;         //!< azimuth [rad] from north
+    double yaw_rate;        //!< [rad/s]
+};
+
+static TrajectoryPoint Trajectory(const SyntheticStreamConfig &config, double time) {
+    TrajectoryPoint point;
+    if (config.turn_radius > 0) {
+        point.heading = config.speed*time/config.turn_radius;
+        point.north = config.turn_radius*sin(point.heading);
+        point.east = config.turn_radius*(1 - cos(point.heading));
+        point.yaw_rate = config.speed/config.turn_radius;
+    } else {
+        point.heading = 0;
+        point.north = config.speed*time;
+        point.east = 0;
+        point.yaw_rate = 0;
+    }
+    return point;
+}
+
+SyntheticStream::SyntheticStream(const SyntheticStreamConfig &config)
+    : config_(config), time_(0), logs_(0) {
+    for (std::map<BINARY_LOG_TYPE, double>::const_iterator it = config.rates.begin();
+            it != config.rates.end(); ++it) {
+        if (!Supports(it->first) || (it->second <= 0))
+            continue;
+        StreamLog log;
+        log.log_type = it->first;
+        log.period = 1.0/it->second;
+        log.sent = 0;
+        stream_logs_.push_back(log);
+    }
+    ranges_.resize(config.satellites);
+    compressed_ranges_.resize(config.satellites);
+    prns_.resize(config.satellites);
+}
+
+bool SyntheticStream::Supports(BINARY_LOG_TYPE log_type) {
+    switch (log_type) {
+        case BESTGPSPOS_LOG_TYPE:
+        case BESTPOSB_LOG_TYPE:
+        case PSRPOSB_LOG_TYPE:
+        case RTKPOSB_LOG_TYPE:
+        case BESTVELB_LOG_TYPE:
+        case INSPVA_LOG_TYPE:
+        case INSPVAS_LOG_TYPE:
+        case RAWIMU_LOG_TYPE:
+        case RAWIMUS_LOG_TYPE:
+        case PSRDOPB_LOG_TYPE:
+        case RANGEB_LOG_TYPE:
+        case RANGECMPB_LOG_TYPE:
+        case TIMEB_LOG_TYPE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::string SyntheticStream::Next() {
+    if (stream_logs_.empty())
+        return std::string();
+    // logs due at the same time go out in the order of their ids
+    StreamLog *next = &stream_logs_[0];
+    for (size_t ii=1; ii<stream_logs_.size(); ii++) {
+        if (stream_logs_[ii].sent*stream_logs_[ii].period < next->sent*next->period)
+            next = &stream_logs_[ii];
+    }
+    time_ = next->sent*next->period;
+    next->sent++;
+    logs_++;
+    return Encode(next->log_type);
+}
+
+size_t SyntheticStream::Generate(std::string &data, size_t bytes) {
+    size_t target = data.size() + bytes;
+    size_t logs = 0;
+    while (data.size() < target) {
+        std::string log = Next();
+        if (log.empty())
+            break;
+        data += log;
+        logs++;
+    }
+    return logs;
+}
+
+Oem4BinaryHeader SyntheticStream::Header() const {
+    Oem4BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    uint64_t gps_ms = uint64_t((config_.gps_seconds + time_)*1000 + 0.5);
+    header.port_address = 0x20;     // COM1
+    header.idle = 180;              // 90%
+    header.time_status = 180;       // FINESTEERING
+    header.gps_week = config_.gps_week + gps_ms/604800000;
+    header.gps_millisecs = gps_ms%604800000;
+    return header;
+}
+
+std::string SyntheticStream::Encode(BINARY_LOG_TYPE log_type) {
+    TrajectoryPoint point = Trajectory(config_, time_);
+    double latitude = config_.latitude + point.north/METERS_PER_DEGREE_LATITUDE;
+    double longitude = config_.longitude +
+        point.east/(METERS_PER_DEGREE_LONGITUDE*cos(config_.latitude*M_PI/180));
+    double north_velocity = config_.speed*cos(point.heading);
+    double east_velocity = config_.speed*sin(point.heading);
+    Oem4BinaryHeader header = Header();
+    uint32_t week = header.gps_week;
+    double milliseconds = header.gps_millisecs;
+
+    switch (log_type) {
+        case BESTGPSPOS_LOG_TYPE:
+        case BESTPOSB_LOG_TYPE:
+        case PSRPOSB_LOG_TYPE:
+        case RTKPOSB_LOG_TYPE: {
+            Position position;
+            memset(&position, 0, sizeof(position));
+            position.header = header;
+            position.solution_status = SOL_COMPUTED;
+            position.position_type = (log_type == RTKPOSB_LOG_TYPE) ? NARROW_INT : SINGLE;
+            position.latitude = latitude;
+            position.longitude = longitude;
+            position.height = config_.height;
+            position.undulation = -30;
+            position.datum_id = WGS84;
+            position.latitude_standard_deviation = 1.2f;
+            position.longitude_standard_deviation = 0.9f;
+            position.height_standard_deviation = 2.1f;
+            position.number_of_satellites = std::min<uint32_t>(config_.satellites, 255);
+            position.number_of_satellites_in_solution = position.number_of_satellites;
+            position.num_gps_plus_glonass_l1 = position.number_of_satellites;
+            return EncodeLog(log_type, position);
+        }
+        case BESTVELB_LOG_TYPE: {
+            Velocity velocity;
+            memset(&velocity, 0, sizeof(velocity));
+            velocity.header = header;
+            velocity.solution_status = SOL_COMPUTED;
+            velocity.position_type = DOPPLER_VELOCITY;
+            velocity.horizontal_speed = config_.speed;
+            velocity.track_over_ground = fmod(point.heading*180/M_PI, 360);
+            return EncodeLog(log_type, velocity);
+        }
+        case INSPVA_LOG_TYPE:
+        case INSPVAS_LOG_TYPE: {
+            InsPositionVelocityAttitude ins;
+            memset(&ins, 0, sizeof(ins));
+            ins.header = header;
+            ins.gps_week = week;
+            ins.gps_millisecs = milliseconds;
+            ins.latitude = latitude;
+            ins.longitude = longitude;
+            ins.height = config_.height;
+            ins.north_velocity = north_velocity;
+            ins.east_velocity = east_velocity;
+            ins.azimuth = fmod(point.heading*180/M_PI, 360);
+            ins.status = INS_SOLUTION_GOOD;
+            if (log_type == INSPVA_LOG_TYPE)
+                return EncodeLog(log_type, ins);
+            // the same body behind the short header
+            InsPositionVelocityAttitudeShort short_ins;
+            memset(&short_ins.header, 0, sizeof(short_ins.header));
+            short_ins.header.gps_week = header.gps_week;
+            short_ins.header.millisecs = header.gps_millisecs;
+            memcpy(&short_ins.gps_week, &ins.gps_week, sizeof(short_ins) - SHORT_HEADER_SIZE);
+            return EncodeLog(log_type, short_ins);
+        }
+        case RAWIMU_LOG_TYPE:
+        case RAWIMUS_LOG_TYPE: {
+            // changes over the period of the log
+            double period = 0.01;
+            for (size_t ii=0; ii<stream_logs_.size(); ii++) {
+                if (stream_logs_[ii].log_type == log_type)
+                    period = stream_logs_[ii].period;
+            }
+            double centripetal = config_.speed*point.yaw_rate;
+            RawImu imu;
+            memset(&imu, 0, sizeof(imu));
+            imu.header = header;
+            imu.gps_week = week;
+            imu.gps_millisecs = milliseconds;
+            imu.z_acceleration = int32_t(GRAVITY*period/IMU_VELOCITY_SCALE);
+            imu.y_acceleration_neg = 0;
+            imu.x_acceleration = int32_t(centripetal*period/IMU_VELOCITY_SCALE);
+            imu.z_gyro_rate = int32_t(point.yaw_rate*period/IMU_ANGLE_SCALE);
+            if (log_type == RAWIMU_LOG_TYPE)
+                return EncodeLog(log_type, imu);
+            RawImuShort short_imu;
+            memset(&short_imu.header, 0, sizeof(short_imu.header));
+            short_imu.header.gps_week = header.gps_week;
+            short_imu.header.millisecs = header.gps_millisecs;
+            memcpy(&short_imu.gps_week, &imu.gps_week, sizeof(short_imu) - SHORT_HEADER_SIZE);
+            return EncodeLog(log_type, short_imu);
+        }
+        case PSRDOPB_LOG_TYPE: {
+            Dop dop;
+            memset(&dop, 0, sizeof(dop));
+            dop.header = header;
+            dop.geometric_dop = 2.0f;
+            dop.position_dop = 1.7f;
+            dop.horizontal_dop = 0.9f;
+            dop.horizontal_position_time_dop = 1.2f;
+            dop.time_dop = 1.0f;
+            dop.elevation_cutoff_angle = 5.0f;
+            for (uint32_t ii=0; ii<config_.satellites; ii++)
+                prns_[ii] = ii%32 + 1;
+            return EncodeLog(log_type, &dop, 28, prns_.empty() ? NULL : &prns_[0],
+                             sizeof(uint32_t), config_.satellites);
+        }
+        case RANGEB_LOG_TYPE:
+        case RANGECMPB_LOG_TYPE: {
+            for (uint32_t ii=0; ii<config_.satellites; ii++) {
+                // each satellite drifts slowly towards or away from the vehicle
+                double phase = 0.001*time_ + ii;
+                ChannelStatus status;
+                memset(&status, 0, sizeof(status));
+                status.tracking_state = 4;      // phase lock loop
+                status.sv_chan_num = ii%32;
+                status.phase_lock_flag = 1;
+                status.parity_known_flag = 1;
+                status.code_locked_flag = 1;
+                status.correlator_type = 2;
+                status.grouping = 1;
+                status.primary_L1_chan = 1;
+                status.carrier_phase_meas = 1;
+                double pseudorange = 2.2e7 + 1.0e5*ii + 3.0e3*sin(phase);
+                double doppler = 3.0e3*0.001*cos(phase)/L1_WAVELENGTH;
+                double carrier_to_noise = 38 + ii%12;
+                if (log_type == RANGEB_LOG_TYPE) {
+                    RangeData &range = ranges_[ii];
+                    memset(&range, 0, sizeof(range));
+                    range.satellite_prn = ii%32 + 1;
+                    range.pseudorange = pseudorange;
+                    range.pseudorange_standard_deviation = 0.08f;
+                    range.accumulated_doppler = -pseudorange/L1_WAVELENGTH;
+                    range.accumulated_doppler_std_deviation = 0.005f;
+                    range.doppler = doppler;
+                    range.carrier_to_noise = carrier_to_noise;
+                    range.locktime = time_;
+                    range.channel_status = status;
+                } else {
+                    CompressedRangeData &range = compressed_ranges_[ii];
+                    memset(&range, 0, sizeof(range));
+                    range.channel_status = status;
+                    range.range_record.doppler = int64_t(doppler*256);
+                    range.range_record.pseudorange = uint64_t(pseudorange*128);
+                    range.range_record.accumulated_doppler = int32_t(fmod(-pseudorange/L1_WAVELENGTH, 8388608.0)*256);
+                    range.range_record.pseudorange_standard_deviation = 1;
+                    range.range_record.accumulated_doppler_std_deviation = 1;
+                    range.range_record.satellite_prn = ii%32 + 1;
+                    range.range_record.locktime = uint32_t(time_*32) & 0x1FFFFF;
+                    range.range_record.carrier_to_noise = uint32_t(carrier_to_noise - 20);
+                }
+            }
+            // the header and the record count, which the encoder fills in
+            unsigned char fixed[HEADER_SIZE + 4];
+            memcpy(fixed, &header, HEADER_SIZE);
+            if (log_type == RANGEB_LOG_TYPE)
+                return EncodeLog(log_type, fixed, 4, ranges_.empty() ? NULL : &ranges_[0],
+                                 sizeof(RangeData), config_.satellites);
+            return EncodeLog(log_type, fixed, 4, compressed_ranges_.empty() ? NULL : &compressed_ranges_[0],
+                             sizeof(CompressedRangeData), config_.satellites);
+        }
+        case TIMEB_LOG_TYPE: {
+            TimeOffset time;
+            memset(&time, 0, sizeof(time));
+            time.header = header;
+            time.offset = 1.0e-9;
+            time.gps_to_utc_offset = -18;
+            // GPS time started 1980-01-06 and is 18 s ahead of UTC
+            time_t utc = time_t(315964800 + header.gps_week*604800.0 + header.gps_millisecs/1000.0 - 18);
+            tm calendar;
+            gmtime_r(&utc, &calendar);
+            time.utc_year = calendar.tm_year + 1900;
+            time.utc_month = calendar.tm_mon + 1;
+            time.utc_day = calendar.tm_mday;
+            time.utc_hour = calendar.tm_hour;
+            time.utc_minute = calendar.tm_min;
+            time.utc_millisecond = calendar.tm_sec*1000 + header.gps_millisecs%1000;
+            time.utc_status = 1;    // valid
+            return EncodeLog(log_type, time);
+        }
+        default:
+            return std::string();
+    }
+}
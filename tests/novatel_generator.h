@@ -0,0 +1,90 @@
+/*!
+ * \file novatel_generator.h
+ *
+ * \section DESCRIPTION
+ *
+ * Synthetic streams of binary logs, built with the encoder, for loading
+ * the driver beyond what the captures hold: a vehicle driving circles,
+ * any number of satellites and any log rates.  The stream can be fed to
+ * BufferIncomingData() directly or to a ReceiverEmulator with AddFrame().
+ *
+ */
+
+#ifndef NOVATEL_GENERATOR_H
+#define NOVATEL_GENERATOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+#include "novatel/novatel_structures.h"
+
+namespace novatel {
+
+//! What a synthetic stream holds
+struct SyntheticStreamConfig
+{
+    SyntheticStreamConfig() : latitude(32.6), longitude(-85.5), height(200), speed(10),
+        turn_radius(100), satellites(12), gps_week(2000), gps_seconds(0) {}
+
+    double latitude;        //!< where the vehicle starts [deg]
+    double longitude;       //!< [deg]
+    double height;          //!< [m]
+    double speed;           //!< [m/s]
+    double turn_radius;     //!< the vehicle drives circles of this radius [m], straight north if 0
+    /*!
+     * Satellites tracked, one record each in RANGE, RANGECMP and PSRDOP.
+     * More than MAX_CHAN are sent, though the driver decodes only MAX_CHAN.
+     */
+    uint32_t satellites;
+    uint16_t gps_week;      //!< of the first log
+    double gps_seconds;     //!< into gps_week of the first log
+    std::map<BINARY_LOG_TYPE, double> rates;  //!< [Hz] of each log in the stream
+};
+
+class SyntheticStream
+{
+public:
+    SyntheticStream(const SyntheticStreamConfig &config);
+
+    /*!
+     * True for the logs a stream can hold: BESTPOSB and the other
+     * Position logs, BESTVELB, INSPVA, INSPVAS, RAWIMU, RAWIMUS, PSRDOPB,
+     * RANGEB, RANGECMPB and TIMEB.  Others in the config are left out.
+     */
+    static bool Supports(BINARY_LOG_TYPE log_type);
+
+    //! The next log, in time order; empty if the stream holds none
+    std::string Next();
+    //! Appends logs to data until it has grown by at least bytes; returns the logs appended
+    size_t Generate(std::string &data, size_t bytes);
+
+    //! Seconds since the first log of the last log returned
+    double time() const {return time_;}
+    uint64_t logs() const {return logs_;}
+
+private:
+    struct StreamLog
+    {
+        BINARY_LOG_TYPE log_type;
+        double period;      //!< [s]
+        uint64_t sent;      //!< the next is due at sent*period
+    };
+
+    //! Header of a log at time_ from the start
+    Oem4BinaryHeader Header() const;
+    std::string Encode(BINARY_LOG_TYPE log_type);
+
+    SyntheticStreamConfig config_;
+    std::vector<StreamLog> stream_logs_;
+    double time_;
+    uint64_t logs_;
+    std::vector<RangeData> ranges_;              //!< reused for RANGE
+    std::vector<CompressedRangeData> compressed_ranges_;
+    std::vector<uint32_t> prns_;
+};
+
+}
+
+#endif
@@ -1,9 +1,19 @@
 #include <iostream>
 #include <fstream>
 // #include <ifstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 #include "gtest/gtest.h"
 #include "novatel/novatel_enums.h"
 #include "novatel/novatel_structures.h"
+#include "novatel_emulator.h"
+#include "novatel_generator.h"
+#include "novatel/novatel_encoder.h"
 // #include <string_utils/string_utils.h>
 
 // OMG this is so nasty...
@@ -207,6 +217,1290 @@ TEST(DataParsing, BinaryDataSet1) {
 }
 
 
+// counts BESTPOS messages handed to a batch subscriber
+struct PositionBatchCounter {
+    PositionBatchCounter() : batches(0), messages(0), timestamps(0) {}
+    void HandleBatch(std::vector<Position> &positions, std::vector<double> &times) {
+        batches++;
+        messages+=positions.size();
+        timestamps+=times.size();
+    }
+    size_t batches;
+    size_t messages;
+    size_t timestamps;
+};
+
+TEST(DataParsing, BatchedDelivery) {
+    std::ifstream test_datafile;
+    test_datafile.open("./"
+            "test_data/ParsingData.GPS",std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+
+    Novatel my_gps;
+    my_gps.set_best_position_callback(BestPositionCallback());
+    PositionBatchCounter counter;
+    ASSERT_NE(0u, my_gps.SubscribeBatch<Position>(BESTPOSB_LOG_TYPE,
+        boost::bind(&PositionBatchCounter::HandleBatch, &counter, _1, _2)));
+    // the structure must match the log
+    ASSERT_EQ(0u, my_gps.SubscribeBatch<Velocity>(BESTPOSB_LOG_TYPE,
+        BatchSubscriber<Velocity>::Handler()));
+
+    char file_data[4096];
+    size_t reads=0;
+    while (!test_datafile.eof()) {
+        test_datafile.read(file_data, sizeof(file_data));
+        my_gps.BufferIncomingData((unsigned char*)file_data,test_datafile.gcount());
+        reads++;
+    }
+
+    // ParsingData.GPS holds 84 BESTPOSB logs, several per read
+    ASSERT_EQ(84u, counter.messages);
+    ASSERT_EQ(counter.messages, counter.timestamps);
+    ASSERT_GT(counter.batches, 0u);
+    ASSERT_LT(counter.batches, reads);
+}
+
+// keeps every pooled BESTPOS handle it is given
+struct PositionHolder {
+    void HandlePosition(const PooledMessage<Position> &position) {
+        positions.push_back(position);
+    }
+    std::vector<PooledMessage<Position> > positions;
+};
+
+TEST(DataParsing, PooledDelivery) {
+    std::ifstream test_datafile;
+    test_datafile.open("./"
+            "test_data/ParsingData.GPS",std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+
+    Novatel my_gps;
+    my_gps.set_best_position_callback(BestPositionCallback());
+    PositionHolder holder;
+    SubscriptionId id=my_gps.SubscribePooled<Position>(BESTPOSB_LOG_TYPE,
+        boost::bind(&PositionHolder::HandlePosition, &holder, _1), 16);
+    ASSERT_NE(0u, id);
+
+    char file_data[4096];
+    while (!test_datafile.eof()) {
+        test_datafile.read(file_data, sizeof(file_data));
+        my_gps.BufferIncomingData((unsigned char*)file_data,test_datafile.gcount());
+    }
+
+    // all 84 messages are still held, so everything past the pool
+    // capacity had to be allocated
+    ASSERT_EQ(84u, holder.positions.size());
+    PoolStatistics stats;
+    ASSERT_TRUE(my_gps.GetPoolStatistics(id, &stats));
+    ASSERT_EQ(16u, stats.capacity);
+    ASSERT_EQ(84u, stats.in_use);
+    ASSERT_EQ(68u, stats.misses);
+    ASSERT_EQ(BESTPOSB_LOG_TYPE, holder.positions[0]->header.message_id);
+
+    // handles outlive the subscription and return to the pool on release
+    ASSERT_TRUE(my_gps.Unsubscribe(id));
+    ASSERT_FALSE(my_gps.GetPoolStatistics(id, &stats));
+    PooledMessage<Position> last=holder.positions.back();
+    holder.positions.clear();
+    ASSERT_EQ(BESTPOSB_LOG_TYPE, last->header.message_id);
+    last.reset();
+}
+
+TEST(DataParsing, LogNames) {
+    BINARY_LOG_TYPE log_type;
+    ASSERT_TRUE(BinaryLogTypeFromName("bestposb", &log_type));
+    ASSERT_EQ(BESTPOSB_LOG_TYPE, log_type);
+    ASSERT_TRUE(BinaryLogTypeFromName("INSPVASB", &log_type));
+    ASSERT_EQ(INSPVAS_LOG_TYPE, log_type);
+    ASSERT_FALSE(BinaryLogTypeFromName("BESTPOSA", &log_type));
+    ASSERT_STREQ("RANGECMPB", BinaryLogName(RANGECMPB_LOG_TYPE));
+    ASSERT_TRUE(BinaryLogName(BINARY_LOG_TYPE(9999)) == NULL);
+}
+
+// counts TRACKSTAT messages
+struct TrackStatusCounter {
+    TrackStatusCounter() : messages(0) {}
+    void HandleBatch(std::vector<TrackStatus> &status, std::vector<double> &times) {
+        messages+=status.size();
+    }
+    size_t messages;
+};
+
+TEST(DataParsing, UnsubscribedLogsSkipped) {
+    std::ifstream test_datafile;
+    test_datafile.open("./"
+            "test_data/ParsingData.GPS",std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+
+    // with no callbacks set only TRACKSTAT is stored and decoded, every
+    // other log is counted through without being buffered
+    Novatel my_gps;
+    my_gps.set_best_position_callback(BestPositionCallback());
+    TrackStatusCounter counter;
+    ASSERT_NE(0u, my_gps.SubscribeBatch<TrackStatus>(TRACKSTATB_LOG_TYPE,
+        boost::bind(&TrackStatusCounter::HandleBatch, &counter, _1, _2)));
+
+    char file_data[1000];
+    while (!test_datafile.eof()) {
+        test_datafile.read(file_data, sizeof(file_data));
+        my_gps.BufferIncomingData((unsigned char*)file_data,test_datafile.gcount());
+    }
+    ASSERT_EQ(83u, counter.messages);
+}
+
+// counts BESTPOS messages passed to a subscription
+struct PositionCounter {
+    PositionCounter() : messages(0) {}
+    void HandlePosition(Position &position, double &timestamp) {
+        messages++;
+    }
+    size_t messages;
+};
+
+TEST(DataParsing, CorruptHeaders) {
+    Novatel my_gps;
+    my_gps.set_best_position_callback(BestPositionCallback());
+    PositionCounter counter;
+    my_gps.Subscribe<Position>(BESTPOSB_LOG_TYPE,
+        boost::bind(&PositionCounter::HandlePosition, &counter, _1, _2));
+    Position position;
+    memset(&position, 0, sizeof(position));
+    std::string valid = EncodeLog(BESTPOSB_LOG_TYPE, position);
+
+    // a header too short to hold its own length, on a log nobody wants
+    unsigned char short_header[] = {0xAA, 0x44, 0x12, 0x00, 0x2B, 0x00, 0x00, 0x00, 0x00, 0x00};
+    my_gps.BufferIncomingData(short_header, sizeof(short_header));
+    my_gps.BufferIncomingData((unsigned char*)&valid[0], valid.size());
+    ASSERT_EQ(1u, counter.messages);
+    ASSERT_EQ(1u, my_gps.GetMetrics().counters[METRIC_RESYNCS]);
+
+    // a length longer than the buffer is neither buffered nor skipped
+    unsigned char long_message[] = {0xAA, 0x44, 0x12, HEADER_SIZE, 0x2B, 0x00, 0x00, 0x00, 0xFF, 0xFF};
+    my_gps.BufferIncomingData(long_message, sizeof(long_message));
+    my_gps.BufferIncomingData((unsigned char*)&valid[0], valid.size());
+    ASSERT_EQ(2u, counter.messages);
+    ASSERT_EQ(1u, my_gps.GetMetrics().counters[METRIC_BUFFER_OVERFLOWS]);
+}
+
+TEST(DataParsing, Decimation) {
+    std::ifstream test_datafile;
+    test_datafile.open("./"
+            "test_data/ParsingData.GPS",std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+
+    // ParsingData.GPS holds 84 BESTPOSB logs at 1 Hz spread over 18
+    // five second GPS periods, with one time repeated
+    Novatel my_gps;
+    my_gps.set_best_position_callback(BestPositionCallback());
+    PositionCounter all, every_fourth, half_hz, aligned;
+    my_gps.Subscribe<Position>(BESTPOSB_LOG_TYPE,
+        boost::bind(&PositionCounter::HandlePosition, &all, _1, _2));
+    my_gps.Subscribe<Position>(BESTPOSB_LOG_TYPE,
+        boost::bind(&PositionCounter::HandlePosition, &every_fourth, _1, _2),
+        Decimation::EveryNth(4));
+    my_gps.Subscribe<Position>(BESTPOSB_LOG_TYPE,
+        boost::bind(&PositionCounter::HandlePosition, &half_hz, _1, _2),
+        Decimation::MaxRate(0.5));
+    my_gps.Subscribe<Position>(BESTPOSB_LOG_TYPE,
+        boost::bind(&PositionCounter::HandlePosition, &aligned, _1, _2),
+        Decimation::GpsAligned(5000));
+
+    char file_data[1000];
+    while (!test_datafile.eof()) {
+        test_datafile.read(file_data, sizeof(file_data));
+        my_gps.BufferIncomingData((unsigned char*)file_data,test_datafile.gcount());
+    }
+    ASSERT_EQ(84u, all.messages);
+    ASSERT_EQ(21u, every_fourth.messages);
+    ASSERT_EQ(42u, half_hz.messages);
+    ASSERT_EQ(18u, aligned.messages);
+}
+
+// adds and removes subscribers until told to stop
+struct SubscriptionChurn {
+    SubscriptionChurn(Novatel &gps) : gps(gps), running(true), changes(0) {}
+    void Run() {
+        PositionCounter counter;
+        while (running) {
+            SubscriptionId id=gps.Subscribe<Position>(BESTPOSB_LOG_TYPE,
+                boost::bind(&PositionCounter::HandlePosition, &counter, _1, _2));
+            gps.set_tracking_status_callback(TrackingStatusCallback());
+            gps.Unsubscribe(id);
+            changes++;
+        }
+    }
+    Novatel &gps;
+    boost::atomic<bool> running;
+    size_t changes;
+};
+
+TEST(DataParsing, HotSwapSubscribers) {
+    std::ifstream test_datafile;
+    test_datafile.open("./"
+            "test_data/ParsingData.GPS",std::ios::in|std::ios::binary);
+    ASSERT_TRUE(test_datafile.is_open());
+
+    // setting a data callback replaces the previous one
+    Novatel my_gps;
+    PositionCounter replaced, callback, subscriber;
+    my_gps.set_best_position_callback(
+        boost::bind(&PositionCounter::HandlePosition, &replaced, _1, _2));
+    my_gps.set_best_position_callback(
+        boost::bind(&PositionCounter::HandlePosition, &callback, _1, _2));
+    my_gps.Subscribe<Position>(BESTPOSB_LOG_TYPE,
+        boost::bind(&PositionCounter::HandlePosition, &subscriber, _1, _2));
+
+    // subscriptions change on another thread while data is parsed
+    SubscriptionChurn churn(my_gps);
+    boost::thread churn_thread(boost::bind(&SubscriptionChurn::Run, &churn));
+    char file_data[100];
+    while (!test_datafile.eof()) {
+        test_datafile.read(file_data, sizeof(file_data));
+        my_gps.BufferIncomingData((unsigned char*)file_data,test_datafile.gcount());
+    }
+    churn.running=false;
+    churn_thread.join();
+
+    ASSERT_EQ(0u, replaced.messages);
+    ASSERT_EQ(84u, callback.messages);
+    ASSERT_EQ(84u, subscriber.messages);
+    ASSERT_GT(churn.changes, 0u);
+}
+
+// stands in for WriteCommand() so responses can be fed without a serial port
+boost::shared_future<CommandResult> AddPendingCommand(Novatel &gps, const std::string &command,
+                                                      uint32_t timeout_ms) {
+    Novatel::PendingCommand pending;
+    pending.command=command;
+    pending.deadline=boost::get_system_time()+boost::posix_time::milliseconds(timeout_ms);
+    pending.promise.reset(new boost::promise<CommandResult>());
+    boost::shared_future<CommandResult> future(pending.promise->get_future());
+    gps.pending_commands_[gps.commands_sent_++]=pending;
+    return future;
+}
+
+TEST(DataParsing, CommandResponses) {
+    Novatel my_gps;
+    boost::shared_future<CommandResult> first=AddPendingCommand(my_gps, "LOG BESTPOSB ONTIME 1", 2000);
+    boost::shared_future<CommandResult> second=AddPendingCommand(my_gps, "LOG BADLOGB ONTIME 1", 2000);
+    boost::shared_future<CommandResult> third=AddPendingCommand(my_gps, "LOG RANGEB ONTIME 1", 2000);
+    boost::shared_future<CommandResult> lost=AddPendingCommand(my_gps, "LOG TIMEB ONTIME 1", 0);
+
+    std::string data="\r\n<OK\r\n[COM1]\r\n<ERROR:Invalid Message. Field = 1\r\n"
+                     "[COM1]\r\n<     BESTPOS COM1 0 72.0 FINESTEERING\r\n<OK\r\n[COM1]";
+    my_gps.BufferIncomingData((unsigned char*)data.c_str(), data.size());
+    my_gps.ExpireCommands();
+
+    ASSERT_TRUE(first.is_ready());
+    ASSERT_EQ(COMMAND_OK, first.get().status);
+    ASSERT_EQ(COMMAND_ERROR, second.get().status);
+    ASSERT_EQ("Invalid Message. Field = 1", second.get().message);
+    ASSERT_EQ(COMMAND_OK, third.get().status);
+    ASSERT_EQ(COMMAND_TIMEOUT, lost.get().status);
+    ASSERT_EQ("LOG TIMEB ONTIME 1", lost.get().command);
+
+    // a response with no command written for it is ignored
+    data="<OK\r\n";
+    my_gps.BufferIncomingData((unsigned char*)data.c_str(), data.size());
+    ASSERT_EQ(4u, my_gps.responses_received_);
+
+    // commands fail straight away when there is no port to write to
+    boost::unique_future<CommandResult> unsent=my_gps.SendCommandAsync("UNLOGALL");
+    ASSERT_TRUE(unsent.is_ready());
+    ASSERT_EQ(COMMAND_WRITE_FAILED, unsent.get().status);
+
+    // a command not waited for whose response is lost, as after COM,
+    // does not take the response of the next command
+    my_gps.WriteCommand("COM 9600", NULL);
+    my_gps.pending_commands_[4].deadline=boost::get_system_time();
+    boost::shared_future<CommandResult> after_lost=AddPendingCommand(my_gps, "LOG NOTALOGB ONCE", 2000);
+    data="<ERROR:Invalid Message ID\r\n";
+    my_gps.BufferIncomingData((unsigned char*)data.c_str(), data.size());
+    ASSERT_TRUE(after_lost.is_ready());
+    ASSERT_EQ(COMMAND_ERROR, after_lost.get().status);
+    ASSERT_EQ("Invalid Message ID", after_lost.get().message);
+
+    // closing the port ends every command still waiting
+    boost::shared_future<CommandResult> waiting=AddPendingCommand(my_gps, "LOG RANGEB ONCE", 2000);
+    my_gps.ClosePort(false);
+    ASSERT_TRUE(waiting.is_ready());
+    ASSERT_EQ(COMMAND_WRITE_FAILED, waiting.get().status);
+    ASSERT_EQ(0u, my_gps.commands_sent_);
+    ASSERT_TRUE(my_gps.pending_commands_.empty());
+}
+
+// defined in novatel.cpp
+unsigned long CalculateBlockCRC32(unsigned long ulCount, unsigned char *ucBuffer);
+
+// builds the receiver's binary response to a command
+std::string MakeBinaryResponse(BINARY_COMMAND_ID command_id, uint32_t response_id,
+                               const std::string &text) {
+    std::string body((const char*)&response_id, 4);
+    body+=text;
+    std::string response=EncodeCommand(command_id, body.data(), body.size());
+    unsigned char *data=(unsigned char*)&response[0];
+    data[6]|=RESPONSE_BIT;
+    uint32_t crc=CalculateBlockCRC32(response.size()-4, data);
+    memcpy(data+response.size()-4, &crc, 4);
+    return response;
+}
+
+boost::shared_future<CommandResult> AddPendingBinaryCommand(Novatel &gps, BINARY_COMMAND_ID command_id,
+                                                            const std::string &command) {
+    Novatel::PendingCommand pending;
+    pending.command=command;
+    pending.deadline=boost::get_system_time()+boost::posix_time::milliseconds(2000);
+    pending.promise.reset(new boost::promise<CommandResult>());
+    boost::shared_future<CommandResult> future(pending.promise->get_future());
+    gps.pending_binary_commands_[command_id].push_back(pending);
+    return future;
+}
+
+TEST(DataParsing, BinaryCommands) {
+    std::string log=EncodeLogCommand(BESTPOSB_LOG_TYPE, ONTIME, 0.5);
+    ASSERT_EQ(HEADER_SIZE+sizeof(LogCommand)+4, log.size());
+    Oem4BinaryHeader header;
+    memcpy(&header, log.data(), sizeof(header));
+    ASSERT_EQ(0xAA, header.sync1);
+    ASSERT_EQ(0x44, header.sync2);
+    ASSERT_EQ(0x12, header.sync3);
+    ASSERT_EQ(LOG_CMD_ID, header.message_id);
+    ASSERT_EQ(sizeof(LogCommand), header.message_length);
+    LogCommand body;
+    memcpy(&body, log.data()+HEADER_SIZE, sizeof(body));
+    ASSERT_EQ(BESTPOSB_LOG_TYPE, body.message_id);
+    ASSERT_EQ(ONTIME, body.trigger);
+    ASSERT_EQ(0.5, body.period);
+    // the CRC of a message including its CRC is 0
+    ASSERT_EQ(0u, CalculateBlockCRC32(log.size(), (unsigned char*)&log[0]));
+
+    Novatel my_gps;
+    boost::shared_future<CommandResult> first=AddPendingBinaryCommand(my_gps, LOG_CMD_ID, "LOG BESTPOSB");
+    boost::shared_future<CommandResult> second=AddPendingBinaryCommand(my_gps, LOG_CMD_ID, "LOG BADLOGB");
+    boost::shared_future<CommandResult> position=AddPendingBinaryCommand(my_gps, SETAPPROXPOS_CMD_ID, "SETAPPROXPOS");
+    boost::shared_future<CommandResult> cutoff=AddPendingBinaryCommand(my_gps, ECUTOFF_CMD_ID, "ECUTOFF 5");
+
+    // responses to different commands may be matched in any order
+    std::string corrupted=MakeBinaryResponse(ECUTOFF_CMD_ID, 1, "OK");
+    corrupted[HEADER_SIZE+5]='X';
+    std::string data=MakeBinaryResponse(SETAPPROXPOS_CMD_ID, 1, "OK")+"\r\n"+
+        MakeBinaryResponse(LOG_CMD_ID, 1, "OK")+corrupted+
+        MakeBinaryResponse(LOG_CMD_ID, 31, "Message ID not valid");
+    my_gps.BufferIncomingData((unsigned char*)data.data(), data.size());
+
+    ASSERT_TRUE(position.is_ready());
+    ASSERT_EQ(COMMAND_OK, position.get().status);
+    ASSERT_EQ(COMMAND_OK, first.get().status);
+    ASSERT_EQ(COMMAND_ERROR, second.get().status);
+    ASSERT_EQ("Message ID not valid", second.get().message);
+    // a response with a bad CRC is dropped
+    ASSERT_FALSE(cutoff.is_ready());
+    ASSERT_EQ(1u, my_gps.pending_binary_commands_.size());
+}
+
+TEST(DataParsing, AutoLogCommands) {
+    int master=OpenPseudoTerminal();
+    ASSERT_GE(master, 0);
+    Novatel my_gps;
+    my_gps.serial_port_.reset(new serial::Serial(ptsname(master), 115200, serial::Timeout::simpleTimeout(50)));
+    my_gps.baud_rate_=115200;
+
+    // a log the receiver rejects is not recorded as running
+    my_gps.SendAutoLogCommand(RANGEB_LOG_TYPE, true);
+    ASSERT_FALSE(my_gps.requested_logs_[RANGEB_LOG_TYPE]);
+    std::string data="<ERROR:Invalid Message ID\r\n";
+    my_gps.BufferIncomingData((unsigned char*)data.c_str(), data.size());
+    ASSERT_FALSE(my_gps.requested_logs_[RANGEB_LOG_TYPE]);
+
+    my_gps.SendAutoLogCommand(BESTPOSB_LOG_TYPE, true);
+    data="<OK\r\n";
+    my_gps.BufferIncomingData((unsigned char*)data.c_str(), data.size());
+    ASSERT_TRUE(my_gps.requested_logs_[BESTPOSB_LOG_TYPE]);
+
+    my_gps.ClosePort(false);
+    close(master);
+}
+
+TEST(DataParsing, WriterThread) {
+    // the writer thread writes to a pseudo terminal standing in for the receiver
+    int master=OpenPseudoTerminal();
+    ASSERT_GE(master, 0);
+
+    Novatel my_gps;
+    my_gps.serial_port_.reset(new serial::Serial(ptsname(master), 115200, serial::Timeout::simpleTimeout(50)));
+    my_gps.baud_rate_=115200;
+
+    // commands queued before the thread starts go out in a single write
+    my_gps.SendCommandAsync("LOG BESTPOSB ONTIME 1", 100);
+    my_gps.SendCommandAsync("LOG RANGEB ONTIME 1", 100);
+    my_gps.SendCommandAsync("LOG TIMEB ONTIME 1", 100);
+    ASSERT_EQ(3u, my_gps.GetWriterStatistics().queue_depth);
+    std::string corrections(1000, 'R');
+    ASSERT_FALSE(my_gps.SendCorrections((const unsigned char*)corrections.data(), corrections.size()));
+
+    boost::system_time start=boost::get_system_time();
+    my_gps.StartWriting();
+    ASSERT_TRUE(my_gps.SendCorrections((const unsigned char*)corrections.data(), corrections.size()));
+
+    std::string expected="LOG BESTPOSB ONTIME 1\r\nLOG RANGEB ONTIME 1\r\nLOG TIMEB ONTIME 1\r\n"+corrections;
+    std::string received;
+    char buffer[256];
+    while (received.size()<expected.size()) {
+        struct pollfd ready={master, POLLIN, 0};
+        ASSERT_EQ(1, poll(&ready, 1, 1000));
+        ssize_t count=read(master, buffer, sizeof(buffer));
+        ASSERT_GT(count, 0);
+        received.append(buffer, count);
+    }
+    double elapsed_ms=(boost::get_system_time()-start).total_milliseconds();
+    my_gps.StopWriting();
+
+    ASSERT_EQ(expected, received);
+    WriterStatistics statistics=my_gps.GetWriterStatistics();
+    ASSERT_EQ(3u, statistics.commands_written);
+    ASSERT_EQ(expected.size(), statistics.bytes_written);
+    ASSERT_EQ(0u, statistics.write_errors);
+    // 1000 correction bytes are written in 20 ms chunks of 230 bytes
+    ASSERT_LE(5u, statistics.writes);
+    ASSERT_LE(80, elapsed_ms);
+
+    my_gps.serial_port_.reset();
+    close(master);
+}
+
+TEST(DataParsing, Query) {
+    Novatel my_gps;
+    // with no port the LOG ONCE request fails straight away
+    boost::unique_future<Version> unsent=my_gps.Query<Version>(VERSIONB_LOG_TYPE);
+    ASSERT_TRUE(unsent.has_exception());
+    ASSERT_TRUE(my_gps.pending_queries_.empty());
+
+    // subscribe a query as StartQuery() does, without sending the request
+    boost::shared_ptr<QuerySubscriber<Version> > query(new QuerySubscriber<Version>(VERSIONB_LOG_TYPE));
+    boost::unique_future<Version> future=query->GetFuture();
+    SubscriptionId id=my_gps.AddSubscriber(query, typeid(Version));
+    ASSERT_NE(0u, id);
+    my_gps.pending_queries_[id].query=query;
+    my_gps.pending_queries_[id].deadline=boost::get_system_time()+boost::posix_time::seconds(2);
+
+    Version version;
+    memset(&version, 0, sizeof(version));
+    version.header.sync1=0xAA;
+    version.header.sync2=0x44;
+    version.header.sync3=0x12;
+    version.header.header_length=HEADER_SIZE;
+    version.header.message_id=VERSIONB_LOG_TYPE;
+    version.header.message_length=sizeof(version)-HEADER_SIZE-4;
+    version.number_of_components=1;
+    strcpy(version.model, "L12RV");
+    strcpy(version.serial_number, "DZZ06040010");
+    strcpy(version.hardware_version, "OEMV2G-2.00-2T");
+    strcpy(version.software_version, "3.000A19");
+    // a second reply must not disturb the completed query
+    std::string data((const char*)&version, sizeof(version));
+    data+=data;
+    my_gps.BufferIncomingData((unsigned char*)data.data(), data.size());
+
+    ASSERT_TRUE(future.is_ready());
+    Version reply=future.get();
+    ASSERT_STREQ("DZZ06040010", reply.serial_number);
+    my_gps.ExpireQueries();
+    ASSERT_TRUE(my_gps.pending_queries_.empty());
+    ASSERT_EQ(0u, my_gps.subscribers_.load()->subscribers.count(VERSIONB_LOG_TYPE));
+
+    ASSERT_TRUE(my_gps.ParseVersion(reply));
+    ASSERT_EQ("L12RV", my_gps.model_);
+    ASSERT_EQ("OEMV", my_gps.protocol_version_);
+    ASSERT_TRUE(my_gps.l2_capable_);
+    ASSERT_TRUE(my_gps.raw_capable_);
+    ASSERT_TRUE(my_gps.rtk_capable_);
+    ASSERT_FALSE(my_gps.span_capable_);
+}
+
+void RecordState(std::vector<ConnectionState> *states, ConnectionState state) {
+    states->push_back(state);
+}
+
+TEST(DataParsing, ConnectHandshake) {
+    Novatel my_gps;
+    std::vector<ConnectionState> states;
+    my_gps.set_connection_state_callback(boost::bind(RecordState, &states, _1));
+
+    // a port that cannot be opened ends the handshake straight away
+    ASSERT_FALSE(my_gps.Connect_("/dev/novatel_does_not_exist", 115200));
+    ASSERT_EQ(2u, states.size());
+    ASSERT_EQ(OPENING, states[0]);
+    ASSERT_EQ(DISCONNECTED, states[1]);
+    ASSERT_EQ(DISCONNECTED, my_gps.connection_state());
+
+    // a line that is already quiet is waited on for a few byte times
+    my_gps.baud_rate_=115200;
+    ASSERT_EQ(588u, my_gps.ResponseTimeout());
+    ASSERT_TRUE(my_gps.WaitForQuietLine(my_gps.ResponseTimeout()));
+
+    // a receiver that does not answer is asked for its version and left
+    // alone, in case it was only slow to answer
+    int master=OpenPseudoTerminal();
+    ASSERT_GE(master, 0);
+    my_gps.SetAutoReconnect(false);
+    ASSERT_FALSE(my_gps.Connect(ptsname(master), 115200, false));
+    std::string written;
+    char buffer[256];
+    struct pollfd ready={master, POLLIN, 0};
+    while (poll(&ready, 1, 0) == 1) {
+        ssize_t count=read(master, buffer, sizeof(buffer));
+        if (count <= 0)
+            break;
+        written.append(buffer, count);
+    }
+    close(master);
+    ASSERT_NE(std::string::npos, written.find("LOG VERSIONB ONCE"));
+    ASSERT_EQ(std::string::npos, written.find("UNLOGALL"));
+}
+
+void StreamLogs(int master, std::string logs) {
+    // a receiver sending the same logs over and over until the test closes the port
+    try {
+        for (int ii=0; ii<100; ii++) {
+            if (write(master, logs.data(), logs.size())<0)
+                return;
+            boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+        }
+    } catch (boost::thread_interrupted&) {}
+}
+
+TEST(DataParsing, BaudDetection) {
+    std::string ascii="#TIMEA,COM1,0,86.5,FINESTEERING,1337,410010.000,00000000,9924,1984;"
+        "VALID,1.667187222e-10,9.641617960e-10,-14.00000000000,2005,8,25,17,53,17000,VALID*d1a80614\r\n";
+    ApproximateTimeCommand time_command;
+    time_command.gps_week=1337;
+    time_command.gps_seconds=410010;
+    std::string binary=EncodeCommand(SETAPPROXTIME_CMD_ID, time_command);
+
+    // garbled bytes, a log cut short and a bad CRC don't count
+    std::string garbage="\xAA\x44\x12\x1c\xff\x13#\x80\x7f*zz\r\n";
+    ASSERT_EQ(0u, Novatel::ScoreBaudSample((const unsigned char*)garbage.data(), garbage.size()));
+    ASSERT_EQ(0u, Novatel::ScoreBaudSample((const unsigned char*)binary.data(), binary.size()-1));
+    std::string corrupted=ascii;
+    corrupted[10]='X';
+    ASSERT_EQ(0u, Novatel::ScoreBaudSample((const unsigned char*)corrupted.data(), corrupted.size()));
+
+    std::string sample=garbage+ascii+binary+garbage+binary+ascii.substr(0, 20);
+    ASSERT_EQ(3u, Novatel::ScoreBaudSample((const unsigned char*)sample.data(), sample.size()));
+
+    int master=OpenPseudoTerminal();
+    ASSERT_GE(master, 0);
+
+    // a silent line is listened to at every rate
+    Novatel my_gps;
+    ASSERT_EQ(0, my_gps.DetectBaudRate(ptsname(master), 100));
+
+    // a streaming receiver is found without sending it anything
+    boost::thread receiver(StreamLogs, master, garbage+ascii+binary);
+    ASSERT_EQ(115200, my_gps.DetectBaudRate(ptsname(master), 100));
+    receiver.interrupt();
+    receiver.join();
+    close(master);
+}
+
+TEST(DataParsing, ReceiverCache) {
+    char path[]="/tmp/novatel_cacheXXXXXX";
+    int fd=mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    unlink(path);
+
+    Novatel my_gps;
+    ASSERT_TRUE(my_gps.SetReceiverCacheFile(path));
+    my_gps.SetVersion("L12RV", "DZZ06040010", "OEMV2G-2.00-2T", "3.000A19");
+    my_gps.port_="/dev/ttyUSB0";
+    my_gps.RecordLogRequest("BESTPOSB ONTIME 0.05");
+    my_gps.RecordLogRequest("RANGEB ONTIME 1");
+    my_gps.UpdateReceiverCache(true);
+    my_gps.RecordLogRequest("RANGEB ONTIME 0.5");
+    my_gps.UpdateReceiverCache(false);
+
+    // logs requested with the same trigger are not sent again
+    ASSERT_TRUE(my_gps.ConfigureLogs("BESTPOSB ONTIME 0.05"));
+    ASSERT_FALSE(my_gps.IsLogRequested("BESTPOSB ONTIME 1"));
+    ASSERT_FALSE(my_gps.IsLogRequested("COM2 BESTPOSB ONTIME 0.05"));
+
+    // another instance finds the receiver in the cache file
+    Novatel restarted;
+    ASSERT_TRUE(restarted.SetReceiverCacheFile(path));
+    Novatel::CachedReceiver cached;
+    ASSERT_FALSE(restarted.FindCachedReceiver("/dev/ttyUSB1", &cached));
+    ASSERT_TRUE(restarted.FindCachedReceiver("/dev/ttyUSB0", &cached));
+    ASSERT_EQ("DZZ06040010", cached.serial_number);
+    ASSERT_EQ("L12RV", cached.model);
+    ASSERT_EQ("OEMV2G-2.00-2T", cached.hardware_version);
+    ASSERT_EQ("3.000A19", cached.software_version);
+    ASSERT_EQ(2u, cached.logs.size());
+    ASSERT_EQ("ONTIME 0.05", cached.logs[BESTPOSB_LOG_TYPE]);
+    ASSERT_EQ("ONTIME 0.5", cached.logs[RANGEB_LOG_TYPE]);
+    ASSERT_EQ(2u, cached.saved_logs.size());
+    ASSERT_EQ("ONTIME 1", cached.saved_logs[RANGEB_LOG_TYPE]);
+
+    restarted.ClearReceiverCache();
+    ASSERT_FALSE(restarted.FindCachedReceiver("/dev/ttyUSB0", &cached));
+    ASSERT_NE(0, access(path, F_OK));
+}
+
+void ReadLogList(Novatel *gps, std::vector<LogListEntry> *port_logs, bool *result) {
+    *result=gps->ReadLogList(port_logs);
+}
+
+TEST(DataParsing, LogListDiff) {
+    int master=OpenPseudoTerminal();
+    ASSERT_GE(master, 0);
+
+    Novatel my_gps;
+    my_gps.serial_port_.reset(new serial::Serial(ptsname(master), 115200, serial::Timeout::simpleTimeout(50)));
+    my_gps.baud_rate_=115200;
+    my_gps.StartWriting();
+    std::vector<LogListEntry> port_logs;
+    bool result=false;
+    boost::thread reader(ReadLogList, &my_gps, &port_logs, &result);
+
+    // wait for the LOG LOGLISTB ONCE request
+    char buffer[256];
+    struct pollfd ready={master, POLLIN, 0};
+    ASSERT_EQ(1, poll(&ready, 1, 1000));
+    ASSERT_GT(read(master, buffer, sizeof(buffer)), 0);
+
+    // the list arrives on COM1 and names logs on several ports
+    LogList list;
+    memset(&list, 0, sizeof(list));
+    list.header.sync1=0xAA;
+    list.header.sync2=0x44;
+    list.header.sync3=0x12;
+    list.header.header_length=HEADER_SIZE;
+    list.header.message_id=LOGLISTB_LOG_TYPE;
+    list.header.port_address=0x20;
+    list.number_of_logs=4;
+    list.header.message_length=4+4*sizeof(LogListEntry);
+    LogListEntry entries[4]={
+        {0x20, BESTPOSB_LOG_TYPE, 0, 0, ONTIME, 0.05, 0, 0},
+        {0x40, RANGEB_LOG_TYPE, 0, 0, ONTIME, 1, 0, 0},
+        {0x20, BESTPOSB_LOG_TYPE, 0x20, 0, ONTIME, 1, 0, 0},  // BESTPOSA
+        {0x20, TIMEB_LOG_TYPE, 0, 0, ONCE, 0, 0, 0}};
+    memcpy(list.logs, entries, sizeof(entries));
+    std::string data((const char*)&list, HEADER_SIZE+list.header.message_length+4);
+    my_gps.BufferIncomingData((unsigned char*)data.data(), data.size());
+    reader.join();
+    my_gps.StopWriting();
+
+    ASSERT_TRUE(result);
+    ASSERT_EQ(2u, port_logs.size());
+    ASSERT_TRUE(my_gps.requested_logs_[BESTPOSB_LOG_TYPE]);
+    ASSERT_FALSE(my_gps.requested_logs_[RANGEB_LOG_TYPE]);
+    ASSERT_FALSE(my_gps.requested_logs_[TIMEB_LOG_TYPE]);
+    ASSERT_EQ("ONTIME 0.05", my_gps.log_triggers_[BESTPOSB_LOG_TYPE]);
+
+    // only logs running differently need a command
+    ASSERT_TRUE(my_gps.IsLogRequested("BESTPOSB ONTIME 0.050"));
+    ASSERT_TRUE(my_gps.IsLogRequested("bestposb ontime 0.05 0 nohold"));
+    ASSERT_FALSE(my_gps.IsLogRequested("BESTPOSB ONTIME 1"));
+    ASSERT_FALSE(my_gps.IsLogRequested("BESTPOSB ONTIME 0.05 0 HOLD"));
+    ASSERT_FALSE(my_gps.IsLogRequested("RANGEB ONTIME 1"));
+
+    my_gps.serial_port_.reset();
+    close(master);
+}
+
+class GapRecorder : public Subscriber
+{
+public:
+    GapRecorder() : Subscriber(BESTPOSB_LOG_TYPE), gaps(0), messages(0) {}
+    void Deliver(void *message, double timestamp) {messages++;}
+    void Gap(double last_timestamp, double resumed_timestamp) {gaps++;}
+    int gaps;
+    unsigned int messages;
+};
+
+TEST(DataParsing, PortLoss) {
+    int master=OpenPseudoTerminal();
+    ASSERT_GE(master, 0);
+
+    Novatel my_gps;
+    // the fastest ONTIME log sets how long the receiver may be quiet
+    ASSERT_EQ(0u, my_gps.SilenceTimeout());
+    my_gps.RecordLogRequest("RANGEB ONTIME 1");
+    ASSERT_EQ(3050u, my_gps.SilenceTimeout());
+    my_gps.RecordLogRequest("BESTPOSB ONTIME 0.05");
+    ASSERT_EQ(250u, my_gps.SilenceTimeout());
+
+    boost::shared_ptr<GapRecorder> recorder(new GapRecorder);
+    my_gps.AddSubscriber(recorder, typeid(Position));
+
+    // the receiver disappearing ends the read thread instead of spinning
+    my_gps.serial_port_.reset(new serial::Serial(ptsname(master), 115200, serial::Timeout::simpleTimeout(50)));
+    my_gps.StartReading();
+    close(master);
+    {
+        boost::unique_lock<boost::mutex> lock(my_gps.supervisor_mutex_);
+        boost::system_time deadline=boost::get_system_time()+boost::posix_time::seconds(1);
+        while (!my_gps.port_lost_ && my_gps.supervisor_condition_.timed_wait(lock, deadline)) {}
+        ASSERT_TRUE(my_gps.port_lost_);
+    }
+    my_gps.StopReading();
+    ASSERT_FALSE(my_gps.IsConnected());
+
+    // subscribers hear of the gap once data arrives again
+    ASSERT_EQ(0, recorder->gaps);
+    unsigned char data[]="junk";
+    my_gps.BufferIncomingData(data, 4);
+    my_gps.BufferIncomingData(data, 4);
+    ASSERT_EQ(1, recorder->gaps);
+
+    my_gps.serial_port_.reset();
+}
+
+TEST(DataParsing, BandwidthPlan) {
+    Novatel my_gps;
+    std::string logs="RANGECMPB ONTIME 1;BESTPOSB ONTIME 0.05;RXSTATUSB ONCHANGED;COM2 BESTPOSB ONTIME 0.01";
+
+    // fits easily at 115200 baud; on change logs and other ports are left out
+    my_gps.baud_rate_=115200;
+    BandwidthPlan plan=my_gps.PlanBandwidth(logs);
+    ASSERT_EQ(3u, plan.logs.size());
+    ASSERT_DOUBLE_EQ(11520, plan.capacity);
+    ASSERT_DOUBLE_EQ(sizeof(Position)*20, plan.logs[1].bytes_per_second);
+    ASSERT_DOUBLE_EQ(0, plan.logs[2].bytes_per_second);
+    ASSERT_TRUE(plan.fits);
+
+    // not at 9600
+    my_gps.baud_rate_=9600;
+    plan=my_gps.PlanBandwidth(logs);
+    ASSERT_GT(plan.utilization, 1);
+    ASSERT_FALSE(plan.fits);
+
+    // replanning lengthens periods until the logs fit
+    plan=my_gps.PlanBandwidth(logs, true);
+    ASSERT_TRUE(plan.fits);
+    ASSERT_LE(plan.utilization, 0.8);
+    ASSERT_TRUE(plan.logs[1].replanned);
+    ASSERT_EQ(0u, plan.logs[1].log.find("BESTPOSB ONTIME 0."));
+
+    // sizes of logs received replace the typical sizes
+    my_gps.observed_log_sizes_[RANGECMPB_LOG_TYPE]=100;
+    plan=my_gps.PlanBandwidth("RANGECMPB ONTIME 0.5");
+    ASSERT_DOUBLE_EQ(200, plan.bytes_per_second);
+
+    // the lowest baud rate the logs fit into
+    ASSERT_EQ(9600, Novatel::SufficientBaudRate(700, 0.8, 921600));
+    ASSERT_EQ(38400, Novatel::SufficientBaudRate(sizeof(Position)*20, 0.8, 921600));
+    ASSERT_EQ(0, Novatel::SufficientBaudRate(20000, 0.8, 115200));
+    my_gps.SetBandwidthPolicy(BANDWIDTH_RAISE_BAUD);
+    ASSERT_FALSE(my_gps.SetBaudRate(115200));
+
+    // rejected logs are not sent
+    my_gps.SetBandwidthPolicy(BANDWIDTH_REJECT);
+    ASSERT_FALSE(my_gps.ConfigureLogs("BESTPOSB ONTIME 0.01"));
+}
+
+TEST(DataParsing, AdaptiveLogRates) {
+    Novatel my_gps;
+    // the least idle time and every status bit seen count
+    Oem4BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    header.idle=30;
+    header.status=0x100;
+    my_gps.RecordReceiverLoad(&header);
+    header.idle=150;
+    header.status=0x1;
+    my_gps.RecordReceiverLoad(&header);
+    ASSERT_EQ(30, my_gps.receiver_idle_);
+    ASSERT_EQ(0x101u, my_gps.receiver_status_);
+
+    my_gps.RecordLogRequest("SATVISB ONTIME 1");
+    my_gps.RecordLogRequest("TRACKSTATB ONTIME 5 0.5");
+    my_gps.RecordLogRequest("INSPVASB ONTIME 0.01");
+    my_gps.RecordLogRequest("GPSEPHEMB ONCHANGED");
+    Novatel::LogIdSet low_priority=my_gps.low_priority_logs_;
+
+    // only low priority ONTIME logs are slowed down, to 8 times their period
+    std::string logs=my_gps.AdjustLogRates(true, false, low_priority);
+    ASSERT_EQ("SATVISB ONTIME 2;TRACKSTATB ONTIME 10 0.5", logs);
+    for (int ii=0; ii<2; ii++) {
+        std::vector<std::string> acknowledged;
+        Tokenize(logs, acknowledged, ";");
+        for (size_t jj=0; jj<acknowledged.size(); jj++)
+            my_gps.RecordLogRequest(acknowledged[jj]);
+        logs=my_gps.AdjustLogRates(true, false, low_priority);
+    }
+    ASSERT_EQ("TRACKSTATB ONTIME 20 0.5", logs);
+    my_gps.RecordLogRequest(logs);
+    ASSERT_EQ("ONTIME 5", my_gps.log_triggers_[SATVISB_LOG_TYPE]);
+    ASSERT_EQ("ONTIME 0.01", my_gps.log_triggers_[INSPVAS_LOG_TYPE]);
+
+    // a log requested again is left alone, the others sped up a step at a time
+    my_gps.RecordLogRequest("SATVISB ONTIME 0.5");
+    for (int ii=0; ii<10 && !my_gps.throttled_logs_.empty(); ii++)
+        my_gps.RecordLogRequest(my_gps.AdjustLogRates(false, true, low_priority));
+    ASSERT_TRUE(my_gps.throttled_logs_.empty());
+    ASSERT_EQ("ONTIME 0.5", my_gps.log_triggers_[SATVISB_LOG_TYPE]);
+    ASSERT_EQ("ONTIME 5 0.5", my_gps.log_triggers_[TRACKSTATB_LOG_TYPE]);
+    ASSERT_EQ("", my_gps.AdjustLogRates(false, true, low_priority));
+}
+
+void RecordTimingEvent(std::vector<LogTimingEvent> *events, const LogTimingEvent &event) {
+    events->push_back(event);
+}
+
+void ReceiveEpoch(Novatel &gps, BINARY_LOG_TYPE log_type, uint32_t gps_millisecs, double late_ms=0) {
+    Oem4BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    header.message_id=log_type;
+    header.gps_week=1800;
+    header.gps_millisecs=gps_millisecs;
+    gps.frame_timestamp_=100+(gps_millisecs+late_ms)/1000.0;
+    gps.MonitorLogTiming(&header);
+}
+
+TEST(DataParsing, LogTiming) {
+    Novatel my_gps;
+    std::vector<LogTimingEvent> events;
+    my_gps.set_log_timing_callback(boost::bind(RecordTimingEvent, &events, _1));
+
+    // a log requested ONTIME is expected at its period
+    my_gps.RecordLogRequest("INSPVAB ONTIME 0.05");
+    ReceiveEpoch(my_gps, INSPVA_LOG_TYPE, 1000);
+    ReceiveEpoch(my_gps, INSPVA_LOG_TYPE, 1050);
+    ReceiveEpoch(my_gps, INSPVA_LOG_TYPE, 1100);
+    ASSERT_TRUE(events.empty());
+    ReceiveEpoch(my_gps, INSPVA_LOG_TYPE, 1250);
+    ReceiveEpoch(my_gps, INSPVA_LOG_TYPE, 1250);
+    ReceiveEpoch(my_gps, INSPVA_LOG_TYPE, 1200);
+    ReceiveEpoch(my_gps, INSPVA_LOG_TYPE, 1300, 5);
+    ASSERT_EQ(3u, events.size());
+    ASSERT_EQ(LOG_GAP, events[0].type);
+    ASSERT_EQ(INSPVA_LOG_TYPE, events[0].log_type);
+    ASSERT_EQ(2u, events[0].missed);
+    ASSERT_DOUBLE_EQ(1.1, events[0].previous_gps_time);
+    ASSERT_DOUBLE_EQ(1.25, events[0].gps_time);
+    ASSERT_EQ(LOG_DUPLICATE, events[1].type);
+    ASSERT_EQ(LOG_OUT_OF_ORDER, events[2].type);
+
+    LogTimingStatistics statistics=my_gps.GetLogTimingStatistics(INSPVA_LOG_TYPE);
+    ASSERT_DOUBLE_EQ(0.05, statistics.period);
+    ASSERT_EQ(7u, statistics.messages);
+    ASSERT_EQ(1u, statistics.gaps);
+    ASSERT_EQ(2u, statistics.missed);
+    ASSERT_EQ(1u, statistics.duplicates);
+    ASSERT_EQ(1u, statistics.out_of_order);
+    ASSERT_NEAR(5, statistics.max_jitter_ms, 1e-3);
+    ASSERT_EQ(3u, statistics.jitter_histogram[0]);
+    ASSERT_EQ(1u, statistics.jitter_histogram[3]);
+
+    // otherwise the period is learned from the messages
+    events.clear();
+    ReceiveEpoch(my_gps, BESTPOSB_LOG_TYPE, 0);
+    ReceiveEpoch(my_gps, BESTPOSB_LOG_TYPE, 3000);
+    ReceiveEpoch(my_gps, BESTPOSB_LOG_TYPE, 4000);
+    ASSERT_DOUBLE_EQ(0, my_gps.GetLogTimingStatistics(BESTPOSB_LOG_TYPE).period);
+    ReceiveEpoch(my_gps, BESTPOSB_LOG_TYPE, 5000);
+    ASSERT_DOUBLE_EQ(1, my_gps.GetLogTimingStatistics(BESTPOSB_LOG_TYPE).period);
+    ASSERT_TRUE(events.empty());
+    ReceiveEpoch(my_gps, BESTPOSB_LOG_TYPE, 8000);
+    ASSERT_EQ(1u, events.size());
+    ASSERT_EQ(2u, events[0].missed);
+    ASSERT_EQ(0u, my_gps.GetLogTimingStatistics(RANGEB_LOG_TYPE).messages);
+}
+
+//! More text than a socket buffers
+static std::string LargeMetricsText(boost::atomic<bool> *sending) {
+    *sending=true;
+    return std::string(16<<20, '#');
+}
+
+TEST(DataParsing, Metrics) {
+    Novatel my_gps;
+    ApproximateTimeCommand time_command;
+    time_command.gps_week=1337;
+    time_command.gps_seconds=410010;
+    std::string frame=EncodeCommand(SETAPPROXTIME_CMD_ID, time_command);
+    Position position;
+    memset(&position, 0, sizeof(position));
+    position.header.sync1=0xAA;
+    position.header.sync2=0x44;
+    position.header.sync3=0x12;
+    position.header.header_length=HEADER_SIZE;
+    position.header.message_id=BESTPOSB_LOG_TYPE;
+    position.header.message_length=sizeof(position)-HEADER_SIZE-4;
+    uint32_t crc=CalculateBlockCRC32(sizeof(position)-4, (unsigned char*)&position);
+    memcpy(position.crc, &crc, 4);
+    std::string logged((const char*)&position, sizeof(position));
+    std::string corrupted=logged;
+    corrupted[HEADER_SIZE]^=0xff;
+    // CRCs are checked on logs that are decoded
+    boost::shared_ptr<GapRecorder> recorder(new GapRecorder);
+    my_gps.AddSubscriber(recorder, typeid(Position));
+    std::string data=frame+"\xAA\x44\x13"+logged+corrupted;
+    my_gps.BufferIncomingData((unsigned char*)data.data(), data.size());
+    my_gps.metrics_.AddRoundTrip(1500);
+    my_gps.metrics_.AddRoundTrip(500);
+
+    MetricsSnapshot metrics=my_gps.GetMetrics();
+    ASSERT_EQ(data.size(), metrics.counters[METRIC_BYTES_READ]);
+    ASSERT_EQ(3u, metrics.counters[METRIC_FRAMES]);
+    ASSERT_EQ(1u, metrics.counters[METRIC_CRC_FAILURES]);
+    ASSERT_EQ(1u, metrics.counters[METRIC_RESYNCS]);
+    ASSERT_EQ(1u, metrics.counters[METRIC_UNKNOWN_LOGS]);
+    ASSERT_EQ(1u, metrics.log_frames[SETAPPROXTIME_CMD_ID]);
+    ASSERT_EQ(2u, metrics.log_frames[BESTPOSB_LOG_TYPE]);
+    ASSERT_EQ(2000u, metrics.counters[METRIC_COMMAND_ROUND_TRIP_US]);
+    ASSERT_EQ(1500u, metrics.command_round_trip_max_us);
+    ASSERT_FALSE(metrics.connected);
+
+    std::string text=my_gps.GetPrometheusMetrics();
+    ASSERT_NE(std::string::npos, text.find("# TYPE novatel_crc_failures_total counter\nnovatel_crc_failures_total 1\n"));
+    ASSERT_NE(std::string::npos, text.find("novatel_log_frames_total{id=\"42\",log=\"BESTPOSB\"} 2\n"));
+    ASSERT_NE(std::string::npos, text.find("novatel_command_round_trip_seconds_count 2\n"));
+
+    // a client connecting to the socket is sent the same text
+    char path[]="/tmp/novatel_metricsXXXXXX";
+    int fd=mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    ASSERT_TRUE(my_gps.ServeMetrics(path));
+    int client=socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family=AF_UNIX;
+    strcpy(address.sun_path, path);
+    ASSERT_EQ(0, connect(client, (sockaddr*)&address, sizeof(address)));
+    std::string received;
+    char buffer[1024];
+    ssize_t length;
+    while ((length=read(client, buffer, sizeof(buffer)))>0)
+        received.append(buffer, length);
+    close(client);
+    ASSERT_NE(std::string::npos, received.find("novatel_resyncs_total 1\n"));
+    my_gps.StopServingMetrics();
+    ASSERT_NE(0, access(path, F_OK));
+
+    // a client that never reads does not keep the server from stopping
+    MetricsServer server;
+    std::string error;
+    boost::atomic<bool> sending(false);
+    ASSERT_TRUE(server.Start(path, boost::bind(&LargeMetricsText, &sending), &error));
+    client=socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_EQ(0, connect(client, (sockaddr*)&address, sizeof(address)));
+    while (!sending)
+        boost::this_thread::yield();
+    server.Stop();
+    close(client);
+}
+
+TEST(DataParsing, Latency) {
+    // buckets are exact to 8 us and then within 12.5%
+    ASSERT_EQ(7u, LatencyHistogram::BucketTop(LatencyHistogram::BucketIndex(7)));
+    ASSERT_EQ(1023u, LatencyHistogram::BucketTop(LatencyHistogram::BucketIndex(1000)));
+    ASSERT_EQ(LATENCY_BUCKETS-1, LatencyHistogram::BucketIndex(uint64_t(1)<<50));
+    LatencyHistogram histogram;
+    for (uint64_t ii=1; ii<=1000; ii++)
+        histogram.Record(ii);
+    LatencySummary summary=histogram.Summarize();
+    ASSERT_EQ(1000u, summary.count);
+    ASSERT_DOUBLE_EQ(500.5, summary.mean_us);
+    ASSERT_EQ(511u, summary.p50_us);
+    ASSERT_EQ(959u, summary.p90_us);
+    ASSERT_EQ(1000u, summary.p99_us);
+    ASSERT_EQ(1000u, summary.max_us);
+
+    // a log half a second old is timed through each stage
+    Novatel my_gps;
+    boost::shared_ptr<GapRecorder> recorder(new GapRecorder);
+    my_gps.AddSubscriber(recorder, typeid(Position));
+    Position position;
+    memset(&position, 0, sizeof(position));
+    position.header.sync1=0xAA;
+    position.header.sync2=0x44;
+    position.header.sync3=0x12;
+    position.header.header_length=HEADER_SIZE;
+    position.header.message_id=BESTPOSB_LOG_TYPE;
+    position.header.message_length=sizeof(position)-HEADER_SIZE-4;
+    double gps_time=WallClockSeconds()-315964800.0+18-0.5;
+    position.header.gps_week=uint16_t(gps_time/604800);
+    position.header.gps_millisecs=uint32_t(fmod(gps_time, 604800)*1000);
+    my_gps.read_monotonic_us_=MonotonicMicroseconds();
+    my_gps.read_wall_time_=WallClockSeconds();
+    my_gps.BufferIncomingData((unsigned char*)&position, sizeof(position));
+    ASSERT_EQ(1u, recorder->messages);
+    ASSERT_EQ(1u, my_gps.GetLatency(BESTPOSB_LOG_TYPE, LATENCY_READ_TO_FRAME).count);
+    ASSERT_EQ(1u, my_gps.GetLatency(BESTPOSB_LOG_TYPE, LATENCY_FRAME_TO_DECODE).count);
+    // once for each subscriber, the recorder and the best position callback
+    ASSERT_EQ(2u, my_gps.GetLatency(BESTPOSB_LOG_TYPE, LATENCY_DECODE_TO_DISPATCH).count);
+    ASSERT_EQ(2u, my_gps.GetLatency(BESTPOSB_LOG_TYPE, LATENCY_CALLBACK).count);
+    LatencySummary age=my_gps.GetLatency(BESTPOSB_LOG_TYPE, LATENCY_MESSAGE_AGE);
+    ASSERT_NEAR(0.5, age.max_us/1e6, 0.1);
+    ASSERT_EQ(0u, my_gps.GetLatency(RANGEB_LOG_TYPE, LATENCY_CALLBACK).count);
+    ASSERT_NE(std::string::npos, my_gps.GetPrometheusMetrics().find(
+        "novatel_latency_seconds_count{id=\"42\",log=\"BESTPOSB\",stage=\"callback\"} 2\n"));
+
+    // untimed when turned off
+    my_gps.SetLatencyTracking(false);
+    my_gps.BufferIncomingData((unsigned char*)&position, sizeof(position));
+    ASSERT_EQ(2u, recorder->messages);
+    ASSERT_EQ(2u, my_gps.GetLatency(BESTPOSB_LOG_TYPE, LATENCY_CALLBACK).count);
+}
+
+TEST(DataParsing, Trace) {
+    Novatel my_gps;
+    boost::shared_ptr<GapRecorder> recorder(new GapRecorder);
+    my_gps.AddSubscriber(recorder, typeid(Position));
+    Position position;
+    memset(&position, 0, sizeof(position));
+    position.header.sync1=0xAA;
+    position.header.sync2=0x44;
+    position.header.sync3=0x12;
+    position.header.header_length=HEADER_SIZE;
+    position.header.message_id=BESTPOSB_LOG_TYPE;
+    position.header.message_length=sizeof(position)-HEADER_SIZE-4;
+
+    // nothing is kept until tracing starts
+    my_gps.BufferIncomingData((unsigned char*)&position, sizeof(position));
+    ASSERT_TRUE(my_gps.tracer_.Events(READER_SHARD).empty());
+
+    my_gps.StartTracing(4);
+    my_gps.BufferIncomingData((unsigned char*)&position, sizeof(position));
+    Novatel::PendingCommand pending;
+    my_gps.CompleteCommand(pending, COMMAND_TIMEOUT, "");
+    std::vector<TraceEvent> events=my_gps.tracer_.Events(READER_SHARD);
+    // a frame, its decode and a callback for each of the two subscribers
+    ASSERT_EQ(8u, my_gps.tracer_.rings_[READER_SHARD].capacity);
+    ASSERT_EQ(4u, events.size());
+    ASSERT_EQ(TRACE_FRAME, events[0].type);
+    ASSERT_EQ(BESTPOSB_LOG_TYPE, events[0].id);
+    ASSERT_EQ(sizeof(position), events[0].value);
+    ASSERT_EQ(TRACE_DECODE, events[1].type);
+    ASSERT_EQ(TRACE_CALLBACK, events[2].type);
+    ASSERT_EQ(1u, my_gps.tracer_.Events(SHARED_SHARD).size());
+
+    // the ring keeps the latest events, less the oldest slot once full
+    my_gps.BufferIncomingData((unsigned char*)&position, sizeof(position));
+    events=my_gps.tracer_.Events(READER_SHARD);
+    ASSERT_EQ(7u, events.size());
+    ASSERT_EQ(TRACE_DECODE, events[0].type);
+    ASSERT_EQ(TRACE_FRAME, events[3].type);
+    ASSERT_GE(events[3].start_ns, events[0].start_ns);
+
+    std::string trace=my_gps.GetTrace();
+    ASSERT_EQ(0u, trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    ASSERT_NE(std::string::npos, trace.find("\"name\":\"decode BESTPOSB\""));
+    ASSERT_NE(std::string::npos, trace.find("\"name\":\"command done\""));
+
+    my_gps.StopTracing();
+    my_gps.BufferIncomingData((unsigned char*)&position, sizeof(position));
+    ASSERT_EQ(events[3].start_ns, my_gps.tracer_.Events(READER_SHARD)[3].start_ns);
+}
+
+//! Waits for a count updated by the read thread to reach target, for up to 10 s
+static bool WaitForCount(const unsigned int &count, unsigned int target) {
+    for (int ii=0; (ii<1000) && (*(volatile const unsigned int*)&count < target); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    return count >= target;
+}
+
+TEST(Emulator, ConnectAndStream) {
+    ReceiverEmulator emulator;
+    ASSERT_TRUE(emulator.LoadCapture("test_data/ParsingData.GPS"));
+    ASSERT_TRUE(emulator.Start(115200));
+
+    Novatel my_gps;
+    my_gps.SetAutoReconnect(false);
+    my_gps.set_best_position_callback(BestPositionCallback());
+    // the search is only needed if the receiver does not answer at 115200
+    ASSERT_TRUE(my_gps.Connect(emulator.port()));
+    ASSERT_EQ("EMU00000001", my_gps.serial_number_);
+    boost::shared_ptr<GapRecorder> recorder(new GapRecorder);
+    my_gps.AddSubscriber(recorder, typeid(Position));
+    ASSERT_TRUE(my_gps.ConfigureLogs("BESTPOSB ONTIME 0.05"));
+    ASSERT_TRUE(WaitForCount(recorder->messages, 5u));
+    ASSERT_EQ(0u, my_gps.GetMetrics().counters[METRIC_CRC_FAILURES]);
+
+    // flipped bits are caught by the CRC and the stream carries on
+    EmulatorFaults faults;
+    faults.bit_flip_probability=0.002;
+    emulator.SetFaults(faults);
+    unsigned int received=recorder->messages;
+    for (int ii=0; (ii<1000) && (my_gps.GetMetrics().counters[METRIC_CRC_FAILURES] == 0); ii++)
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    ASSERT_GT(emulator.GetStatistics().bits_flipped, 0u);
+    ASSERT_GT(my_gps.GetMetrics().counters[METRIC_CRC_FAILURES], 0u);
+    ASSERT_TRUE(WaitForCount(recorder->messages, received+1));
+    my_gps.Disconnect();
+
+    std::vector<std::string> commands=emulator.GetCommands();
+    ASSERT_NE(commands.end(), std::find(commands.begin(), commands.end(), "LOG VERSIONB ONCE"));
+    ASSERT_NE(commands.end(), std::find(commands.begin(), commands.end(), "LOG BESTPOSB ONTIME 0.05"));
+}
+
+TEST(Emulator, BaudMismatch) {
+    ReceiverEmulator emulator;
+    ASSERT_TRUE(emulator.Start(9600));
+    EmulatorFaults faults;
+    faults.host_baud_rate=115200;
+    emulator.SetFaults(faults);
+
+    // nothing gets through at the wrong baud rate
+    Novatel my_gps;
+    my_gps.SetAutoReconnect(false);
+    ASSERT_FALSE(my_gps.Connect(emulator.port(), 115200, false));
+    ASSERT_EQ(0u, emulator.GetStatistics().commands);
+    faults.host_baud_rate=9600;
+    emulator.SetFaults(faults);
+    ASSERT_TRUE(my_gps.Connect(emulator.port(), 9600, false));
+    my_gps.Disconnect();
+}
+
+// keeps the last message of a log handed to it
+template <typename T>
+class LastMessage : public Subscriber
+{
+public:
+    LastMessage(BINARY_LOG_TYPE log_type) : Subscriber(log_type), messages(0) {
+        memset(&message, 0, sizeof(message));
+    }
+    void Deliver(void *decoded, double timestamp) {
+        message = *static_cast<T*>(decoded);
+        messages++;
+    }
+    T message;
+    unsigned int messages;
+};
+
+TEST(Encoder, RoundTrip) {
+    Novatel my_gps;
+    my_gps.set_best_position_callback(BestPositionCallback());
+    boost::shared_ptr<LastMessage<Position> > position(new LastMessage<Position>(BESTPOSB_LOG_TYPE));
+    boost::shared_ptr<LastMessage<RangeMeasurements> > range(new LastMessage<RangeMeasurements>(RANGEB_LOG_TYPE));
+    boost::shared_ptr<LastMessage<LogList> > log_list(new LastMessage<LogList>(LOGLISTB_LOG_TYPE));
+    my_gps.AddSubscriber(position, typeid(Position));
+    my_gps.AddSubscriber(range, typeid(RangeMeasurements));
+    my_gps.AddSubscriber(log_list, typeid(LogList));
+    boost::shared_ptr<LastMessage<ReceiverConfiguration> > config(
+        new LastMessage<ReceiverConfiguration>(RXCONFIGB_LOG_TYPE));
+    my_gps.AddSubscriber(config, typeid(ReceiverConfiguration));
+
+    // a log that fills its structure comes back byte for byte
+    Position sent_position;
+    memset(&sent_position, 0, sizeof(sent_position));
+    sent_position.header.gps_week = 1700;
+    sent_position.header.gps_millisecs = 345600000;
+    sent_position.position_type = NARROW_INT;
+    sent_position.latitude = 32.5;
+    sent_position.longitude = -85.25;
+    sent_position.number_of_satellites = 9;
+    std::string encoded = EncodeLog(BESTPOSB_LOG_TYPE, sent_position);
+    ASSERT_EQ(sizeof(Position), encoded.size());
+    my_gps.BufferIncomingData((unsigned char*)&encoded[0], encoded.size());
+    ASSERT_EQ(1u, position->messages);
+    ASSERT_EQ(0, memcmp(&position->message, encoded.data(), sizeof(Position)));
+    ASSERT_EQ(-85.25, position->message.longitude);
+    ASSERT_EQ(1700, position->message.header.gps_week);
+
+    // only the records counted are sent, and at most MAX_CHAN decoded
+    RangeMeasurements sent_range;
+    memset(&sent_range, 0, sizeof(sent_range));
+    sent_range.number_of_observations = 3;
+    for (int ii=0; ii<3; ii++) {
+        sent_range.range_data[ii].satellite_prn = ii+5;
+        sent_range.range_data[ii].pseudorange = 2.1e7 + ii;
+    }
+    encoded = EncodeLog(RANGEB_LOG_TYPE, sent_range);
+    ASSERT_EQ(HEADER_SIZE + 4 + 3*sizeof(RangeData) + 4, encoded.size());
+    my_gps.BufferIncomingData((unsigned char*)&encoded[0], encoded.size());
+    ASSERT_EQ(1u, range->messages);
+    ASSERT_EQ(3, range->message.number_of_observations);
+    ASSERT_EQ(7, range->message.range_data[2].satellite_prn);
+    ASSERT_EQ(2.1e7 + 2, range->message.range_data[2].pseudorange);
+    std::vector<RangeData> records(MAX_CHAN+10, sent_range.range_data[0]);
+    encoded = EncodeLog(RANGEB_LOG_TYPE, &sent_range, 4, &records[0], sizeof(RangeData), records.size());
+    my_gps.BufferIncomingData((unsigned char*)&encoded[0], encoded.size());
+    ASSERT_EQ(2u, range->messages);
+    ASSERT_EQ(MAX_CHAN, range->message.number_of_observations);
+
+    LogList sent_log_list;
+    memset(&sent_log_list, 0, sizeof(sent_log_list));
+    sent_log_list.number_of_logs = 1;
+    sent_log_list.logs[0].message_id = BESTPOSB_LOG_TYPE;
+    sent_log_list.logs[0].trigger = ONTIME;
+    sent_log_list.logs[0].period = 0.05;
+    encoded = EncodeLog(LOGLISTB_LOG_TYPE, sent_log_list);
+    my_gps.BufferIncomingData((unsigned char*)&encoded[0], encoded.size());
+    ASSERT_EQ(1u, log_list->messages);
+    ASSERT_EQ(0.05, log_list->message.logs[0].period);
+
+    // the embedded command keeps its own CRC
+    ReceiverConfiguration sent_config;
+    memset(&sent_config, 0, sizeof(sent_config));
+    sent_config.command_header.message_id = 1;
+    sent_config.command_header.message_length = 8;
+    for (int ii=0; ii<12; ii++)
+        sent_config.command[ii] = ii+1;
+    encoded = EncodeLog(RXCONFIGB_LOG_TYPE, sent_config);
+    ASSERT_EQ(2*HEADER_SIZE + 8 + 4 + 4, encoded.size());
+    my_gps.BufferIncomingData((unsigned char*)&encoded[0], encoded.size());
+    ASSERT_EQ(1u, config->messages);
+    ASSERT_EQ(0, memcmp(&config->message.command_header, &encoded[HEADER_SIZE], HEADER_SIZE + 12));
+    ASSERT_EQ(12, config->message.command[11]);
+    ASSERT_EQ(0u, my_gps.GetMetrics().counters[METRIC_CRC_FAILURES]);
+
+    InsPositionVelocityAttitudeShort sent_ins;
+    memset(&sent_ins, 0, sizeof(sent_ins));
+    encoded = EncodeLog(INSPVAS_LOG_TYPE, sent_ins);
+    ASSERT_EQ(sizeof(sent_ins), encoded.size());
+    ASSERT_EQ(0x13, (unsigned char)encoded[2]);
+    ASSERT_EQ(sizeof(sent_ins) - SHORT_HEADER_SIZE - 4, (unsigned char)encoded[3]);
+}
+
+TEST(Encoder, SyntheticStream) {
+    SyntheticStreamConfig config;
+    config.satellites = 100;
+    config.rates[INSPVA_LOG_TYPE] = 200;
+    config.rates[RANGECMPB_LOG_TYPE] = 50;
+    config.rates[BESTPOSB_LOG_TYPE] = 20;
+    config.rates[GPSEPHEMB_LOG_TYPE] = 1;   // not generated
+    SyntheticStream stream(config);
+
+    Novatel my_gps;
+    my_gps.set_best_position_callback(BestPositionCallback());
+    boost::shared_ptr<LastMessage<InsPositionVelocityAttitude> > ins(
+        new LastMessage<InsPositionVelocityAttitude>(INSPVA_LOG_TYPE));
+    boost::shared_ptr<LastMessage<CompressedRangeMeasurements> > range(
+        new LastMessage<CompressedRangeMeasurements>(RANGECMPB_LOG_TYPE));
+    boost::shared_ptr<LastMessage<Position> > position(new LastMessage<Position>(BESTPOSB_LOG_TYPE));
+    my_gps.AddSubscriber(ins, typeid(InsPositionVelocityAttitude));
+    my_gps.AddSubscriber(range, typeid(CompressedRangeMeasurements));
+    my_gps.AddSubscriber(position, typeid(Position));
+
+    // ten seconds of logs, fed in reads of about 1000 bytes
+    std::string data;
+    while (stream.time() < 10) {
+        data += stream.Next();
+        if (data.size() >= 1000) {
+            my_gps.BufferIncomingData((unsigned char*)&data[0], data.size());
+            data.clear();
+        }
+    }
+    my_gps.BufferIncomingData((unsigned char*)&data[0], data.size());
+    ASSERT_NEAR(2700, stream.logs(), 2);
+    ASSERT_NEAR(2000, ins->messages, 1);
+    ASSERT_NEAR(500, range->messages, 1);
+    ASSERT_NEAR(200, position->messages, 1);
+    ASSERT_EQ(0u, my_gps.GetMetrics().counters[METRIC_CRC_FAILURES]);
+    ASSERT_EQ(0u, my_gps.GetMetrics().counters[METRIC_RESYNCS]);
+    // all 100 records are sent, MAX_CHAN decoded
+    ASSERT_EQ(MAX_CHAN, range->message.number_of_observations);
+    ASSERT_EQ(HEADER_SIZE + 4 + 100*sizeof(CompressedRangeData) + 4,
+        my_gps.observed_log_sizes_[RANGECMPB_LOG_TYPE].load());
+    // a radian round the 100 m circle at 10 m/s
+    ASSERT_NEAR(32.6 + 100*sin(1.0)/111132.954, ins->message.latitude, 1e-6);
+    ASSERT_NEAR(180/M_PI, ins->message.azimuth, 0.1);
+}
+
 int main(int argc, char **argv) {
   try {
     ::testing::InitGoogleTest(&argc, argv);